@@ -0,0 +1,97 @@
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.EOFException;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
+
+import unluac.Configuration;
+import unluac.decompile.Decompiler;
+import unluac.decompile.OutputProvider;
+import unluac.parse.BHeader;
+
+// Decompiles a stream of Lua chunks in one JVM, for bemt's lua_decomp_dir (see UnluacWorker in
+// lua/unluacInterface.h). Run as: java -cp unluac.jar UnluacDriver.java (Java 11+).
+//
+// Request: u32 size (little-endian), then the bytecode.
+// Response: u8 status (0 if decompiled), u32 size (little-endian), then the source or the error.
+// The driver exits once its stdin is closed.
+//
+// Written against the classes of the bundled unluac.jar (1.2.3), the same ones its Main uses.
+public class UnluacDriver {
+    public static void main(String[] args) throws IOException {
+        DataInputStream in = new DataInputStream(new BufferedInputStream(System.in, 1 << 16));
+        OutputStream out = new BufferedOutputStream(System.out, 1 << 16);
+        // Anything unluac prints itself would corrupt the responses.
+        System.setOut(System.err);
+
+        byte[] sizeBytes = new byte[4];
+        while (true) {
+            try {
+                in.readFully(sizeBytes);
+            }
+            catch (EOFException e) {
+                break;
+            }
+
+            int size = ByteBuffer.wrap(sizeBytes).order(ByteOrder.LITTLE_ENDIAN).getInt();
+            byte[] bytecode = new byte[size];
+            in.readFully(bytecode);
+
+            byte status = 0;
+            byte[] result;
+            try {
+                result = decompile(bytecode);
+            }
+            catch (Throwable t) {
+                status = 1;
+                result = String.valueOf(t).getBytes(StandardCharsets.UTF_8);
+            }
+
+            out.write(status);
+            out.write(ByteBuffer.allocate(4).order(ByteOrder.LITTLE_ENDIAN).putInt(result.length).array());
+            out.write(result);
+            out.flush();
+        }
+    }
+
+    private static byte[] decompile(byte[] bytecode) {
+        ByteBuffer buffer = ByteBuffer.wrap(bytecode);
+        buffer.order(ByteOrder.LITTLE_ENDIAN);
+
+        BHeader header = new BHeader(buffer, new Configuration());
+
+        Decompiler decompiler = new Decompiler(header.main);
+        Decompiler.State state = decompiler.decompile();
+
+        // Characters are bytes, like unluac's own file output.
+        final ByteArrayOutputStream text = new ByteArrayOutputStream();
+        decompiler.print(state, new OutputProvider() {
+            @Override
+            public void print(String s) {
+                for (int i = 0; i < s.length(); i++)
+                    text.write(s.charAt(i));
+            }
+
+            @Override
+            public void print(byte b) {
+                text.write(b);
+            }
+
+            @Override
+            public void println() {
+                text.write('\n');
+            }
+
+            @Override
+            public void finish() {
+            }
+        });
+
+        return text.toByteArray();
+    }
+}
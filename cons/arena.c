@@ -0,0 +1,181 @@
+#include "arena.h"
+
+#include "macro.h"
+
+#include <stdlib.h>
+
+#include <string.h>
+
+typedef struct _ConsArenaBlock {
+    struct _ConsArenaBlock* next;
+    u64 used;
+    u64 capacity;
+    _Alignas(16) u8 data[];
+} _ConsArenaBlock;
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define ARENA_DEFAULT_ALIGNMENT (16)
+
+static _ConsArenaBlock* _CreateBlock(u64 capacity) {
+    _ConsArenaBlock* block = malloc(sizeof(_ConsArenaBlock) + capacity);
+
+    block->next = NULL;
+    block->used = 0;
+    block->capacity = capacity;
+
+    return block;
+}
+
+void ArenaInit(ConsArena* arena, u64 blockSize) {
+    if (arena == NULL)
+        return;
+
+    arena->_blocks = NULL;
+    arena->_blockSize = (blockSize != 0) ? blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+static void _FreeBlocksUntil(_ConsArenaBlock* block, _ConsArenaBlock* end) {
+    while (block != end) {
+        _ConsArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+void ArenaDestroy(ConsArena* arena) {
+    if (arena == NULL)
+        return;
+
+    _FreeBlocksUntil(arena->_blocks, NULL);
+    arena->_blocks = NULL;
+}
+
+// Offset of the next free byte in a block that has the given alignment.
+static u64 _GetAlignedOffset(const _ConsArenaBlock* block, u64 alignment) {
+    const u64 address = (u64)(uintptr_t)(block->data + block->used);
+    return block->used + (ALIGN_UP(address, alignment) - address);
+}
+
+void* ArenaAllocAligned(ConsArena* arena, u64 size, u64 alignment) {
+    if (arena == NULL)
+        return NULL;
+
+    _ConsArenaBlock* block = arena->_blocks;
+    if (block != NULL) {
+        const u64 offset = _GetAlignedOffset(block, alignment);
+        if (offset <= block->capacity && size <= block->capacity - offset) {
+            block->used = offset + size;
+            return block->data + offset;
+        }
+    }
+
+    // Block data is 16-byte aligned; larger alignments may need padding.
+    const u64 padding = (alignment > ARENA_DEFAULT_ALIGNMENT) ? alignment : 0;
+
+    block = _CreateBlock(MAX(arena->_blockSize, size + padding));
+    block->next = arena->_blocks;
+    arena->_blocks = block;
+
+    const u64 offset = _GetAlignedOffset(block, alignment);
+    block->used = offset + size;
+    return block->data + offset;
+}
+
+void* ArenaAlloc(ConsArena* arena, u64 size) {
+    return ArenaAllocAligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
+void* ArenaRealloc(ConsArena* arena, void* data, u64 oldSize, u64 newSize) {
+    if (arena == NULL)
+        return NULL;
+    if (data == NULL)
+        return ArenaAlloc(arena, newSize);
+
+    // The last allocation can grow (or shrink) in place.
+    _ConsArenaBlock* block = arena->_blocks;
+    if (block != NULL && (u8*)data + oldSize == block->data + block->used) {
+        const u64 offset = (u64)((u8*)data - block->data);
+        if (newSize <= block->capacity - offset) {
+            block->used = offset + newSize;
+            return data;
+        }
+    }
+
+    if (newSize <= oldSize)
+        return data;
+
+    void* newData = ArenaAlloc(arena, newSize);
+    memcpy(newData, data, oldSize);
+    return newData;
+}
+
+char* ArenaStrndup(ConsArena* arena, const char* str, u64 len) {
+    if (arena == NULL || str == NULL)
+        return NULL;
+
+    const char* end = memchr(str, '\0', len);
+    if (end != NULL)
+        len = (u64)(end - str);
+
+    char* copy = ArenaAllocAligned(arena, len + 1, 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    return copy;
+}
+
+char* ArenaStrdup(ConsArena* arena, const char* str) {
+    if (arena == NULL || str == NULL)
+        return NULL;
+
+    const u64 len = strlen(str);
+
+    char* copy = ArenaAllocAligned(arena, len + 1, 1);
+    memcpy(copy, str, len + 1);
+
+    return copy;
+}
+
+ConsArenaMark ArenaGetMark(const ConsArena* arena) {
+    ConsArenaMark mark;
+    mark._block = arena->_blocks;
+    mark._used = (arena->_blocks != NULL) ? arena->_blocks->used : 0;
+
+    return mark;
+}
+
+void ArenaResetToMark(ConsArena* arena, ConsArenaMark mark) {
+    if (arena == NULL)
+        return;
+
+    _FreeBlocksUntil(arena->_blocks, mark._block);
+
+    arena->_blocks = mark._block;
+    if (mark._block != NULL)
+        mark._block->used = mark._used;
+}
+
+void ArenaReset(ConsArena* arena) {
+    if (arena == NULL || arena->_blocks == NULL)
+        return;
+
+    _ConsArenaBlock* block = arena->_blocks;
+    _FreeBlocksUntil(block->next, NULL);
+
+    block->next = NULL;
+    block->used = 0;
+}
+
+void ArenaAdopt(ConsArena* arena, ConsArena* other) {
+    if (arena == NULL || other == NULL || other->_blocks == NULL)
+        return;
+
+    _ConsArenaBlock* last = other->_blocks;
+    while (last->next != NULL)
+        last = last->next;
+
+    last->next = arena->_blocks;
+    arena->_blocks = other->_blocks;
+
+    other->_blocks = NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef CONS_ARENA_H
+#define CONS_ARENA_H
+
+// CONS -- arena (bump) allocator
+
+#include "type.h"
+
+// Allocations are carved out of large blocks and freed all at once (or back to a mark), instead
+// of one by one. Not thread-safe; use one arena per thread & adopt them afterwards.
+typedef struct ConsArena {
+    struct _ConsArenaBlock* _blocks; // Newest first; allocations come from the newest.
+    u64 _blockSize;
+} ConsArena;
+
+// A position in an arena to reset back to.
+typedef struct ConsArenaMark {
+    struct _ConsArenaBlock* _block;
+    u64 _used;
+} ConsArenaMark;
+
+// Initialize an empty arena. Blocks are blockSize bytes (0 for the default of 64 KiB), or larger
+// for allocations that don't fit.
+void ArenaInit(ConsArena* arena, u64 blockSize);
+
+// Destroy an arena, freeing every allocation made from it.
+void ArenaDestroy(ConsArena* arena);
+
+// Allocate uninitialized memory (aligned to 16 bytes).
+void* ArenaAlloc(ConsArena* arena, u64 size);
+// Allocate uninitialized memory with the given alignment (a power of two).
+void* ArenaAllocAligned(ConsArena* arena, u64 size, u64 alignment);
+
+// Resize an allocation. The last allocation is grown in place when possible, otherwise the data
+// is copied to a new allocation (the old one is only reclaimed when the arena is reset).
+void* ArenaRealloc(ConsArena* arena, void* data, u64 oldSize, u64 newSize);
+
+// Copy a string into the arena.
+char* ArenaStrdup(ConsArena* arena, const char* str);
+// Copy (at most) len characters of a string into the arena, null-terminated.
+char* ArenaStrndup(ConsArena* arena, const char* str, u64 len);
+
+// Get the current position in an arena.
+ConsArenaMark ArenaGetMark(const ConsArena* arena);
+// Free everything allocated since a mark was taken. Used to scope temporary allocations:
+//     ConsArenaMark mark = ArenaGetMark(arena);
+//     ... (temporary allocations)
+//     ArenaResetToMark(arena, mark);
+void ArenaResetToMark(ConsArena* arena, ConsArenaMark mark);
+// Free everything allocated from an arena, keeping the newest block for reuse.
+void ArenaReset(ConsArena* arena);
+
+// Move every allocation of another arena into this one (other is left empty). They count as
+// newer than any mark taken before.
+void ArenaAdopt(ConsArena* arena, ConsArena* other);
+
+#endif // CONS_ARENA_H
@@ -1,7 +1,17 @@
 #include "buffer.h"
 
+#include "file.h"
+
+#include "macro.h"
+
 #include <stdlib.h>
 
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 void BufferInit(ConsBuffer* buffer, u64 size) {
     if (buffer == NULL)
         return;
@@ -16,6 +26,135 @@ void BufferInit(ConsBuffer* buffer, u64 size) {
     buffer->size = size;
 }
 
+void BufferInitUninit(ConsBuffer* buffer, u64 size) {
+    if (buffer == NULL)
+        return;
+
+    buffer->data_void = (size == 0) ? NULL : malloc(size);
+    buffer->size = size;
+}
+
+// Buffer pool
+
+// Blocks from 64 KiB to 64 MiB are kept, one free list per power of two.
+#define BUFFER_POOL_MIN_SHIFT (16)
+#define BUFFER_POOL_MAX_SHIFT (26)
+#define BUFFER_POOL_CLASS_COUNT (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1)
+
+// Shared by every thread: blocks are often released on another thread than the one that took
+// them (loaded on one thread, compressed or written on another).
+#define BUFFER_POOL_MAX_BLOCKS_PER_CLASS (4)
+#define BUFFER_POOL_MAX_CACHED_SIZE (128 * 1024 * 1024)
+
+// Blocks at least this large are aligned to it & may be backed by huge pages.
+#define BUFFER_POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct _BufferPoolBlock {
+    struct _BufferPoolBlock* next;
+} _BufferPoolBlock;
+
+// Blocks are at least 64 KiB, so the lock is cheap next to filling one.
+static struct {
+    pthread_mutex_t mutex;
+
+    _BufferPoolBlock* freeBlocks[BUFFER_POOL_CLASS_COUNT];
+    u32 blockCounts[BUFFER_POOL_CLASS_COUNT];
+    u64 cachedSize;
+} _bufferPool = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+// Smallest shift where (1 << shift) >= size.
+static u32 _CeilShift(u64 size) {
+    return (size <= 1) ? 0 : 64 - (u32)__builtin_clzll(size - 1);
+}
+// Largest shift where (1 << shift) <= size.
+static u32 _FloorShift(u64 size) {
+    return 63 - (u32)__builtin_clzll(size);
+}
+
+static void* _BufferPoolAllocBlock(u64 size) {
+#ifdef __linux__
+    if (size >= BUFFER_POOL_HUGE_PAGE_SIZE) {
+        void* block;
+        if (posix_memalign(&block, BUFFER_POOL_HUGE_PAGE_SIZE, size) != 0)
+            return NULL;
+
+        // Fewer page faults & TLB misses for big blocks where transparent huge pages are opt-in.
+        madvise(block, size, MADV_HUGEPAGE);
+        return block;
+    }
+#endif
+    return malloc(size);
+}
+
+void BufferInitPooled(ConsBuffer* buffer, u64 size) {
+    if (buffer == NULL)
+        return;
+
+    const u32 shift = _CeilShift(size);
+    if (size < (1ull << BUFFER_POOL_MIN_SHIFT) || shift > BUFFER_POOL_MAX_SHIFT) {
+        BufferInitUninit(buffer, size);
+        return;
+    }
+
+    const u32 classIndex = shift - BUFFER_POOL_MIN_SHIFT;
+
+    pthread_mutex_lock(&_bufferPool.mutex);
+
+    _BufferPoolBlock* block = _bufferPool.freeBlocks[classIndex];
+    if (block != NULL) {
+        _bufferPool.freeBlocks[classIndex] = block->next;
+        _bufferPool.blockCounts[classIndex]--;
+        _bufferPool.cachedSize -= 1ull << shift;
+    }
+
+    pthread_mutex_unlock(&_bufferPool.mutex);
+
+    if (block == NULL)
+        block = _BufferPoolAllocBlock(1ull << shift);
+
+    buffer->data_void = block;
+    buffer->size = size;
+}
+
+void BufferReleasePooled(ConsBuffer* buffer) {
+    if (buffer == NULL || buffer->data_void == NULL)
+        return;
+
+    // A block holds at least buffer->size bytes (even after shrinking), so it can serve
+    // requests up to the power of two below that.
+    const u32 shift = _FloorShift(buffer->size);
+    if (shift < BUFFER_POOL_MIN_SHIFT || shift > BUFFER_POOL_MAX_SHIFT) {
+        BufferDestroy(buffer);
+        return;
+    }
+
+    const u32 classIndex = shift - BUFFER_POOL_MIN_SHIFT;
+
+    pthread_mutex_lock(&_bufferPool.mutex);
+
+    const bool keep =
+        _bufferPool.blockCounts[classIndex] < BUFFER_POOL_MAX_BLOCKS_PER_CLASS &&
+        _bufferPool.cachedSize + (1ull << shift) <= BUFFER_POOL_MAX_CACHED_SIZE;
+
+    if (keep) {
+        _BufferPoolBlock* block = buffer->data_void;
+        block->next = _bufferPool.freeBlocks[classIndex];
+        _bufferPool.freeBlocks[classIndex] = block;
+        _bufferPool.blockCounts[classIndex]++;
+        _bufferPool.cachedSize += 1ull << shift;
+    }
+
+    pthread_mutex_unlock(&_bufferPool.mutex);
+
+    if (!keep) {
+        BufferDestroy(buffer);
+        return;
+    }
+
+    buffer->data_void = NULL;
+    buffer->size = 0;
+}
+
 void BufferInitCopy(ConsBuffer* buffer, const void* data, u64 size) {
     if (buffer == NULL)
         return;
@@ -71,6 +210,26 @@ void BufferResize(ConsBuffer* buffer, u64 newSize) {
     buffer->size = newSize;
 }
 
+void BufferResizeUninit(ConsBuffer* buffer, u64 newSize) {
+    if (buffer == NULL)
+        return;
+
+    if (buffer->data_void == NULL) {
+        BufferInitUninit(buffer, newSize);
+        return;
+    }
+
+    if (buffer->size == newSize)
+        return;
+    if (newSize == 0) {
+        BufferDestroy(buffer);
+        return;
+    }
+
+    buffer->data_void = realloc(buffer->data_void, newSize);
+    buffer->size = newSize;
+}
+
 void BufferGrow(ConsBuffer* buffer, s64 growBy) {
     if (!buffer || growBy == 0)
         return;
@@ -108,3 +267,165 @@ bool BufferViewCompare(ConsBufferView a, ConsBufferView b) {
     
     return false;
 }
+
+// Buffer builder
+
+#define BUFFER_BUILDER_MIN_CAPACITY (64)
+
+// Builders writing through to a file write once this much has been built.
+#define BUFFER_BUILDER_FLUSH_SIZE (1024 * 1024)
+
+void BufferBuilderInit(ConsBufferBuilder* builder, u64 initialCapacity) {
+    if (builder == NULL)
+        return;
+
+    BufferInitUninit(&builder->buffer, initialCapacity);
+    builder->_capacity = initialCapacity;
+    builder->buffer.size = 0;
+
+    builder->_file = NULL;
+    builder->_fileOffset = 0;
+    builder->_flushedSize = 0;
+    builder->_failed = false;
+}
+
+void BufferBuilderInitFile(ConsBufferBuilder* builder, struct ConsFile* file, u64 fileOffset) {
+    if (builder == NULL)
+        return;
+
+    BufferBuilderInit(builder, BUFFER_BUILDER_FLUSH_SIZE);
+    builder->_file = file;
+    builder->_fileOffset = fileOffset;
+}
+
+static bool _BufferBuilderWriteThrough(ConsBufferBuilder* builder) {
+    if (builder->buffer.size == 0)
+        return true;
+
+    if (!FileWriteAt(
+        builder->_file, builder->buffer.data_void,
+        builder->_fileOffset + builder->_flushedSize, builder->buffer.size
+    ))
+        builder->_failed = true;
+
+    builder->_flushedSize += builder->buffer.size;
+    builder->buffer.size = 0;
+
+    return !builder->_failed;
+}
+
+void BufferBuilderReserve(ConsBufferBuilder* builder, u64 size) {
+    if (builder == NULL)
+        return;
+
+    const u64 requiredCapacity = builder->buffer.size + size;
+    if (requiredCapacity <= builder->_capacity)
+        return;
+
+    u64 newCapacity = MAX(builder->_capacity * 2, (u64)BUFFER_BUILDER_MIN_CAPACITY);
+    if (newCapacity < requiredCapacity)
+        newCapacity = requiredCapacity;
+
+    builder->buffer.data_void = realloc(builder->buffer.data_void, newCapacity);
+    builder->_capacity = newCapacity;
+}
+
+u64 BufferBuilderAppend(ConsBufferBuilder* builder, const void* data, u64 size) {
+    if (builder == NULL)
+        return 0;
+
+    const u64 offset = BufferBuilderGetSize(builder);
+    if (size == 0)
+        return offset;
+
+    // Write what's pending through first instead of growing past the flush size.
+    if (builder->_file != NULL && builder->buffer.size + size > builder->_capacity)
+        _BufferBuilderWriteThrough(builder);
+
+    BufferBuilderReserve(builder, size);
+
+    u8* dst = builder->buffer.data_u8 + builder->buffer.size;
+    if (data != NULL)
+        memcpy(dst, data, size);
+    else
+        memset(dst, 0x00, size);
+
+    builder->buffer.size += size;
+
+    if (builder->_file != NULL && builder->buffer.size >= BUFFER_BUILDER_FLUSH_SIZE)
+        _BufferBuilderWriteThrough(builder);
+
+    return offset;
+}
+
+u64 BufferBuilderAppendAligned(ConsBufferBuilder* builder, const void* data, u64 size, u64 alignment) {
+    if (builder == NULL)
+        return 0;
+
+    const u64 currentSize = BufferBuilderGetSize(builder);
+    const u64 paddingSize = ALIGN_UP(currentSize, MAX(alignment, 1ull)) - currentSize;
+
+    BufferBuilderAppend(builder, NULL, paddingSize);
+    return BufferBuilderAppend(builder, data, size);
+}
+
+bool BufferBuilderPatch(ConsBufferBuilder* builder, u64 offset, const void* data, u64 size) {
+    if (builder == NULL || data == NULL)
+        return false;
+    if (offset > BufferBuilderGetSize(builder) || size > BufferBuilderGetSize(builder) - offset)
+        return false;
+
+    const u8* src = data;
+
+    // Part that was already written through.
+    if (offset < builder->_flushedSize) {
+        const u64 flushedPatchSize = MIN(size, builder->_flushedSize - offset);
+        if (!FileWriteAt(builder->_file, src, builder->_fileOffset + offset, flushedPatchSize)) {
+            builder->_failed = true;
+            return false;
+        }
+
+        src += flushedPatchSize;
+        offset += flushedPatchSize;
+        size -= flushedPatchSize;
+    }
+
+    if (size > 0)
+        memcpy(builder->buffer.data_u8 + (offset - builder->_flushedSize), src, size);
+
+    return true;
+}
+
+bool BufferBuilderFlush(ConsBufferBuilder* builder) {
+    if (builder == NULL)
+        return false;
+    if (builder->_file == NULL)
+        return true;
+
+    _BufferBuilderWriteThrough(builder);
+    return !builder->_failed;
+}
+
+ConsBuffer BufferBuilderFinish(ConsBufferBuilder* builder) {
+    if (builder == NULL)
+        return (ConsBuffer){ 0 };
+
+    ConsBuffer buffer = builder->buffer;
+    if (buffer.size == 0)
+        BufferDestroy(&buffer);
+    else if (buffer.size != builder->_capacity)
+        buffer.data_void = realloc(buffer.data_void, buffer.size);
+
+    builder->buffer = (ConsBuffer){ 0 };
+    builder->_capacity = 0;
+
+    return buffer;
+}
+
+void BufferBuilderDestroy(ConsBufferBuilder* builder) {
+    if (builder == NULL)
+        return;
+
+    BufferDestroy(&builder->buffer);
+    builder->_capacity = 0;
+}
@@ -75,6 +75,13 @@ static inline ConsBufferView BufferViewFromCstr(char* cstr) {
 
 // Creates a zero-initialized buffer of the given size.
 void BufferInit(ConsBuffer* buffer, u64 size);
+// Creates a buffer of the given size without initializing it. Use when every byte is written
+// before it's read.
+void BufferInitUninit(ConsBuffer* buffer, u64 size);
+// Creates an uninitialized buffer of the given size, reusing a released block if there is one
+// (on any thread). Large blocks are rounded up to a power of two.
+// The buffer may be destroyed normally with BufferDestroy.
+void BufferInitPooled(ConsBuffer* buffer, u64 size);
 // Creates a buffer by copying data from a raw pointer.
 void BufferInitCopy(ConsBuffer* buffer, const void* data, u64 size);
 // Creates a buffer by copying data from a buffer view.
@@ -82,10 +89,17 @@ void BufferInitCopyView(ConsBuffer* buffer, ConsBufferView view);
 
 // Destroy a buffer. It's safe to pass in a uninitialized buffer.
 void BufferDestroy(ConsBuffer* buffer);
+// Destroy a buffer, keeping large blocks in a shared, bounded pool for BufferInitPooled to reuse
+// (so their pages don't have to be faulted in again). Any buffer may be released this way, on
+// any thread.
+void BufferReleasePooled(ConsBuffer* buffer);
 
 // Resize a buffer. It's safe to pass in a uninitialized buffer.
 void BufferResize(ConsBuffer* buffer, u64 newSize);
 
+// Resize a buffer, leaving any new bytes uninitialized. It's safe to pass in a uninitialized buffer.
+void BufferResizeUninit(ConsBuffer* buffer, u64 newSize);
+
 // Grow a buffer (increase it's size by growBy). Supports negative values.
 // It's safe to pass in a uninitialized buffer.
 void BufferGrow(ConsBuffer* buffer, s64 growBy);
@@ -98,4 +112,53 @@ static inline void* BufferGetEnd(ConsBuffer* buffer) {
 
 bool BufferViewCompare(ConsBufferView a, ConsBufferView b);
 
+// Builds a buffer piece by piece. The capacity grows geometrically, so appending is amortized
+// O(1). Optionally, the data is written through to a file as it's built, so only the part not
+// yet written is kept in memory.
+typedef struct ConsBufferBuilder {
+    ConsBuffer buffer; // Data not yet written through; buffer.size is the used size.
+    u64 _capacity;
+
+    struct ConsFile* _file; // NULL unless writing through to a file.
+    u64 _fileOffset; // Offset in the file the builder starts at.
+    u64 _flushedSize; // Bytes already written through.
+    bool _failed; // A write through failed.
+} ConsBufferBuilder;
+
+// Initialize an empty builder.
+void BufferBuilderInit(ConsBufferBuilder* builder, u64 initialCapacity);
+// Initialize a builder that writes through to a file, starting at fileOffset. Offsets passed to
+// and returned by the builder are relative to fileOffset.
+void BufferBuilderInitFile(ConsBufferBuilder* builder, struct ConsFile* file, u64 fileOffset);
+
+// Get the amount of bytes built so far (including those written through).
+static inline u64 BufferBuilderGetSize(const ConsBufferBuilder* builder) {
+    return builder->_flushedSize + builder->buffer.size;
+}
+
+// Make sure at least size more bytes can be appended without growing.
+void BufferBuilderReserve(ConsBufferBuilder* builder, u64 size);
+
+// Append bytes (zeroes if data is NULL).
+// Returns the offset they were appended at.
+u64 BufferBuilderAppend(ConsBufferBuilder* builder, const void* data, u64 size);
+// Append bytes at the next multiple of alignment (a power of two), padding with zeroes.
+// Returns the offset they were appended at.
+u64 BufferBuilderAppendAligned(ConsBufferBuilder* builder, const void* data, u64 size, u64 alignment);
+
+// Overwrite bytes that were already appended (e.g. a header whose fields are known last).
+// Returns true on success, false on failure (out of range, or the write through failed).
+bool BufferBuilderPatch(ConsBufferBuilder* builder, u64 offset, const void* data, u64 size);
+
+// Write everything built so far through to the file. Does nothing for builders without a file.
+// Returns true if every write through succeeded, false otherwise.
+bool BufferBuilderFlush(ConsBufferBuilder* builder);
+
+// Finish a builder without a file, returning the built buffer (trimmed to size). The builder is
+// left empty.
+ConsBuffer BufferBuilderFinish(ConsBufferBuilder* builder);
+
+// Destroy a builder (without flushing).
+void BufferBuilderDestroy(ConsBufferBuilder* builder);
+
 #endif // CONS_BUFFER_H
@@ -0,0 +1,589 @@
+#include "bulkwrite.h"
+
+#include "file.h"
+#include "threadpool.h"
+
+#include "error.h"
+
+#include "macro.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <string.h>
+
+#include <errno.h>
+
+#include <pthread.h>
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <direct.h> // _mkdir
+
+#else // _WIN32
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#endif // _WIN32
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define BULK_WRITE_IO_URING
+
+#endif // __linux__
+
+// Files per batch. Each file takes up to three submissions (open, write, close).
+#define BULK_WRITE_BATCH_COUNT (64)
+// A batch is submitted early once it holds this much data.
+#define BULK_WRITE_BATCH_SIZE (16 * 1024 * 1024)
+
+// The thread pool only lets this much data wait to be written.
+#define BULK_WRITE_POOL_MAX_QUEUED_SIZE (32 * 1024 * 1024)
+
+typedef struct _BulkEntry {
+    char* path;
+    ConsBuffer data;
+} _BulkEntry;
+
+static void _BulkEntryDestroy(_BulkEntry* entry) {
+    free(entry->path);
+    BufferReleasePooled(&entry->data);
+}
+
+// Directory cache
+
+static bool _CreateDirectory(ConsBulkWriter* writer, char* dirPath, u64 dirPathLen) {
+    if (dirPathLen == 0 || PtrieSearchLen(&writer->_createdDirs, dirPath, dirPathLen) != NULL)
+        return true;
+
+    // Parents first (each only once, thanks to the cache).
+    char* lastSlash = NULL;
+    for (u64 i = dirPathLen; i > 0; i--) {
+        if (dirPath[i - 1] == '/' || dirPath[i - 1] == '\\') {
+            lastSlash = dirPath + i - 1;
+            break;
+        }
+    }
+    if (lastSlash != NULL && lastSlash != dirPath) {
+        const char separator = *lastSlash;
+        *lastSlash = '\0';
+        const bool ok = _CreateDirectory(writer, dirPath, (u64)(lastSlash - dirPath));
+        *lastSlash = separator;
+
+        if (!ok)
+            return false;
+    }
+
+#ifdef _WIN32
+    if (_mkdir(dirPath) != 0 && errno != EEXIST)
+        return false;
+#else
+    if (mkdir(dirPath, 0700) != 0 && errno != EEXIST)
+        return false;
+#endif
+
+    // The cache borrows its keys, so they're kept in the arena.
+    char* key = ArenaAlloc(&writer->_arena, dirPathLen);
+    memcpy(key, dirPath, dirPathLen);
+    PtrieInsertLen(&writer->_createdDirs, key, dirPathLen);
+    return true;
+}
+
+bool BulkWriterCreateParentDirs(ConsBulkWriter* writer, const char* path) {
+    if (writer == NULL || path == NULL)
+        return false;
+
+    const char* lastSlash = strrchr(path, '/');
+#ifdef _WIN32
+    const char* lastBackslash = strrchr(path, '\\');
+    if (lastBackslash > lastSlash)
+        lastSlash = lastBackslash;
+#endif
+    if (lastSlash == NULL)
+        return true;
+
+    const u64 dirPathLen = (u64)(lastSlash - path);
+
+    char* dirPath = malloc(dirPathLen + 1);
+    memcpy(dirPath, path, dirPathLen);
+    dirPath[dirPathLen] = '\0';
+
+    const bool ok = _CreateDirectory(writer, dirPath, dirPathLen);
+
+    free(dirPath);
+    return ok;
+}
+
+static void _FinishEntry(ConsBulkWriter* writer, _BulkEntry* entry, bool written) {
+    if (written)
+        writer->fileCount++;
+    else {
+        Warn("BulkWriter: failed to write file at path '%s'", entry->path);
+        writer->failedCount++;
+    }
+
+    _BulkEntryDestroy(entry);
+}
+
+#ifdef BULK_WRITE_IO_URING
+
+// io_uring backend
+
+// Two batches: one is filled while the other is in flight. Each has its own range of
+// registered file slots.
+#define BULK_RING_SLOT_COUNT (BULK_WRITE_BATCH_COUNT * 2)
+#define BULK_RING_ENTRIES (256)
+_Static_assert(BULK_RING_ENTRIES >= BULK_WRITE_BATCH_COUNT * 3, "ring must fit a whole batch");
+
+typedef enum _BulkRingOp {
+    BULK_RING_OP_OPEN,
+    BULK_RING_OP_WRITE,
+    BULK_RING_OP_CLOSE,
+
+    BULK_RING_OP_COUNT
+} _BulkRingOp;
+
+typedef struct _BulkRingBatch {
+    _BulkEntry entries[BULK_WRITE_BATCH_COUNT];
+    bool isFailed[BULK_WRITE_BATCH_COUNT];
+    u32 count;
+    u64 size;
+
+    u32 firstSlot;
+    u32 pendingCompletions; // Non-zero while in flight.
+} _BulkRingBatch;
+
+typedef struct _ConsBulkRing {
+    int fd;
+
+    void* sqRing;
+    u64 sqRingSize;
+    void* cqRing; // Same as sqRing with IORING_FEAT_SINGLE_MMAP.
+    u64 cqRingSize;
+
+    struct io_uring_sqe* sqes;
+    u64 sqesSize;
+
+    u32* sqTail;
+    u32 sqMask;
+    u32* sqArray;
+
+    u32* cqHead;
+    u32* cqTail;
+    u32 cqMask;
+    struct io_uring_cqe* cqes;
+
+    _BulkRingBatch batches[2];
+    u32 currentBatch;
+} _ConsBulkRing;
+
+static int _RingEnter(int fd, u32 toSubmit, u32 minComplete, u32 flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static void _RingDestroy(_ConsBulkRing* ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing)
+        munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED)
+        munmap(ring->sqRing, ring->sqRingSize);
+
+    close(ring->fd);
+    free(ring);
+}
+
+// Returns NULL if io_uring (or direct file descriptors, Linux 5.19+) isn't available.
+static _ConsBulkRing* _RingCreate(void) {
+    struct io_uring_params params;
+    memset(&params, 0x00, sizeof(params));
+
+    const int fd = (int)syscall(__NR_io_uring_setup, BULK_RING_ENTRIES, &params);
+    if (fd < 0)
+        return NULL;
+
+    _ConsBulkRing* ring = calloc(1, sizeof(_ConsBulkRing));
+    ring->fd = fd;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+        ring->sqRingSize = ring->cqRingSize = MAX(ring->sqRingSize, ring->cqRingSize);
+
+    ring->sqRing = mmap(
+        NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING
+    );
+    if (ring->sqRing == MAP_FAILED) {
+        _RingDestroy(ring);
+        return NULL;
+    }
+
+    ring->cqRing = singleMmap ? ring->sqRing : mmap(
+        NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING
+    );
+    if (ring->cqRing == MAP_FAILED) {
+        _RingDestroy(ring);
+        return NULL;
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(
+        NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES
+    );
+    if (ring->sqes == MAP_FAILED) {
+        _RingDestroy(ring);
+        return NULL;
+    }
+
+    u8* sqRing = ring->sqRing;
+    ring->sqTail = (u32*)(sqRing + params.sq_off.tail);
+    ring->sqMask = *(u32*)(sqRing + params.sq_off.ring_mask);
+    ring->sqArray = (u32*)(sqRing + params.sq_off.array);
+
+    u8* cqRing = ring->cqRing;
+    ring->cqHead = (u32*)(cqRing + params.cq_off.head);
+    ring->cqTail = (u32*)(cqRing + params.cq_off.tail);
+    ring->cqMask = *(u32*)(cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cqRing + params.cq_off.cqes);
+
+    // Files are opened straight into registered slots, so the write & close can be linked to
+    // the open without knowing its file descriptor.
+    struct io_uring_rsrc_register filesRegister;
+    memset(&filesRegister, 0x00, sizeof(filesRegister));
+    filesRegister.nr = BULK_RING_SLOT_COUNT;
+    filesRegister.flags = IORING_RSRC_REGISTER_SPARSE;
+
+    if (syscall(
+        __NR_io_uring_register, fd, IORING_REGISTER_FILES2, &filesRegister, sizeof(filesRegister)
+    ) != 0) {
+        _RingDestroy(ring);
+        return NULL;
+    }
+
+    ring->batches[0].firstSlot = 0;
+    ring->batches[1].firstSlot = BULK_WRITE_BATCH_COUNT;
+
+    return ring;
+}
+
+static struct io_uring_sqe* _RingPushSqe(_ConsBulkRing* ring, u32* tail, u8 opcode, u64 userData) {
+    const u32 index = *tail & ring->sqMask;
+    (*tail)++;
+
+    struct io_uring_sqe* sqe = ring->sqes + index;
+    memset(sqe, 0x00, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = userData;
+
+    ring->sqArray[index] = index;
+    return sqe;
+}
+
+static void _RingSubmitBatch(_ConsBulkRing* ring, _BulkRingBatch* batch) {
+    u32 tail = *ring->sqTail;
+    u32 submissionCount = 0;
+
+    for (u32 i = 0; i < batch->count; i++) {
+        const _BulkEntry* entry = batch->entries + i;
+        const u32 slot = batch->firstSlot + i;
+        const bool hasData = BufferIsValid(&entry->data);
+
+        batch->isFailed[i] = false;
+
+        struct io_uring_sqe* sqe = _RingPushSqe(
+            ring, &tail, IORING_OP_OPENAT, (u64)i * BULK_RING_OP_COUNT + BULK_RING_OP_OPEN
+        );
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (u64)(uintptr_t)entry->path;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC; // O_CLOEXEC isn't allowed with direct descriptors.
+        sqe->len = 0666; // Mode (same as fopen).
+        sqe->file_index = slot + 1; // 1-based.
+        sqe->flags = IOSQE_IO_LINK;
+        submissionCount++;
+
+        if (hasData) {
+            sqe = _RingPushSqe(
+                ring, &tail, IORING_OP_WRITE, (u64)i * BULK_RING_OP_COUNT + BULK_RING_OP_WRITE
+            );
+            sqe->fd = (s32)slot;
+            sqe->addr = (u64)(uintptr_t)entry->data.data_void;
+            sqe->len = (u32)entry->data.size;
+            sqe->off = 0;
+            // Close even if the write fails.
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            submissionCount++;
+        }
+
+        sqe = _RingPushSqe(
+            ring, &tail, IORING_OP_CLOSE, (u64)i * BULK_RING_OP_COUNT + BULK_RING_OP_CLOSE
+        );
+        sqe->file_index = slot + 1;
+        submissionCount++;
+    }
+
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+    batch->pendingCompletions = submissionCount;
+
+    u32 submitted = 0;
+    while (submitted < submissionCount) {
+        const int ret = _RingEnter(ring->fd, submissionCount - submitted, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            Panic("BulkWriter: io_uring_enter failed (errno %d)", errno);
+        }
+        submitted += (u32)ret;
+    }
+}
+
+static void _RingWaitBatch(ConsBulkWriter* writer, _ConsBulkRing* ring, _BulkRingBatch* batch) {
+    while (batch->pendingCompletions > 0) {
+        u32 head = *ring->cqHead;
+        const u32 tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (_RingEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                Panic("BulkWriter: io_uring_enter failed (errno %d)", errno);
+            continue;
+        }
+
+        for (; head != tail; head++) {
+            const struct io_uring_cqe* cqe = ring->cqes + (head & ring->cqMask);
+
+            const u32 i = (u32)(cqe->user_data / BULK_RING_OP_COUNT);
+            const _BulkRingOp op = (_BulkRingOp)(cqe->user_data % BULK_RING_OP_COUNT);
+
+            // Writes to regular files are only short on error, so treat short ones as failed too.
+            if (cqe->res < 0 || (op == BULK_RING_OP_WRITE && (u64)cqe->res != batch->entries[i].data.size))
+                batch->isFailed[i] = true;
+
+            batch->pendingCompletions--;
+        }
+
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    for (u32 i = 0; i < batch->count; i++) {
+        _BulkEntry* entry = batch->entries + i;
+
+        // Retry failed files the plain way.
+        const bool written = !batch->isFailed[i] || FileWriteMem(BUFFER_TO_VIEW(entry->data), entry->path);
+        _FinishEntry(writer, entry, written);
+    }
+
+    batch->count = 0;
+    batch->size = 0;
+}
+
+// Submit the current batch (once the one in flight is done) and start filling the other one.
+static void _RingFlushCurrent(ConsBulkWriter* writer, _ConsBulkRing* ring) {
+    _BulkRingBatch* batch = ring->batches + ring->currentBatch;
+    _BulkRingBatch* otherBatch = ring->batches + (ring->currentBatch ^ 1);
+
+    _RingWaitBatch(writer, ring, otherBatch);
+
+    if (batch->count > 0) {
+        _RingSubmitBatch(ring, batch);
+        ring->currentBatch ^= 1;
+    }
+}
+
+static void _RingAdd(ConsBulkWriter* writer, _ConsBulkRing* ring, _BulkEntry* entry) {
+    // The write length is 32-bit.
+    if (entry->data.size > 0xFFFFFFFFull) {
+        _FinishEntry(writer, entry, FileWriteMem(BUFFER_TO_VIEW(entry->data), entry->path));
+        return;
+    }
+
+    _BulkRingBatch* batch = ring->batches + ring->currentBatch;
+    batch->entries[batch->count++] = *entry;
+    batch->size += entry->data.size;
+
+    if (batch->count >= BULK_WRITE_BATCH_COUNT || batch->size >= BULK_WRITE_BATCH_SIZE)
+        _RingFlushCurrent(writer, ring);
+}
+
+static void _RingFlush(ConsBulkWriter* writer, _ConsBulkRing* ring) {
+    _RingFlushCurrent(writer, ring);
+    _RingWaitBatch(writer, ring, ring->batches + (ring->currentBatch ^ 1));
+}
+
+#endif // BULK_WRITE_IO_URING
+
+// Thread pool backend
+
+typedef struct _ConsBulkPool {
+    ConsBulkWriter* writer;
+    ConsThreadPool* threadPool;
+
+    ConsTaskGroup group;
+    u64 queuedSize;
+
+    pthread_mutex_t mutex; // Guards queuedSize & the writer's counters.
+    pthread_cond_t cond;
+} _ConsBulkPool;
+
+typedef struct _BulkPoolTask {
+    _ConsBulkPool* pool;
+    _BulkEntry entry;
+} _BulkPoolTask;
+
+static void _PoolWriteTask(void* userData) {
+    _BulkPoolTask* task = userData;
+    _ConsBulkPool* pool = task->pool;
+
+    const bool written = FileWriteMem(BUFFER_TO_VIEW(task->entry.data), task->entry.path);
+    const u64 size = task->entry.data.size;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    // The counters are shared, so finish under the lock.
+    _FinishEntry(pool->writer, &task->entry, written);
+
+    pool->queuedSize -= size;
+    pthread_cond_broadcast(&pool->cond);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    free(task);
+}
+
+static _ConsBulkPool* _PoolCreate(ConsBulkWriter* writer, ConsThreadPool* threadPool) {
+    _ConsBulkPool* pool = calloc(1, sizeof(_ConsBulkPool));
+    pool->writer = writer;
+    pool->threadPool = threadPool;
+
+    TaskGroupInit(&pool->group);
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    return pool;
+}
+
+static void _PoolAdd(_ConsBulkPool* pool, _BulkEntry* entry) {
+    pthread_mutex_lock(&pool->mutex);
+
+    // Don't let too much data pile up.
+    while (pool->queuedSize > 0 && pool->queuedSize + entry->data.size > BULK_WRITE_POOL_MAX_QUEUED_SIZE)
+        pthread_cond_wait(&pool->cond, &pool->mutex);
+
+    pool->queuedSize += entry->data.size;
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    _BulkPoolTask* task = malloc(sizeof(_BulkPoolTask));
+    task->pool = pool;
+    task->entry = *entry;
+
+    ThreadPoolSubmit(pool->threadPool, &pool->group, _PoolWriteTask, task);
+}
+
+static void _PoolFlush(_ConsBulkPool* pool) {
+    ThreadPoolWait(pool->threadPool, &pool->group);
+}
+
+static void _PoolDestroy(_ConsBulkPool* pool) {
+    _PoolFlush(pool);
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+
+    free(pool);
+}
+
+void BulkWriterInit(ConsBulkWriter* writer, ConsThreadPool* threadPool) {
+    if (writer == NULL)
+        return;
+
+    writer->fileCount = 0;
+    writer->failedCount = 0;
+
+    ArenaInit(&writer->_arena, 0);
+    PtrieInitArena(&writer->_createdDirs, &writer->_arena);
+
+    writer->_ring = NULL;
+    writer->_pool = NULL;
+
+#ifdef BULK_WRITE_IO_URING
+    writer->_ring = _RingCreate();
+#endif
+    writer->usesIoUring = writer->_ring != NULL;
+
+    if (writer->_ring == NULL && threadPool != NULL)
+        writer->_pool = _PoolCreate(writer, threadPool);
+}
+
+void BulkWriterAdd(ConsBulkWriter* writer, const char* path, ConsBuffer data) {
+    if (writer == NULL || path == NULL)
+        return;
+
+    _BulkEntry entry;
+    entry.path = strdup(path);
+    entry.data = data;
+
+    // If this fails, so will the write (which is counted).
+    if (!BulkWriterCreateParentDirs(writer, path))
+        Warn("BulkWriter: failed to create parent directories of path '%s'", path);
+
+#ifdef BULK_WRITE_IO_URING
+    if (writer->_ring != NULL) {
+        _RingAdd(writer, writer->_ring, &entry);
+        return;
+    }
+#endif
+
+    if (writer->_pool != NULL) {
+        _PoolAdd(writer->_pool, &entry);
+        return;
+    }
+
+    _FinishEntry(writer, &entry, FileWriteMem(BUFFER_TO_VIEW(entry.data), entry.path));
+}
+
+bool BulkWriterFlush(ConsBulkWriter* writer) {
+    if (writer == NULL)
+        return false;
+
+#ifdef BULK_WRITE_IO_URING
+    if (writer->_ring != NULL)
+        _RingFlush(writer, writer->_ring);
+#endif
+    if (writer->_pool != NULL)
+        _PoolFlush(writer->_pool);
+
+    return writer->failedCount == 0;
+}
+
+void BulkWriterDestroy(ConsBulkWriter* writer) {
+    if (writer == NULL)
+        return;
+
+    BulkWriterFlush(writer);
+
+#ifdef BULK_WRITE_IO_URING
+    if (writer->_ring != NULL)
+        _RingDestroy(writer->_ring);
+#endif
+    if (writer->_pool != NULL)
+        _PoolDestroy(writer->_pool);
+
+    writer->_ring = NULL;
+    writer->_pool = NULL;
+
+    PtrieDestroy(&writer->_createdDirs);
+    ArenaDestroy(&writer->_arena);
+}
@@ -0,0 +1,48 @@
+#ifndef CONS_BULKWRITE_H
+#define CONS_BULKWRITE_H
+
+// CONS -- bulk file writer (many small files)
+
+#include "arena.h"
+#include "buffer.h"
+#include "ptrie.h"
+#include "threadpool.h"
+
+#include "type.h"
+
+// Writes are queued and carried out in batches: through io_uring where the kernel supports it
+// (open, write & close of a file are submitted as one linked chain), as thread pool tasks
+// otherwise. Parent directories are created as needed, and each one only once.
+typedef struct ConsBulkWriter {
+    bool usesIoUring;
+
+    u64 fileCount; // Files written so far.
+    u64 failedCount; // Files that couldn't be written.
+
+    ConsArena _arena;
+    ConsPtrie _createdDirs; // Allocated from _arena.
+
+    struct _ConsBulkRing* _ring; // NULL if io_uring isn't used.
+    struct _ConsBulkPool* _pool; // NULL if io_uring is used (or no thread pool was given).
+} ConsBulkWriter;
+
+// Initialize a bulk writer. threadPool runs the writes when io_uring isn't available; if it's
+// NULL too, files are written as they're added.
+void BulkWriterInit(ConsBulkWriter* writer, ConsThreadPool* threadPool);
+
+// Queue a file to be written. Ownership of data is taken (it's freed once written); data may be
+// empty. The path is copied.
+void BulkWriterAdd(ConsBulkWriter* writer, const char* path, ConsBuffer data);
+
+// Create the parent directories of a path (for files written some other way).
+// Returns true on success, false on failure.
+bool BulkWriterCreateParentDirs(ConsBulkWriter* writer, const char* path);
+
+// Wait for every queued file to be written.
+// Returns true if all files were written, false if any failed.
+bool BulkWriterFlush(ConsBulkWriter* writer);
+
+// Flush & destroy a bulk writer.
+void BulkWriterDestroy(ConsBulkWriter* writer);
+
+#endif // CONS_BULKWRITE_H
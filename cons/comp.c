@@ -2,6 +2,8 @@
 
 #include "error.h"
 
+#include "macro.h"
+
 #include <stdlib.h>
 
 #include <zlib.h>
@@ -15,7 +17,7 @@ ConsBuffer CompressZlib(ConsBufferView data) {
         return (ConsBuffer){ 0 };
 
     ConsBuffer buffer;
-    BufferInit(&buffer, compressBound(data.size));
+    BufferInitUninit(&buffer, compressBound(data.size));
 
     z_stream strm = { 0 };
     strm.avail_in = (u32)data.size;
@@ -50,7 +52,7 @@ ConsBuffer DecompressZlib(ConsBufferView data, u64 decompressedSize) {
         return (ConsBuffer){ 0 };
 
     ConsBuffer buffer;
-    BufferInit(&buffer, decompressedSize);
+    BufferInitPooled(&buffer, decompressedSize);
 
     z_stream strm = { 0 };
     strm.avail_in = (u32)data.size;
@@ -82,7 +84,7 @@ ConsBuffer CompressZstd(ConsBufferView data) {
         return (ConsBuffer){ 0 };
 
     ConsBuffer buffer;
-    BufferInit(&buffer, ZSTD_compressBound(data.size));
+    BufferInitUninit(&buffer, ZSTD_compressBound(data.size));
 
     u64 compressedSize = ZSTD_compress(
         buffer.data_void, buffer.size,
@@ -102,7 +104,7 @@ ConsBuffer DecompressZstd(ConsBufferView data, u64 _decompressedSize) {
         return (ConsBuffer){ 0 };
 
     ConsBuffer buffer;
-    BufferInit(&buffer, _decompressedSize);
+    BufferInitPooled(&buffer, _decompressedSize);
 
     u64 decompressedSize = ZSTD_decompress(
         buffer.data_void, buffer.size,
@@ -116,3 +118,255 @@ ConsBuffer DecompressZstd(ConsBufferView data, u64 _decompressedSize) {
     BufferResize(&buffer, decompressedSize);
     return buffer;
 }
+
+#define STREAM_CHUNK_SIZE (256 * 1024)
+
+bool CompressZlibStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u64* outCompressedSize
+) {
+    if (inFile == NULL || outFile == NULL)
+        return false;
+
+    z_stream strm = { 0 };
+    if (deflateInit(&strm, Z_BEST_COMPRESSION) != Z_OK)
+        return false;
+
+    u8* inChunk = malloc(STREAM_CHUNK_SIZE * 2);
+    u8* outChunk = inChunk + STREAM_CHUNK_SIZE;
+
+    u64 inRead = 0;
+    u64 outWritten = 0;
+
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+        if (strm.avail_in == 0 && inRead < inSize) {
+            const u64 readSize = MIN(inSize - inRead, (u64)STREAM_CHUNK_SIZE);
+            if (!FileReadAt(inFile, inChunk, inOffset + inRead, readSize))
+                break;
+            inRead += readSize;
+
+            strm.next_in = inChunk;
+            strm.avail_in = (u32)readSize;
+        }
+
+        strm.next_out = outChunk;
+        strm.avail_out = STREAM_CHUNK_SIZE;
+
+        ret = deflate(&strm, (inRead == inSize) ? Z_FINISH : Z_NO_FLUSH);
+        if (ret == Z_STREAM_ERROR)
+            break;
+
+        const u64 producedSize = STREAM_CHUNK_SIZE - strm.avail_out;
+        if (!FileWriteAt(outFile, outChunk, outOffset + outWritten, producedSize))
+            break;
+        outWritten += producedSize;
+    }
+
+    deflateEnd(&strm);
+    free(inChunk);
+
+    if (ret != Z_STREAM_END)
+        return false;
+
+    if (outCompressedSize != NULL)
+        *outCompressedSize = outWritten;
+    return true;
+}
+
+bool CompressZstdStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u32 workerCount, u64* outCompressedSize
+) {
+    if (inFile == NULL || outFile == NULL)
+        return false;
+
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    if (cctx == NULL)
+        return false;
+
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, 17);
+    // Lets the frame header record the content size, like ZSTD_compress does.
+    ZSTD_CCtx_setPledgedSrcSize(cctx, inSize);
+
+    // Always at least one worker: the job split (and so the output) then doesn't depend on the
+    // worker count, while without workers zstd compresses as one job. Fails harmlessly (staying
+    // single-threaded) if libzstd was built without threading.
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, (int)MAX(workerCount, 1));
+
+    u8* inChunk = malloc(STREAM_CHUNK_SIZE * 2);
+    u8* outChunk = inChunk + STREAM_CHUNK_SIZE;
+
+    u64 inRead = 0;
+    u64 outWritten = 0;
+
+    bool failed = false;
+    bool finished = false;
+
+    while (!finished && !failed) {
+        const u64 readSize = MIN(inSize - inRead, (u64)STREAM_CHUNK_SIZE);
+        if (readSize > 0 && !FileReadAt(inFile, inChunk, inOffset + inRead, readSize)) {
+            failed = true;
+            break;
+        }
+        inRead += readSize;
+
+        const ZSTD_EndDirective mode = (inRead == inSize) ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer input = { inChunk, readSize, 0 };
+
+        // Drain the output until the chunk is consumed (or, at the end, the frame is flushed).
+        while (true) {
+            ZSTD_outBuffer output = { outChunk, STREAM_CHUNK_SIZE, 0 };
+
+            const u64 remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+            if (ZSTD_isError(remaining)) {
+                failed = true;
+                break;
+            }
+
+            if (!FileWriteAt(outFile, outChunk, outOffset + outWritten, output.pos)) {
+                failed = true;
+                break;
+            }
+            outWritten += output.pos;
+
+            if (mode == ZSTD_e_end ? (remaining == 0) : (input.pos == input.size)) {
+                finished = mode == ZSTD_e_end;
+                break;
+            }
+        }
+    }
+
+    ZSTD_freeCCtx(cctx);
+    free(inChunk);
+
+    if (failed)
+        return false;
+
+    if (outCompressedSize != NULL)
+        *outCompressedSize = outWritten;
+    return true;
+}
+
+bool DecompressZlibStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u64 decompressedSize
+) {
+    if (inFile == NULL || outFile == NULL)
+        return false;
+
+    z_stream strm = { 0 };
+    if (inflateInit(&strm) != Z_OK)
+        return false;
+
+    u8* inChunk = malloc(STREAM_CHUNK_SIZE * 2);
+    u8* outChunk = inChunk + STREAM_CHUNK_SIZE;
+
+    u64 inRead = 0;
+    u64 outWritten = 0;
+
+    // If the last call filled the output chunk, there may be more output pending.
+    bool outputFull = false;
+
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+        if (strm.avail_in == 0 && !outputFull) {
+            if (inRead >= inSize)
+                break; // Truncated stream.
+
+            const u64 readSize = MIN(inSize - inRead, (u64)STREAM_CHUNK_SIZE);
+            if (!FileReadAt(inFile, inChunk, inOffset + inRead, readSize))
+                break;
+            inRead += readSize;
+
+            strm.next_in = inChunk;
+            strm.avail_in = (u32)readSize;
+        }
+
+        strm.next_out = outChunk;
+        strm.avail_out = STREAM_CHUNK_SIZE;
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            break;
+
+        const u64 producedSize = STREAM_CHUNK_SIZE - strm.avail_out;
+        if (outWritten + producedSize > decompressedSize)
+            break;
+        if (!FileWriteAt(outFile, outChunk, outOffset + outWritten, producedSize))
+            break;
+        outWritten += producedSize;
+
+        outputFull = strm.avail_out == 0;
+    }
+
+    inflateEnd(&strm);
+    free(inChunk);
+
+    return ret == Z_STREAM_END && outWritten == decompressedSize;
+}
+
+bool DecompressZstdStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u64 decompressedSize
+) {
+    if (inFile == NULL || outFile == NULL)
+        return false;
+
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (dctx == NULL)
+        return false;
+
+    u8* inChunk = malloc(STREAM_CHUNK_SIZE * 2);
+    u8* outChunk = inChunk + STREAM_CHUNK_SIZE;
+
+    u64 inRead = 0;
+    u64 outWritten = 0;
+
+    // If the last call filled the output chunk, there may be more output pending.
+    bool outputFull = false;
+
+    // Zero once a frame has been fully decoded & flushed.
+    u64 ret = 1;
+
+    ZSTD_inBuffer input = { inChunk, 0, 0 };
+    while (true) {
+        if (input.pos == input.size && !outputFull) {
+            if (inRead >= inSize)
+                break;
+
+            const u64 readSize = MIN(inSize - inRead, (u64)STREAM_CHUNK_SIZE);
+            if (!FileReadAt(inFile, inChunk, inOffset + inRead, readSize)) {
+                ret = 1;
+                break;
+            }
+            inRead += readSize;
+
+            input.size = readSize;
+            input.pos = 0;
+        }
+
+        ZSTD_outBuffer output = { outChunk, STREAM_CHUNK_SIZE, 0 };
+
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret))
+            break;
+
+        if (
+            outWritten + output.pos > decompressedSize ||
+            !FileWriteAt(outFile, outChunk, outOffset + outWritten, output.pos)
+        ) {
+            ret = 1;
+            break;
+        }
+        outWritten += output.pos;
+
+        // A finished frame has nothing left to flush, even if it filled the output chunk.
+        outputFull = ret != 0 && output.pos == output.size;
+    }
+
+    ZSTD_freeDCtx(dctx);
+    free(inChunk);
+
+    return ret == 0 && outWritten == decompressedSize;
+}
@@ -5,6 +5,8 @@
 
 #include "buffer.h"
 
+#include "file.h"
+
 #include "type.h"
 
 // Compress data into Zlib format (DEFLATE).
@@ -17,4 +19,35 @@ ConsBuffer CompressZstd(ConsBufferView data);
 // Decompress Zstandard data.
 ConsBuffer DecompressZstd(ConsBufferView data, u64 decompressedSize);
 
+// Streaming variants: these move data between files through fixed-size buffers, so memory use
+// doesn't depend on the size of the data. The input is the range [inOffset, inOffset + inSize)
+// of inFile; the output is written to outFile starting at outOffset.
+// Returns true on success, false on failure (for decompression, this includes output that isn't
+// decompressedSize long).
+
+// Compress data into Zlib format (DEFLATE) from file to file. Unlike CompressZlib, this has
+// no 4 GiB input limit. The compressed size is written to outCompressedSize.
+bool CompressZlibStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u64* outCompressedSize
+);
+// Compress data into Zstandard format from file to file. The compressed size is written to
+// outCompressedSize. The input is split into jobs that are compressed on workerCount threads (at
+// least 1); the output is a single frame, and the same for any worker count.
+bool CompressZstdStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u32 workerCount, u64* outCompressedSize
+);
+
+// Decompress Zlib data (INFLATE) from file to file.
+bool DecompressZlibStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u64 decompressedSize
+);
+// Decompress Zstandard data from file to file.
+bool DecompressZstdStream(
+    ConsFile* inFile, u64 inOffset, u64 inSize,
+    ConsFile* outFile, u64 outOffset, u64 decompressedSize
+);
+
 #endif // CONS_COMP_H
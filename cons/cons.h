@@ -6,11 +6,17 @@
 #include "type.h"
 #include "macro.h"
 
+#include "arena.h"
 #include "buffer.h"
+#include "bulkwrite.h"
+#include "deque.h"
 #include "error.h"
 #include "file.h"
+#include "hash.h"
 #include "linklist.h"
 #include "list.h"
 #include "ptrie.h"
+#include "threadpool.h"
+#include "vec.h"
 
 #endif // CONS_H
@@ -0,0 +1,226 @@
+#include "deque.h"
+
+#include "macro.h"
+
+#include <stdlib.h>
+
+#include <string.h>
+
+static u64 _RoundUpToPow2(u64 value) {
+    u64 result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+void DequeInit(ConsDeque* deque, u32 elementSize, u64 initialCapacity) {
+    if (deque == NULL)
+        return;
+
+    deque->elementSize = elementSize;
+    deque->elementCount = 0;
+    deque->_head = 0;
+    deque->_capacity = _RoundUpToPow2(MAX(initialCapacity, 1));
+    deque->data = malloc(deque->_capacity * elementSize);
+}
+
+static inline u8* _GetSlot(ConsDeque* deque, u64 index) {
+    return deque->data + ((deque->_head + index) & (deque->_capacity - 1)) * deque->elementSize;
+}
+
+// Double the capacity. The elements are unwrapped so they start at the beginning of the ring.
+static void _Grow(ConsDeque* deque) {
+    const u64 newCapacity = deque->_capacity * 2;
+    u8* newData = malloc(newCapacity * deque->elementSize);
+
+    const u64 firstCount = MIN(deque->elementCount, deque->_capacity - deque->_head);
+    memcpy(
+        newData, deque->data + deque->_head * deque->elementSize,
+        firstCount * deque->elementSize
+    );
+    memcpy(
+        newData + firstCount * deque->elementSize, deque->data,
+        (deque->elementCount - firstCount) * deque->elementSize
+    );
+
+    free(deque->data);
+
+    deque->data = newData;
+    deque->_capacity = newCapacity;
+    deque->_head = 0;
+}
+
+void DequePushBack(ConsDeque* deque, const void* element) {
+    if (deque == NULL)
+        return;
+
+    if (deque->elementCount == deque->_capacity)
+        _Grow(deque);
+
+    memcpy(_GetSlot(deque, deque->elementCount), element, deque->elementSize);
+    deque->elementCount++;
+}
+
+void DequePushFront(ConsDeque* deque, const void* element) {
+    if (deque == NULL)
+        return;
+
+    if (deque->elementCount == deque->_capacity)
+        _Grow(deque);
+
+    deque->_head = (deque->_head - 1) & (deque->_capacity - 1);
+    deque->elementCount++;
+
+    memcpy(_GetSlot(deque, 0), element, deque->elementSize);
+}
+
+bool DequePopFront(ConsDeque* deque, void* outElement) {
+    if (deque == NULL || deque->elementCount == 0)
+        return false;
+
+    if (outElement != NULL)
+        memcpy(outElement, _GetSlot(deque, 0), deque->elementSize);
+
+    deque->_head = (deque->_head + 1) & (deque->_capacity - 1);
+    deque->elementCount--;
+
+    return true;
+}
+
+bool DequePopBack(ConsDeque* deque, void* outElement) {
+    if (deque == NULL || deque->elementCount == 0)
+        return false;
+
+    deque->elementCount--;
+
+    if (outElement != NULL)
+        memcpy(outElement, _GetSlot(deque, deque->elementCount), deque->elementSize);
+
+    return true;
+}
+
+void* DequeGet(ConsDeque* deque, u64 index) {
+    if (deque == NULL || index >= deque->elementCount)
+        return NULL;
+
+    return _GetSlot(deque, index);
+}
+
+void DequeClear(ConsDeque* deque) {
+    if (deque == NULL)
+        return;
+
+    deque->elementCount = 0;
+    deque->_head = 0;
+}
+
+void DequeDestroy(ConsDeque* deque) {
+    if (deque == NULL)
+        return;
+
+    free(deque->data);
+    deque->data = NULL;
+
+    deque->elementCount = 0;
+    deque->_capacity = 0;
+    deque->_head = 0;
+}
+
+// Lock-free queue
+
+// Each slot is a sequence number followed by the element. A slot at ring position p is free for
+// the producer at push position p when its sequence equals p, and holds an element for the
+// consumer at pop position p when its sequence equals p + 1.
+
+static inline u64* _GetMpmcSequence(ConsMpmcQueue* queue, u64 position) {
+    return (u64*)(queue->_slots + (position & queue->_mask) * queue->_slotSize);
+}
+
+void MpmcQueueInit(ConsMpmcQueue* queue, u32 elementSize, u64 capacity) {
+    if (queue == NULL)
+        return;
+
+    const u64 slotCount = _RoundUpToPow2(MAX(capacity, 2));
+
+    queue->elementSize = elementSize;
+    queue->_slotSize = ALIGN_UP_8(sizeof(u64) + elementSize);
+    queue->_mask = slotCount - 1;
+    queue->_slots = malloc(slotCount * queue->_slotSize);
+
+    for (u64 i = 0; i < slotCount; i++)
+        *_GetMpmcSequence(queue, i) = i;
+
+    queue->_pushPosition = 0;
+    queue->_popPosition = 0;
+}
+
+bool MpmcQueueTryPush(ConsMpmcQueue* queue, const void* element) {
+    u64 position = __atomic_load_n(&queue->_pushPosition, __ATOMIC_RELAXED);
+
+    while (true) {
+        u64* sequence = _GetMpmcSequence(queue, position);
+        const s64 difference =
+            (s64)(__atomic_load_n(sequence, __ATOMIC_ACQUIRE) - position);
+
+        if (difference == 0) {
+            // Claim the slot; on failure position is reloaded & we try again.
+            if (__atomic_compare_exchange_n(
+                &queue->_pushPosition, &position, position + 1,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+            )) {
+                memcpy(sequence + 1, element, queue->elementSize);
+                __atomic_store_n(sequence, position + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+        // The slot still holds an element from the previous lap: full.
+        else if (difference < 0)
+            return false;
+        // Another producer claimed it first.
+        else
+            position = __atomic_load_n(&queue->_pushPosition, __ATOMIC_RELAXED);
+    }
+}
+
+bool MpmcQueueTryPop(ConsMpmcQueue* queue, void* outElement) {
+    u64 position = __atomic_load_n(&queue->_popPosition, __ATOMIC_RELAXED);
+
+    while (true) {
+        u64* sequence = _GetMpmcSequence(queue, position);
+        const s64 difference =
+            (s64)(__atomic_load_n(sequence, __ATOMIC_ACQUIRE) - (position + 1));
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(
+                &queue->_popPosition, &position, position + 1,
+                true, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+            )) {
+                memcpy(outElement, sequence + 1, queue->elementSize);
+                // Free the slot for the producer one lap ahead.
+                __atomic_store_n(sequence, position + queue->_mask + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+        // Nothing has been pushed to this slot yet: empty.
+        else if (difference < 0)
+            return false;
+        else
+            position = __atomic_load_n(&queue->_popPosition, __ATOMIC_RELAXED);
+    }
+}
+
+u64 MpmcQueueGetSize(ConsMpmcQueue* queue) {
+    const u64 popPosition = __atomic_load_n(&queue->_popPosition, __ATOMIC_RELAXED);
+    const u64 pushPosition = __atomic_load_n(&queue->_pushPosition, __ATOMIC_RELAXED);
+
+    return (pushPosition > popPosition) ? pushPosition - popPosition : 0;
+}
+
+void MpmcQueueDestroy(ConsMpmcQueue* queue) {
+    if (queue == NULL)
+        return;
+
+    free(queue->_slots);
+    queue->_slots = NULL;
+    queue->_mask = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef CONS_DEQUE_H
+#define CONS_DEQUE_H
+
+// CONS -- ring buffer deque & lock-free queue implementation
+
+#include "type.h"
+
+// Double-ended queue stored in one ring buffer (the capacity is always a power of two), so
+// pushing & popping at either end and indexing are O(1) without per-element allocations.
+typedef struct ConsDeque {
+    u8* data;
+
+    u64 elementCount;
+    u32 elementSize;
+
+    u64 _capacity;
+    u64 _head; // Index of the first element in the ring.
+} ConsDeque;
+
+// Initialize a deque.
+void DequeInit(ConsDeque* deque, u32 elementSize, u64 initialCapacity);
+
+// Push an element at the back (tail) of the deque.
+void DequePushBack(ConsDeque* deque, const void* element);
+// Push an element at the front (head) of the deque.
+void DequePushFront(ConsDeque* deque, const void* element);
+
+// Pop the element at the front of the deque into outElement (may be NULL).
+// Returns true on success, false if the deque is empty.
+bool DequePopFront(ConsDeque* deque, void* outElement);
+// Pop the element at the back of the deque into outElement (may be NULL).
+// Returns true on success, false if the deque is empty.
+bool DequePopBack(ConsDeque* deque, void* outElement);
+
+// Get a pointer to the specified element (0 is the front). Pointers are invalidated by pushes.
+void* DequeGet(ConsDeque* deque, u64 index);
+
+// Check if the deque is empty.
+static inline bool DequeIsEmpty(const ConsDeque* deque) {
+    return deque->elementCount == 0;
+}
+
+// Clear a deque (does not change capacity).
+void DequeClear(ConsDeque* deque);
+
+// Destroy a deque.
+void DequeDestroy(ConsDeque* deque);
+
+// Bounded multi-producer/multi-consumer queue. Pushing & popping never take a lock; each slot
+// carries a sequence number that tells producers & consumers whose turn it is. Push and pop fail
+// instead of waiting, so the caller decides how to wait (spin, yield or a condition variable).
+typedef struct ConsMpmcQueue {
+    u8* _slots;
+    u64 _slotSize;
+    u64 _mask; // Capacity - 1.
+    u32 elementSize;
+
+    // Kept on separate cache lines so producers & consumers don't contend on one.
+    _Alignas(64) u64 _pushPosition;
+    _Alignas(64) u64 _popPosition;
+} ConsMpmcQueue;
+
+// Initialize a lock-free queue. The capacity is rounded up to a power of two.
+void MpmcQueueInit(ConsMpmcQueue* queue, u32 elementSize, u64 capacity);
+
+// Try to push an element. Safe to call from any amount of threads at once.
+// Returns true on success, false if the queue is full.
+bool MpmcQueueTryPush(ConsMpmcQueue* queue, const void* element);
+
+// Try to pop an element into outElement. Safe to call from any amount of threads at once.
+// Returns true on success, false if the queue is empty.
+bool MpmcQueueTryPop(ConsMpmcQueue* queue, void* outElement);
+
+// Get the approximate amount of elements in the queue (exact when no other thread uses it).
+u64 MpmcQueueGetSize(ConsMpmcQueue* queue);
+
+// Destroy a lock-free queue. No other thread may be using it.
+void MpmcQueueDestroy(ConsMpmcQueue* queue);
+
+#endif // CONS_DEQUE_H
@@ -1,6 +1,9 @@
 #include "file.h"
 
-#include "linklist.h"
+#include "deque.h"
+#include "threadpool.h"
+
+#include "macro.h"
 
 #include "error.h"
 
@@ -21,6 +24,10 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <dirent.h>
 #include <libgen.h>
@@ -35,36 +42,261 @@
 ConsBuffer FileLoadMem(const char* path) {
     ConsBuffer buffer = {0};
 
-    if (path == NULL)
+    ConsFile file;
+    if (path == NULL || !FileOpenRead(&file, path))
         return buffer;
 
+    // Empty files give an empty buffer.
+    if (file.size == 0) {
+        FileClose(&file);
+        return buffer;
+    }
+
+    // Every byte is read into, so there's no need to zero it first.
+    BufferInitPooled(&buffer, file.size);
+
+    if (!FileReadAt(&file, buffer.data_void, 0, buffer.size))
+        BufferDestroy(&buffer);
+
+    FileClose(&file);
+    return buffer;
+}
+
+bool FileOpenRead(ConsFile* file, const char* path) {
+    if (file == NULL || path == NULL)
+        return false;
+
+#ifdef _WIN32
     FILE* fp = fopen(path, "rb");
     if (fp == NULL)
-        return buffer;
+        return false;
 
-    if (fseek(fp, 0, SEEK_END) != 0) {
+    if (_fseeki64(fp, 0, SEEK_END) != 0) {
         fclose(fp);
-        return buffer;
+        return false;
     }
 
-    u64 fileSize = (u64)ftell(fp);
-    if (fileSize == (u64)-1L) {
-        fclose(fp);
+    file->_fp = fp;
+    file->size = (u64)_ftelli64(fp);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0) {
+        close(fd);
+        return false;
+    }
+
+    file->_fd = fd;
+    file->size = (u64)statbuf.st_size;
+#endif
+
+    return true;
+}
+
+bool FileOpenWrite(ConsFile* file, const char* path) {
+    if (file == NULL || path == NULL)
+        return false;
+
+#ifdef _WIN32
+    FILE* fp = fopen(path, "wb+");
+    if (fp == NULL)
+        return false;
+
+    file->_fp = fp;
+#else
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    file->_fd = fd;
+#endif
+
+    file->size = 0;
+    return true;
+}
+
+void FileClose(ConsFile* file) {
+    if (file == NULL)
+        return;
+
+#ifdef _WIN32
+    if (file->_fp != NULL)
+        fclose((FILE*)file->_fp);
+    file->_fp = NULL;
+#else
+    if (file->_fd >= 0)
+        close(file->_fd);
+    file->_fd = -1;
+#endif
+
+    file->size = 0;
+}
+
+bool FileReadAt(ConsFile* file, void* dst, u64 offset, u64 size) {
+    if (file == NULL || (dst == NULL && size > 0))
+        return false;
+
+#ifdef _WIN32
+    if (_fseeki64((FILE*)file->_fp, (s64)offset, SEEK_SET) != 0)
+        return false;
+    return fread(dst, 1, size, (FILE*)file->_fp) == size;
+#else
+    u8* currentDst = dst;
+    while (size > 0) {
+        const ssize_t bytesRead = pread(file->_fd, currentDst, size, (off_t)offset);
+        if (bytesRead < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (bytesRead == 0)
+            return false; // Unexpected EOF.
+
+        currentDst += bytesRead;
+        offset += (u64)bytesRead;
+        size -= (u64)bytesRead;
+    }
+
+    return true;
+#endif
+}
+
+bool FileWriteAt(ConsFile* file, const void* src, u64 offset, u64 size) {
+    if (file == NULL || (src == NULL && size > 0))
+        return false;
+
+#ifdef _WIN32
+    if (_fseeki64((FILE*)file->_fp, (s64)offset, SEEK_SET) != 0)
+        return false;
+    if (fwrite(src, 1, size, (FILE*)file->_fp) != size)
+        return false;
+#else
+    const u8* currentSrc = src;
+    u64 currentOffset = offset;
+    u64 sizeLeft = size;
+    while (sizeLeft > 0) {
+        const ssize_t bytesWritten = pwrite(file->_fd, currentSrc, sizeLeft, (off_t)currentOffset);
+        if (bytesWritten < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        currentSrc += bytesWritten;
+        currentOffset += (u64)bytesWritten;
+        sizeLeft -= (u64)bytesWritten;
+    }
+#endif
+
+    if (offset + size > file->size)
+        file->size = offset + size;
+
+    return true;
+}
+
+ConsBuffer FileLoadMemRange(const char* path, u64 offset, u64 size) {
+    ConsBuffer buffer = {0};
+
+    ConsFile file;
+    if (size == 0 || !FileOpenRead(&file, path))
+        return buffer;
+
+    if (offset >= file.size) {
+        FileClose(&file);
         return buffer;
     }
 
-    BufferInit(&buffer, fileSize);
+    if (size > file.size - offset)
+        size = file.size - offset;
 
-    rewind(fp);
-    u64 bytesCopied = fread(buffer.data_void, 1, buffer.size, fp);
-    if (bytesCopied < fileSize && ferror(fp)) {
-        fclose(fp);
+    BufferInitPooled(&buffer, size);
+
+    if (!FileReadAt(&file, buffer.data_void, offset, size))
         BufferDestroy(&buffer);
+
+    FileClose(&file);
+    return buffer;
+}
+
+bool FileGetInfo(const char* path, u64* outSize, s64* outModifyTime) {
+    if (path == NULL)
+        return false;
+
+#ifdef _WIN32
+    struct _stat64 statbuf;
+    if (_stat64(path, &statbuf) != 0)
+        return false;
+
+    const s64 modifyTime = (s64)statbuf.st_mtime * 1000000000ll;
+#else
+    struct stat statbuf;
+    if (stat(path, &statbuf) != 0)
+        return false;
+
+    #ifdef __APPLE__
+    const struct timespec modifyTimespec = statbuf.st_mtimespec;
+    #else
+    const struct timespec modifyTimespec = statbuf.st_mtim;
+    #endif
+
+    const s64 modifyTime = ((s64)modifyTimespec.tv_sec * 1000000000ll) + modifyTimespec.tv_nsec;
+#endif
+
+    if (outSize)
+        *outSize = (u64)statbuf.st_size;
+    if (outModifyTime)
+        *outModifyTime = modifyTime;
+
+    return true;
+}
+
+ConsBuffer FileMapMem(const char* path) {
+#ifdef _WIN32
+    // No private mappings here; fall back to loading the file.
+    return FileLoadMem(path);
+#else
+    ConsBuffer buffer = {0};
+
+    if (path == NULL)
+        return buffer;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return buffer;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0 || statbuf.st_size <= 0) {
+        close(fd);
         return buffer;
     }
 
-    fclose(fp);
+    void* data = mmap(NULL, (size_t)statbuf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return buffer;
+
+    buffer.data_void = data;
+    buffer.size = (u64)statbuf.st_size;
     return buffer;
+#endif
+}
+
+void FileUnmapMem(ConsBuffer* buffer) {
+#ifdef _WIN32
+    BufferDestroy(buffer);
+#else
+    if (buffer == NULL || buffer->data_void == NULL)
+        return;
+
+    munmap(buffer->data_void, buffer->size);
+
+    buffer->data_void = NULL;
+    buffer->size = 0;
+#endif
 }
 
 bool FileWriteMem(ConsBufferView view, const char* path) {
@@ -172,18 +404,15 @@ ConsList DirectoryGetAllFiles(const char* rootPath) {
     ConsList fileList;
     ListInit(&fileList, sizeof(char*), 128);
 
-    ConsLLNode* queue = NULL;
-    LinkListInsertTail(&queue, (u64)strdup(rootPath));
+    // Directories left to read, breadth-first.
+    ConsDeque queue;
+    DequeInit(&queue, sizeof(char*), 64);
 
-    while (queue) {
-        ConsLLNode* currentNode = queue;
-        queue = queue->next;
-        if (queue != NULL)
-            queue->prev = NULL;
-
-        char* currentPath = (char*)currentNode->data;
-        LinkListDeleteNode(&currentNode, currentNode);
+    char* rootCopy = strdup(rootPath);
+    DequePushBack(&queue, &rootCopy);
 
+    char* currentPath;
+    while (DequePopFront(&queue, &currentPath)) {
 #ifdef _WIN32
         WIN32_FIND_DATAA findFileData;
         char searchPath[MAX_PATH];
@@ -204,7 +433,8 @@ ConsList DirectoryGetAllFiles(const char* rootPath) {
             snprintf(fullPath, MAX_PATH, "%s\\%s", currentPath, name);
 
             if (_IsDirectory(fullPath)) {
-                LinkListInsertTail(&queue, (u64)strdup(fullPath));
+                char* dirCopy = strdup(fullPath);
+                DequePushBack(&queue, &dirCopy);
             } else {
                 char* fileCopy = strdup(fullPath);
                 ListAdd(&fileList, &fileCopy);
@@ -228,8 +458,12 @@ ConsList DirectoryGetAllFiles(const char* rootPath) {
             char fullPath[MAX_PATH];
             snprintf(fullPath, MAX_PATH, "%s/%s", currentPath, entry->d_name);
 
-            if (_IsDirectory(fullPath)) {
-                LinkListInsertTail(&queue, (u64)strdup(fullPath));
+            // Only stat when the filesystem doesn't give us the type.
+            const bool isDirectory = (entry->d_type == DT_DIR) ||
+                ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && _IsDirectory(fullPath));
+            if (isDirectory) {
+                char* dirCopy = strdup(fullPath);
+                DequePushBack(&queue, &dirCopy);
             }
             else {
                 char* fileCopy = strdup(fullPath);
@@ -242,9 +476,231 @@ ConsList DirectoryGetAllFiles(const char* rootPath) {
         free(currentPath);
     }
 
+    DequeDestroy(&queue);
+
     return fileList;
 }
 
+// Directory scan
+
+// Copy a path (prefix + '/' + name, or just name if prefix is empty) into the arena.
+static char* _ScanArenaPath(ConsArena* arena, const char* prefix, u64 prefixLen, const char* name) {
+    const u64 nameLen = strlen(name);
+    const u64 size = prefixLen + (prefixLen > 0 ? 1 : 0) + nameLen + 1;
+
+    char* path = ArenaAllocAligned(arena, size, 1);
+
+    char* current = path;
+    if (prefixLen > 0) {
+        memcpy(current, prefix, prefixLen);
+        current += prefixLen;
+        *(current++) = '/';
+    }
+    memcpy(current, name, nameLen + 1);
+
+    return path;
+}
+
+static int _ComparePaths(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+#ifndef _WIN32
+
+// Per-thread results; only touched by the thread they belong to.
+typedef struct _ScanSlot {
+    ConsArena arena;
+    ConsList files; // const char*
+} _ScanSlot;
+
+typedef struct _ScanState {
+    int rootFd;
+    u64 rootPathLen;
+
+    ConsThreadPool* pool; // NULL to scan on the calling thread.
+    ConsTaskGroup group;
+    ConsDeque pendingDirs; // const char*; only used without a pool.
+
+    _ScanSlot* slots; // One per pool thread, plus one for the calling thread.
+} _ScanState;
+
+typedef struct _ScanTask {
+    _ScanState* state;
+    const char* dirPath;
+} _ScanTask;
+
+static void _ScanDirectoryTask(void* userData);
+
+static _ScanSlot* _GetScanSlot(_ScanState* state) {
+    return state->slots + ((state->pool != NULL) ? ThreadPoolGetThreadIndex(state->pool) : 0);
+}
+
+// Queue a directory to be read: as a pool task, or for the calling thread's loop.
+static void _ScanQueueDirectory(_ScanState* state, _ScanSlot* slot, const char* dirPath) {
+    if (state->pool == NULL) {
+        DequePushBack(&state->pendingDirs, &dirPath);
+        return;
+    }
+
+    _ScanTask* task = ArenaAlloc(&slot->arena, sizeof(_ScanTask));
+    task->state = state;
+    task->dirPath = dirPath;
+
+    ThreadPoolSubmit(state->pool, &state->group, _ScanDirectoryTask, task);
+}
+
+static void _ScanDirectory(_ScanState* state, const char* dirPath) {
+    _ScanSlot* slot = _GetScanSlot(state);
+
+    // Open relative to the root, so only the root path has to be resolved from scratch.
+    const char* relativePath = (dirPath[state->rootPathLen] == '/') ?
+        dirPath + state->rootPathLen + 1 : ".";
+
+    const int dirFd = openat(state->rootFd, relativePath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        Warn("DirectoryScan: failed to open directory at path '%s'; skipping", dirPath);
+        return;
+    }
+
+    DIR* dir = fdopendir(dirFd);
+    if (dir == NULL) {
+        close(dirFd);
+        Warn("DirectoryScan: failed to open directory at path '%s'; skipping", dirPath);
+        return;
+    }
+
+    const u64 dirPathLen = strlen(dirPath);
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        bool isDirectory;
+        if (entry->d_type == DT_DIR)
+            isDirectory = true;
+        else if (entry->d_type == DT_REG)
+            isDirectory = false;
+        else {
+            // Unknown to the filesystem, or a link: ask (following links, like stat).
+            struct stat statbuf;
+            isDirectory = fstatat(dirFd, name, &statbuf, 0) == 0 && S_ISDIR(statbuf.st_mode);
+        }
+
+        const char* path = _ScanArenaPath(&slot->arena, dirPath, dirPathLen, name);
+        if (isDirectory)
+            _ScanQueueDirectory(state, slot, path);
+        else
+            ListAdd(&slot->files, &path);
+    }
+
+    closedir(dir);
+}
+
+static void _ScanDirectoryTask(void* userData) {
+    _ScanTask* task = userData;
+    _ScanDirectory(task->state, task->dirPath);
+}
+
+#endif // !_WIN32
+
+bool DirectoryScan(ConsDirScan* scan, const char* rootPath, ConsThreadPool* pool, ConsArena* arena) {
+    if (scan == NULL || rootPath == NULL)
+        return false;
+
+    scan->fileCount = 0;
+    scan->filePaths = NULL;
+    ArenaInit(&scan->_arena, 0);
+
+    if (arena == NULL)
+        arena = &scan->_arena;
+
+    ConsList files;
+    ListInit(&files, sizeof(const char*), 128);
+
+#ifdef _WIN32
+    (void)pool;
+
+    // No parallel walk here; copy the plain walk's results into the arena.
+    ConsList plainFiles = DirectoryGetAllFiles(rootPath);
+    for (u64 i = 0; i < plainFiles.elementCount; i++) {
+        char* plainPath = *(char**)ListGet(&plainFiles, i);
+
+        const char* path = ArenaStrdup(arena, plainPath);
+        ListAdd(&files, &path);
+
+        free(plainPath);
+    }
+    ListDestroy(&plainFiles);
+#else
+    _ScanState state;
+    state.rootFd = open(rootPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.rootFd < 0) {
+        ListDestroy(&files);
+        return false;
+    }
+
+    state.rootPathLen = strlen(rootPath);
+    state.pool = pool;
+    TaskGroupInit(&state.group);
+    DequeInit(&state.pendingDirs, sizeof(const char*), 64);
+
+    const u32 slotCount = (pool != NULL) ? pool->threadCount + 1 : 1;
+    state.slots = calloc(slotCount, sizeof(_ScanSlot));
+    for (u32 i = 0; i < slotCount; i++) {
+        ArenaInit(&state.slots[i].arena, 0);
+        ListInit(&state.slots[i].files, sizeof(const char*), 128);
+    }
+
+    // The root path is stored in the arena too, so every pending path is owned the same way.
+    _ScanSlot* callerSlot = _GetScanSlot(&state);
+    _ScanQueueDirectory(&state, callerSlot, ArenaStrdup(&callerSlot->arena, rootPath));
+
+    // Subdirectories are queued as they're found; the calling thread helps while it waits.
+    if (pool != NULL)
+        ThreadPoolWait(pool, &state.group);
+    else {
+        const char* dirPath;
+        while (DequePopBack(&state.pendingDirs, &dirPath))
+            _ScanDirectory(&state, dirPath);
+    }
+
+    for (u32 i = 0; i < slotCount; i++) {
+        ListAddRange(&files, state.slots[i].files.data, state.slots[i].files.elementCount);
+
+        // Hand the thread's paths over to the scan's arena.
+        ArenaAdopt(arena, &state.slots[i].arena);
+        ListDestroy(&state.slots[i].files);
+    }
+
+    free(state.slots);
+    DequeDestroy(&state.pendingDirs);
+
+    close(state.rootFd);
+#endif
+
+    qsort(files.data, files.elementCount, sizeof(const char*), _ComparePaths);
+
+    scan->fileCount = files.elementCount;
+    scan->filePaths = ArenaAlloc(arena, files.elementCount * sizeof(const char*));
+    memcpy(scan->filePaths, files.data, files.elementCount * sizeof(const char*));
+
+    ListDestroy(&files);
+
+    return true;
+}
+
+void DirectoryScanDestroy(ConsDirScan* scan) {
+    if (scan == NULL)
+        return;
+
+    scan->filePaths = NULL;
+    scan->fileCount = 0;
+
+    ArenaDestroy(&scan->_arena);
+}
+
 char* DirectoryGetName(const char* dirPath) {
     char resolvedPath[MAX_PATH];
 
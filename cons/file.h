@@ -3,15 +3,60 @@
 
 // CONS -- filesystem implementation
 
+#include "arena.h"
 #include "buffer.h"
 
 #include "list.h"
+#include "threadpool.h"
 
 #include "type.h"
 
 // Load a file from the FS into a buffer.
 ConsBuffer FileLoadMem(const char* path);
 
+// Handle to an open file, for reading at arbitrary offsets.
+typedef struct ConsFile {
+#ifdef _WIN32
+    void* _fp;
+#else
+    int _fd;
+#endif
+    u64 size; // Size of the file at the time it was opened.
+} ConsFile;
+
+// Open a file for reading.
+// Returns true on success, false on failure.
+bool FileOpenRead(ConsFile* file, const char* path);
+
+// Open a file for reading & writing; it's created if it doesn't exist, and truncated if it does.
+// Returns true on success, false on failure.
+bool FileOpenWrite(ConsFile* file, const char* path);
+
+// Close a file. It's safe to pass in a file that failed to open.
+void FileClose(ConsFile* file);
+
+// Read exactly size bytes starting at offset (does not move any file position).
+// Returns true on success, false on failure (including short reads).
+bool FileReadAt(ConsFile* file, void* dst, u64 offset, u64 size);
+
+// Write exactly size bytes starting at offset (does not move any file position). The file is
+// extended as needed.
+// Returns true on success, false on failure.
+bool FileWriteAt(ConsFile* file, const void* src, u64 offset, u64 size);
+
+// Load part of a file from the FS into a buffer. The range is clamped to the end of the file.
+ConsBuffer FileLoadMemRange(const char* path, u64 offset, u64 size);
+
+// Get the size & last modification time (in nanoseconds) of a file.
+// Returns true on success, false on failure.
+bool FileGetInfo(const char* path, u64* outSize, s64* outModifyTime);
+
+// Map a file from the FS into memory. The mapping is private (copy-on-write): it may be
+// modified freely, but changes never reach the file. Must be released with FileUnmapMem.
+ConsBuffer FileMapMem(const char* path);
+// Release a mapping created by FileMapMem.
+void FileUnmapMem(ConsBuffer* buffer);
+
 // Write a file to the FS. If the view is empty, this will create an empty file.
 // Returns true on success, false on failure.
 bool FileWriteMem(ConsBufferView view, const char* path);
@@ -24,6 +69,25 @@ bool DirectoryCreateTree(const char* dirPath);
 // Note: the strings contained in this list are dynamically allocated and must be freed.
 ConsList DirectoryGetAllFiles(const char* rootPath);
 
+// Result of a directory scan. All paths (and the path array) live in one arena and are freed
+// together.
+typedef struct ConsDirScan {
+    u64 fileCount;
+    // Paths of all files (rootPath + '/' + relative path), sorted by strcmp.
+    const char** filePaths;
+
+    ConsArena _arena; // Used if no arena was passed to DirectoryScan.
+} ConsDirScan;
+
+// Scan a directory tree for files (including subfiles). Every subdirectory is read as a task on
+// pool (NULL reads them on the calling thread); the result is sorted, so it doesn't depend on
+// readdir or thread timing. The paths are allocated from arena, or from an arena owned by the
+// scan if NULL.
+// Returns true on success, false on failure (the root directory couldn't be opened).
+bool DirectoryScan(ConsDirScan* scan, const char* rootPath, ConsThreadPool* pool, ConsArena* arena);
+// Destroy a directory scan (frees all paths, unless they were allocated from a passed arena).
+void DirectoryScanDestroy(ConsDirScan* scan);
+
 // Get the name of a directory by it's path.
 // Returns dynamically allocated string containing directory name on success, NULL on failure.
 char* DirectoryGetName(const char* dirPath);
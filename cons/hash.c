@@ -0,0 +1,477 @@
+#include "hash.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Little-endian loads & stores, whatever the alignment.
+
+static inline u32 _ReadLE32(const u8* src) {
+    u32 value;
+    memcpy(&value, src, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static inline u64 _ReadLE64(const u8* src) {
+    u64 value;
+    memcpy(&value, src, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline void _WriteLE32(u8* dst, u32 value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    memcpy(dst, &value, sizeof(value));
+}
+
+static inline void _WriteLE64(u8* dst, u64 value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    memcpy(dst, &value, sizeof(value));
+}
+
+static inline u32 _Rotl32(u32 value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+static inline u64 _Rotl64(u64 value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+// MD5 (RFC 1321)
+
+#define _MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define _MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define _MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define _MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define _MD5_STEP(f, a, b, c, d, word, constant, shift) \
+    (a) += f((b), (c), (d)) + (word) + (constant); \
+    (a) = _Rotl32((a), (shift)) + (b)
+
+static void _Md5Block(u32 state[4], const u8* block) {
+    u32 w[16];
+    for (u32 i = 0; i < 16; i++)
+        w[i] = _ReadLE32(block + i * 4);
+
+    u32 a = state[0];
+    u32 b = state[1];
+    u32 c = state[2];
+    u32 d = state[3];
+
+    _MD5_STEP(_MD5_F, a, b, c, d, w[0],  0xD76AA478, 7);
+    _MD5_STEP(_MD5_F, d, a, b, c, w[1],  0xE8C7B756, 12);
+    _MD5_STEP(_MD5_F, c, d, a, b, w[2],  0x242070DB, 17);
+    _MD5_STEP(_MD5_F, b, c, d, a, w[3],  0xC1BDCEEE, 22);
+    _MD5_STEP(_MD5_F, a, b, c, d, w[4],  0xF57C0FAF, 7);
+    _MD5_STEP(_MD5_F, d, a, b, c, w[5],  0x4787C62A, 12);
+    _MD5_STEP(_MD5_F, c, d, a, b, w[6],  0xA8304613, 17);
+    _MD5_STEP(_MD5_F, b, c, d, a, w[7],  0xFD469501, 22);
+    _MD5_STEP(_MD5_F, a, b, c, d, w[8],  0x698098D8, 7);
+    _MD5_STEP(_MD5_F, d, a, b, c, w[9],  0x8B44F7AF, 12);
+    _MD5_STEP(_MD5_F, c, d, a, b, w[10], 0xFFFF5BB1, 17);
+    _MD5_STEP(_MD5_F, b, c, d, a, w[11], 0x895CD7BE, 22);
+    _MD5_STEP(_MD5_F, a, b, c, d, w[12], 0x6B901122, 7);
+    _MD5_STEP(_MD5_F, d, a, b, c, w[13], 0xFD987193, 12);
+    _MD5_STEP(_MD5_F, c, d, a, b, w[14], 0xA679438E, 17);
+    _MD5_STEP(_MD5_F, b, c, d, a, w[15], 0x49B40821, 22);
+
+    _MD5_STEP(_MD5_G, a, b, c, d, w[1],  0xF61E2562, 5);
+    _MD5_STEP(_MD5_G, d, a, b, c, w[6],  0xC040B340, 9);
+    _MD5_STEP(_MD5_G, c, d, a, b, w[11], 0x265E5A51, 14);
+    _MD5_STEP(_MD5_G, b, c, d, a, w[0],  0xE9B6C7AA, 20);
+    _MD5_STEP(_MD5_G, a, b, c, d, w[5],  0xD62F105D, 5);
+    _MD5_STEP(_MD5_G, d, a, b, c, w[10], 0x02441453, 9);
+    _MD5_STEP(_MD5_G, c, d, a, b, w[15], 0xD8A1E681, 14);
+    _MD5_STEP(_MD5_G, b, c, d, a, w[4],  0xE7D3FBC8, 20);
+    _MD5_STEP(_MD5_G, a, b, c, d, w[9],  0x21E1CDE6, 5);
+    _MD5_STEP(_MD5_G, d, a, b, c, w[14], 0xC33707D6, 9);
+    _MD5_STEP(_MD5_G, c, d, a, b, w[3],  0xF4D50D87, 14);
+    _MD5_STEP(_MD5_G, b, c, d, a, w[8],  0x455A14ED, 20);
+    _MD5_STEP(_MD5_G, a, b, c, d, w[13], 0xA9E3E905, 5);
+    _MD5_STEP(_MD5_G, d, a, b, c, w[2],  0xFCEFA3F8, 9);
+    _MD5_STEP(_MD5_G, c, d, a, b, w[7],  0x676F02D9, 14);
+    _MD5_STEP(_MD5_G, b, c, d, a, w[12], 0x8D2A4C8A, 20);
+
+    _MD5_STEP(_MD5_H, a, b, c, d, w[5],  0xFFFA3942, 4);
+    _MD5_STEP(_MD5_H, d, a, b, c, w[8],  0x8771F681, 11);
+    _MD5_STEP(_MD5_H, c, d, a, b, w[11], 0x6D9D6122, 16);
+    _MD5_STEP(_MD5_H, b, c, d, a, w[14], 0xFDE5380C, 23);
+    _MD5_STEP(_MD5_H, a, b, c, d, w[1],  0xA4BEEA44, 4);
+    _MD5_STEP(_MD5_H, d, a, b, c, w[4],  0x4BDECFA9, 11);
+    _MD5_STEP(_MD5_H, c, d, a, b, w[7],  0xF6BB4B60, 16);
+    _MD5_STEP(_MD5_H, b, c, d, a, w[10], 0xBEBFBC70, 23);
+    _MD5_STEP(_MD5_H, a, b, c, d, w[13], 0x289B7EC6, 4);
+    _MD5_STEP(_MD5_H, d, a, b, c, w[0],  0xEAA127FA, 11);
+    _MD5_STEP(_MD5_H, c, d, a, b, w[3],  0xD4EF3085, 16);
+    _MD5_STEP(_MD5_H, b, c, d, a, w[6],  0x04881D05, 23);
+    _MD5_STEP(_MD5_H, a, b, c, d, w[9],  0xD9D4D039, 4);
+    _MD5_STEP(_MD5_H, d, a, b, c, w[12], 0xE6DB99E5, 11);
+    _MD5_STEP(_MD5_H, c, d, a, b, w[15], 0x1FA27CF8, 16);
+    _MD5_STEP(_MD5_H, b, c, d, a, w[2],  0xC4AC5665, 23);
+
+    _MD5_STEP(_MD5_I, a, b, c, d, w[0],  0xF4292244, 6);
+    _MD5_STEP(_MD5_I, d, a, b, c, w[7],  0x432AFF97, 10);
+    _MD5_STEP(_MD5_I, c, d, a, b, w[14], 0xAB9423A7, 15);
+    _MD5_STEP(_MD5_I, b, c, d, a, w[5],  0xFC93A039, 21);
+    _MD5_STEP(_MD5_I, a, b, c, d, w[12], 0x655B59C3, 6);
+    _MD5_STEP(_MD5_I, d, a, b, c, w[3],  0x8F0CCC92, 10);
+    _MD5_STEP(_MD5_I, c, d, a, b, w[10], 0xFFEFF47D, 15);
+    _MD5_STEP(_MD5_I, b, c, d, a, w[1],  0x85845DD1, 21);
+    _MD5_STEP(_MD5_I, a, b, c, d, w[8],  0x6FA87E4F, 6);
+    _MD5_STEP(_MD5_I, d, a, b, c, w[15], 0xFE2CE6E0, 10);
+    _MD5_STEP(_MD5_I, c, d, a, b, w[6],  0xA3014314, 15);
+    _MD5_STEP(_MD5_I, b, c, d, a, w[13], 0x4E0811A1, 21);
+    _MD5_STEP(_MD5_I, a, b, c, d, w[4],  0xF7537E82, 6);
+    _MD5_STEP(_MD5_I, d, a, b, c, w[11], 0xBD3AF235, 10);
+    _MD5_STEP(_MD5_I, c, d, a, b, w[2],  0x2AD7D2BB, 15);
+    _MD5_STEP(_MD5_I, b, c, d, a, w[9],  0xEB86D391, 21);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+void Md5Init(ConsMd5* md5) {
+    md5->_state[0] = 0x67452301;
+    md5->_state[1] = 0xEFCDAB89;
+    md5->_state[2] = 0x98BADCFE;
+    md5->_state[3] = 0x10325476;
+    md5->_size = 0;
+}
+
+void Md5Update(ConsMd5* md5, const void* data, u64 size) {
+    const u8* src = data;
+
+    u64 blockFill = md5->_size % 64;
+    md5->_size += size;
+
+    // Complete a partial block first.
+    if (blockFill != 0) {
+        const u64 copySize = (size < 64 - blockFill) ? size : 64 - blockFill;
+        memcpy(md5->_block + blockFill, src, copySize);
+
+        src += copySize;
+        size -= copySize;
+        blockFill += copySize;
+
+        if (blockFill < 64)
+            return;
+        _Md5Block(md5->_state, md5->_block);
+    }
+
+    // Whole blocks are hashed in place.
+    for (; size >= 64; src += 64, size -= 64)
+        _Md5Block(md5->_state, src);
+
+    if (size != 0)
+        memcpy(md5->_block, src, size);
+}
+
+void Md5Finish(ConsMd5* md5, u8 outDigest[MD5_DIGEST_SIZE]) {
+    const u64 bitSize = md5->_size * 8;
+
+    // 0x80, zeroes up to 56 mod 64, then the size in bits.
+    static const u8 padding[64] = { 0x80 };
+    const u64 blockFill = md5->_size % 64;
+    Md5Update(md5, padding, (blockFill < 56) ? 56 - blockFill : 120 - blockFill);
+
+    u8 sizeBytes[8];
+    _WriteLE64(sizeBytes, bitSize);
+    Md5Update(md5, sizeBytes, sizeof(sizeBytes));
+
+    for (u32 i = 0; i < 4; i++)
+        _WriteLE32(outDigest + i * 4, md5->_state[i]);
+}
+
+void HashMd5(const void* data, u64 size, u8 outDigest[MD5_DIGEST_SIZE]) {
+    ConsMd5 md5;
+    Md5Init(&md5);
+    Md5Update(&md5, data, size);
+    Md5Finish(&md5, outDigest);
+}
+
+// XXH3 (64-bit), following the xxHash reference (v0.8).
+
+#define _PRIME32_1 (0x9E3779B1u)
+#define _PRIME32_2 (0x85EBCA77u)
+#define _PRIME32_3 (0xC2B2AE3Du)
+
+#define _PRIME64_1 (0x9E3779B185EBCA87ull)
+#define _PRIME64_2 (0xC2B2AE3D27D4EB4Full)
+#define _PRIME64_3 (0x165667B19E3779F9ull)
+#define _PRIME64_4 (0x85EBCA77C2B2AE63ull)
+#define _PRIME64_5 (0x27D4EB2F165667C5ull)
+
+#define _PRIME_MX1 (0x165667919E3779F9ull)
+#define _PRIME_MX2 (0x9FB21C651E98DF25ull)
+
+#define _XXH3_SECRET_SIZE (192)
+#define _XXH3_SECRET_SIZE_MIN (136)
+
+#define _XXH3_STRIPE_SIZE (64)
+#define _XXH3_SECRET_CONSUME_RATE (8) // Secret bytes advanced per stripe.
+#define _XXH3_STRIPES_PER_BLOCK ((_XXH3_SECRET_SIZE - _XXH3_STRIPE_SIZE) / _XXH3_SECRET_CONSUME_RATE)
+#define _XXH3_BLOCK_SIZE (_XXH3_STRIPE_SIZE * _XXH3_STRIPES_PER_BLOCK)
+
+static const u8 _xxh3Secret[_XXH3_SECRET_SIZE] __attribute__((aligned(64))) = {
+    0xB8, 0xFE, 0x6C, 0x39, 0x23, 0xA4, 0x4B, 0xBE, 0x7C, 0x01, 0x81, 0x2C, 0xF7, 0x21, 0xAD, 0x1C,
+    0xDE, 0xD4, 0x6D, 0xE9, 0x83, 0x90, 0x97, 0xDB, 0x72, 0x40, 0xA4, 0xA4, 0xB7, 0xB3, 0x67, 0x1F,
+    0xCB, 0x79, 0xE6, 0x4E, 0xCC, 0xC0, 0xE5, 0x78, 0x82, 0x5A, 0xD0, 0x7D, 0xCC, 0xFF, 0x72, 0x21,
+    0xB8, 0x08, 0x46, 0x74, 0xF7, 0x43, 0x24, 0x8E, 0xE0, 0x35, 0x90, 0xE6, 0x81, 0x3A, 0x26, 0x4C,
+    0x3C, 0x28, 0x52, 0xBB, 0x91, 0xC3, 0x00, 0xCB, 0x88, 0xD0, 0x65, 0x8B, 0x1B, 0x53, 0x2E, 0xA3,
+    0x71, 0x64, 0x48, 0x97, 0xA2, 0x0D, 0xF9, 0x4E, 0x38, 0x19, 0xEF, 0x46, 0xA9, 0xDE, 0xAC, 0xD8,
+    0xA8, 0xFA, 0x76, 0x3F, 0xE3, 0x9C, 0x34, 0x3F, 0xF9, 0xDC, 0xBB, 0xC7, 0xC7, 0x0B, 0x4F, 0x1D,
+    0x8A, 0x51, 0xE0, 0x4B, 0xCD, 0xB4, 0x59, 0x31, 0xC8, 0x9F, 0x7E, 0xC9, 0xD9, 0x78, 0x73, 0x64,
+    0xEA, 0xC5, 0xAC, 0x83, 0x34, 0xD3, 0xEB, 0xC3, 0xC5, 0x81, 0xA0, 0xFF, 0xFA, 0x13, 0x63, 0xEB,
+    0x17, 0x0D, 0xDD, 0x51, 0xB7, 0xF0, 0xDA, 0x49, 0xD3, 0x16, 0x55, 0x26, 0x29, 0xD4, 0x68, 0x9E,
+    0x2B, 0x16, 0xBE, 0x58, 0x7D, 0x47, 0xA1, 0xFC, 0x8F, 0xF8, 0xB8, 0xD1, 0x7A, 0xD0, 0x31, 0xCE,
+    0x45, 0xCB, 0x3A, 0x8F, 0x95, 0x16, 0x04, 0x28, 0xAF, 0xD7, 0xFB, 0xCA, 0xBB, 0x4B, 0x40, 0x7E
+};
+
+// Multiply to 128 bits & fold the halves together.
+static inline u64 _Mul128Fold64(u64 lhs, u64 rhs) {
+    __extension__ typedef unsigned __int128 u128;
+    const u128 product = (u128)lhs * rhs;
+    return (u64)product ^ (u64)(product >> 64);
+}
+
+static inline u64 _Xxh64Avalanche(u64 hash) {
+    hash ^= hash >> 33;
+    hash *= _PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= _PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static inline u64 _Xxh3Avalanche(u64 hash) {
+    hash ^= hash >> 37;
+    hash *= _PRIME_MX1;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static inline u64 _Xxh3Rrmxmx(u64 hash, u64 size) {
+    hash ^= _Rotl64(hash, 49) ^ _Rotl64(hash, 24);
+    hash *= _PRIME_MX2;
+    hash ^= (hash >> 35) + size;
+    hash *= _PRIME_MX2;
+    return hash ^ (hash >> 28);
+}
+
+static u64 _Xxh3Hash0To16(const u8* src, u64 size, const u8* secret, u64 seed) {
+    if (size > 8) {
+        const u64 bitflip1 = (_ReadLE64(secret + 24) ^ _ReadLE64(secret + 32)) + seed;
+        const u64 bitflip2 = (_ReadLE64(secret + 40) ^ _ReadLE64(secret + 48)) - seed;
+        const u64 inputLo = _ReadLE64(src) ^ bitflip1;
+        const u64 inputHi = _ReadLE64(src + size - 8) ^ bitflip2;
+
+        return _Xxh3Avalanche(
+            size + __builtin_bswap64(inputLo) + inputHi + _Mul128Fold64(inputLo, inputHi)
+        );
+    }
+    if (size >= 4) {
+        seed ^= (u64)__builtin_bswap32((u32)seed) << 32;
+
+        const u32 input1 = _ReadLE32(src);
+        const u32 input2 = _ReadLE32(src + size - 4);
+        const u64 bitflip = (_ReadLE64(secret + 8) ^ _ReadLE64(secret + 16)) - seed;
+
+        return _Xxh3Rrmxmx((input2 + ((u64)input1 << 32)) ^ bitflip, size);
+    }
+    if (size > 0) {
+        const u32 combined =
+            ((u32)src[0] << 16) | ((u32)src[size >> 1] << 24) |
+            ((u32)src[size - 1] << 0) | ((u32)size << 8);
+        const u64 bitflip = (_ReadLE32(secret) ^ _ReadLE32(secret + 4)) + seed;
+
+        return _Xxh64Avalanche((u64)combined ^ bitflip);
+    }
+
+    return _Xxh64Avalanche(seed ^ (_ReadLE64(secret + 56) ^ _ReadLE64(secret + 64)));
+}
+
+static inline u64 _Xxh3Mix16(const u8* src, const u8* secret, u64 seed) {
+    return _Mul128Fold64(
+        _ReadLE64(src) ^ (_ReadLE64(secret) + seed),
+        _ReadLE64(src + 8) ^ (_ReadLE64(secret + 8) - seed)
+    );
+}
+
+static u64 _Xxh3Hash17To128(const u8* src, u64 size, const u8* secret, u64 seed) {
+    u64 acc = size * _PRIME64_1;
+
+    // Pairs of 16 bytes from the front & back, working inwards.
+    if (size > 32) {
+        if (size > 64) {
+            if (size > 96) {
+                acc += _Xxh3Mix16(src + 48, secret + 96, seed);
+                acc += _Xxh3Mix16(src + size - 64, secret + 112, seed);
+            }
+            acc += _Xxh3Mix16(src + 32, secret + 64, seed);
+            acc += _Xxh3Mix16(src + size - 48, secret + 80, seed);
+        }
+        acc += _Xxh3Mix16(src + 16, secret + 32, seed);
+        acc += _Xxh3Mix16(src + size - 32, secret + 48, seed);
+    }
+    acc += _Xxh3Mix16(src, secret, seed);
+    acc += _Xxh3Mix16(src + size - 16, secret + 16, seed);
+
+    return _Xxh3Avalanche(acc);
+}
+
+static u64 _Xxh3Hash129To240(const u8* src, u64 size, const u8* secret, u64 seed) {
+    const u32 roundCount = (u32)size / 16;
+
+    u64 acc = size * _PRIME64_1;
+    for (u32 i = 0; i < 8; i++)
+        acc += _Xxh3Mix16(src + 16 * i, secret + 16 * i, seed);
+    acc = _Xxh3Avalanche(acc);
+
+    u64 accEnd = _Xxh3Mix16(src + size - 16, secret + _XXH3_SECRET_SIZE_MIN - 17, seed);
+    for (u32 i = 8; i < roundCount; i++)
+        accEnd += _Xxh3Mix16(src + 16 * i, secret + 16 * (i - 8) + 3, seed);
+
+    return _Xxh3Avalanche(acc + accEnd);
+}
+
+// Long inputs: 8 accumulators, one per 8-byte lane of a 64-byte stripe. Lanes don't depend on
+// each other within a stripe, so a stripe is two (SSE2) to four vector operations wide.
+
+#if defined(__SSE2__)
+
+static inline void _Xxh3AccumulateStripe(u64 acc[8], const u8* src, const u8* secret) {
+    __m128i* vecAcc = (__m128i*)acc;
+
+    for (u32 i = 0; i < 4; i++) {
+        const __m128i data = _mm_loadu_si128((const __m128i*)src + i);
+        const __m128i key = _mm_loadu_si128((const __m128i*)secret + i);
+        const __m128i dataKey = _mm_xor_si128(data, key);
+
+        // Low 32 bits times high 32 bits of each lane.
+        const __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+        const __m128i product = _mm_mul_epu32(dataKey, dataKeyHi);
+
+        // The input is added to the neighbouring lane.
+        const __m128i dataSwap = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+        const __m128i sum = _mm_add_epi64(vecAcc[i], dataSwap);
+
+        vecAcc[i] = _mm_add_epi64(product, sum);
+    }
+}
+
+static inline void _Xxh3Scramble(u64 acc[8], const u8* secret) {
+    __m128i* vecAcc = (__m128i*)acc;
+    const __m128i prime = _mm_set1_epi32((int)_PRIME32_1);
+
+    for (u32 i = 0; i < 4; i++) {
+        const __m128i accVec = vecAcc[i];
+        const __m128i shifted = _mm_xor_si128(accVec, _mm_srli_epi64(accVec, 47));
+        const __m128i key = _mm_loadu_si128((const __m128i*)secret + i);
+        const __m128i dataKey = _mm_xor_si128(shifted, key);
+
+        // 64-bit multiply by a 32-bit prime, from two 32x32 products.
+        const __m128i dataKeyHi = _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1));
+        const __m128i productLo = _mm_mul_epu32(dataKey, prime);
+        const __m128i productHi = _mm_mul_epu32(dataKeyHi, prime);
+
+        vecAcc[i] = _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32));
+    }
+}
+
+#else // __SSE2__
+
+static inline void _Xxh3AccumulateStripe(u64 acc[8], const u8* src, const u8* secret) {
+    for (u32 i = 0; i < 8; i++) {
+        const u64 data = _ReadLE64(src + i * 8);
+        const u64 dataKey = data ^ _ReadLE64(secret + i * 8);
+
+        acc[i ^ 1] += data;
+        acc[i] += (u64)(u32)dataKey * (dataKey >> 32);
+    }
+}
+
+static inline void _Xxh3Scramble(u64 acc[8], const u8* secret) {
+    for (u32 i = 0; i < 8; i++) {
+        u64 value = acc[i];
+        value ^= value >> 47;
+        value ^= _ReadLE64(secret + i * 8);
+        value *= _PRIME32_1;
+        acc[i] = value;
+    }
+}
+
+#endif // __SSE2__
+
+static inline void _Xxh3AccumulateStripes(u64 acc[8], const u8* src, u64 stripeCount, const u8* secret) {
+    for (u64 i = 0; i < stripeCount; i++)
+        _Xxh3AccumulateStripe(acc, src + i * _XXH3_STRIPE_SIZE, secret + i * _XXH3_SECRET_CONSUME_RATE);
+}
+
+static u64 _Xxh3HashLong(const u8* src, u64 size, const u8* secret) {
+    u64 acc[8] __attribute__((aligned(16))) = {
+        _PRIME32_3, _PRIME64_1, _PRIME64_2, _PRIME64_3,
+        _PRIME64_4, _PRIME32_2, _PRIME64_5, _PRIME32_1
+    };
+
+    // Whole blocks; the last one may be left for below, so that the final stripe always has
+    // input to take.
+    const u64 blockCount = (size - 1) / _XXH3_BLOCK_SIZE;
+    for (u64 i = 0; i < blockCount; i++) {
+        _Xxh3AccumulateStripes(acc, src + i * _XXH3_BLOCK_SIZE, _XXH3_STRIPES_PER_BLOCK, secret);
+        _Xxh3Scramble(acc, secret + _XXH3_SECRET_SIZE - _XXH3_STRIPE_SIZE);
+    }
+
+    // Stripes of the last partial block, then the last 64 bytes (which may overlap them).
+    const u64 stripeCount = ((size - 1) - blockCount * _XXH3_BLOCK_SIZE) / _XXH3_STRIPE_SIZE;
+    _Xxh3AccumulateStripes(acc, src + blockCount * _XXH3_BLOCK_SIZE, stripeCount, secret);
+    _Xxh3AccumulateStripe(
+        acc, src + size - _XXH3_STRIPE_SIZE, secret + _XXH3_SECRET_SIZE - _XXH3_STRIPE_SIZE - 7
+    );
+
+    // Merge the accumulators.
+    const u8* mergeSecret = secret + 11;
+    u64 result = size * _PRIME64_1;
+    for (u32 i = 0; i < 4; i++) {
+        result += _Mul128Fold64(
+            acc[2 * i] ^ _ReadLE64(mergeSecret + 16 * i),
+            acc[2 * i + 1] ^ _ReadLE64(mergeSecret + 16 * i + 8)
+        );
+    }
+
+    return _Xxh3Avalanche(result);
+}
+
+u64 HashXxh3(const void* data, u64 size, u64 seed) {
+    const u8* src = data;
+
+    if (size <= 16)
+        return _Xxh3Hash0To16(src, size, _xxh3Secret, seed);
+    if (size <= 128)
+        return _Xxh3Hash17To128(src, size, _xxh3Secret, seed);
+    if (size <= 240)
+        return _Xxh3Hash129To240(src, size, _xxh3Secret, seed);
+
+    if (seed == 0)
+        return _Xxh3HashLong(src, size, _xxh3Secret);
+
+    // Long inputs take the seed through a derived secret.
+    u8 secret[_XXH3_SECRET_SIZE] __attribute__((aligned(16)));
+    for (u32 i = 0; i < _XXH3_SECRET_SIZE / 16; i++) {
+        _WriteLE64(secret + 16 * i, _ReadLE64(_xxh3Secret + 16 * i) + seed);
+        _WriteLE64(secret + 16 * i + 8, _ReadLE64(_xxh3Secret + 16 * i + 8) - seed);
+    }
+    return _Xxh3HashLong(src, size, secret);
+}
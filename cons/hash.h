@@ -0,0 +1,32 @@
+#ifndef CONS_HASH_H
+#define CONS_HASH_H
+
+// CONS -- hashing (MD5 & XXH3)
+
+#include "type.h"
+
+#define MD5_DIGEST_SIZE (16)
+
+// MD5, for file formats that store it. Not for anything security related.
+typedef struct ConsMd5 {
+    u32 _state[4];
+    u64 _size; // Bytes hashed so far.
+    u8 _block[64]; // Bytes not yet hashed (_size % 64 of them).
+} ConsMd5;
+
+// Initialize an MD5 hash.
+void Md5Init(ConsMd5* md5);
+// Hash more data.
+void Md5Update(ConsMd5* md5, const void* data, u64 size);
+// Finish an MD5 hash, writing the digest to outDigest.
+void Md5Finish(ConsMd5* md5, u8 outDigest[MD5_DIGEST_SIZE]);
+
+// Hash data with MD5 in one go.
+void HashMd5(const void* data, u64 size, u8 outDigest[MD5_DIGEST_SIZE]);
+
+// Hash data with XXH3 (64-bit); the result is the same as XXH3_64bits_withSeed from xxHash.
+// Many times faster than MD5, for hashes that never leave bemt (lookups, change detection).
+// Long inputs are processed in 64-byte stripes of 8 independent lanes (with SSE2 on x86-64).
+u64 HashXxh3(const void* data, u64 size, u64 seed);
+
+#endif // CONS_HASH_H
@@ -1,5 +1,9 @@
 #include "list.h"
 
+#include "arena.h"
+
+#include "macro.h"
+
 #include <stdlib.h> // malloc, realloc
 
 #include <string.h> // memset
@@ -11,9 +15,28 @@ void ListInit(ConsList* list, u32 elementSize, u64 initialCapacity) {
     list->elementSize = elementSize;
     list->_capacity = initialCapacity;
     list->elementCount = 0;
+    list->_arena = NULL;
     list->data = malloc(elementSize * initialCapacity);
 }
 
+void ListInitArena(ConsList* list, u32 elementSize, u64 initialCapacity, ConsArena* arena) {
+    if (list == NULL)
+        return;
+
+    list->elementSize = elementSize;
+    list->_capacity = initialCapacity;
+    list->elementCount = 0;
+    list->_arena = arena;
+    list->data = ArenaAlloc(arena, (u64)elementSize * initialCapacity);
+}
+
+// Resize the list's data, on the heap or in the list's arena.
+static void* _ListRealloc(ConsList* list, u64 oldSize, u64 newSize) {
+    if (list->_arena != NULL)
+        return ArenaRealloc(list->_arena, list->data, oldSize, newSize);
+    return realloc(list->data, newSize);
+}
+
 void* ListGet(ConsList* list, u64 index) {
     if (list == NULL)
         return NULL;
@@ -29,12 +52,13 @@ void ListAdd(ConsList* list, void* element) {
 
     // Double capacity.
     if (list->elementCount == list->_capacity) {
+        const u64 oldSize = list->elementSize * list->_capacity;
         if (list->_capacity == 0)
             list->_capacity = 1;
         else
             list->_capacity *= 2;
 
-        list->data = realloc(list->data, list->elementSize * list->_capacity);
+        list->data = _ListRealloc(list, oldSize, list->elementSize * list->_capacity);
     }
 
     u64 position = list->elementCount * list->elementSize;
@@ -62,10 +86,12 @@ void ListAddRange(ConsList* list, void* elements, u64 count) {
     if (list == NULL)
         return;
 
+    // Grow geometrically, so repeated range adds stay amortized O(1) per element.
     if (list->elementCount + count > list->_capacity) {
-        list->_capacity = list->elementCount + count;
+        const u64 oldSize = list->elementSize * list->_capacity;
+        list->_capacity = MAX(list->_capacity * 2, list->elementCount + count);
 
-        list->data = realloc(list->data, list->elementSize * list->_capacity);
+        list->data = _ListRealloc(list, oldSize, list->elementSize * list->_capacity);
     }
 
     u64 position = list->elementCount * list->elementSize;
@@ -102,8 +128,9 @@ void ListResize(ConsList* list, u64 newCount) {
         return;
 
     if (newCount > list->_capacity) {
+        const u64 oldSize = list->elementSize * list->_capacity;
         list->_capacity = newCount;
-        list->data = realloc(list->data, list->elementSize * list->_capacity);
+        list->data = _ListRealloc(list, oldSize, list->elementSize * list->_capacity);
     }
 
     u64 startPosition = list->elementCount * list->elementSize;
@@ -152,16 +179,17 @@ void ListCopy(ConsList* dest, ConsList* src) {
 
     // Uninitialized dest
     if (dest->data == NULL) {
-        dest->data = malloc(srcDataSize);
+        dest->data = (dest->_arena != NULL) ?
+            ArenaAlloc(dest->_arena, srcDataSize) : malloc(srcDataSize);
     }
     // Mismatched element size
     else if (dest->elementSize != src->elementSize) {
-        dest->data = realloc(dest->data, srcDataSize);
+        dest->data = _ListRealloc(dest, dest->elementSize * dest->_capacity, srcDataSize);
     }
     // Matching element size
     else {
         if (dest->_capacity < src->elementCount) {
-            dest->data = realloc(dest->data, srcDataSize);
+            dest->data = _ListRealloc(dest, dest->elementSize * dest->_capacity, srcDataSize);
             dest->_capacity = src->elementCount;
         }
         memcpy(dest->data, src->data, srcDataSize);
@@ -187,8 +215,9 @@ void ListDestroy(ConsList* list) {
     if (list == NULL)
         return;
 
-    if (list->data)
+    if (list->data && list->_arena == NULL)
         free(list->data);
+    list->data = NULL;
     list->elementCount = 0;
     list->elementSize = 0;
     list->_capacity = 0;
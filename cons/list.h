@@ -15,10 +15,14 @@ typedef struct ConsList {
     u32 elementSize;
 
     u64 _capacity;
+    struct ConsArena* _arena; // NULL if the data is heap-allocated.
 } ConsList;
 
 // Initialize a list.
 void ListInit(ConsList* list, u32 elementSize, u64 initialCapacity);
+// Initialize a list whose data is allocated from an arena. ListDestroy leaves the data to the
+// arena.
+void ListInitArena(ConsList* list, u32 elementSize, u64 initialCapacity, struct ConsArena* arena);
 
 // Get a pointer to the specified element.
 void* ListGet(ConsList* list, u64 index);
@@ -23,6 +23,10 @@
 #define ALIGN_DOWN_64(value) ( (value) & ~(64 - 1) )
 #define ALIGN_UP_64(value)   ( ((value) + 64 - 1) & ~(64 - 1) )
 
+// Alignment must be a power of two.
+#define ALIGN_DOWN(value, alignment) ( (value) & ~((u64)(alignment) - 1) )
+#define ALIGN_UP(value, alignment)   ( ((value) + (u64)(alignment) - 1) & ~((u64)(alignment) - 1) )
+
 // Identifiers
 
 #define IDENTIFIER_TO_U32(char1, char2, char3, char4) ( \
@@ -6,18 +6,33 @@
 
 #include <stdio.h>
 
+#include "arena.h"
+
 #include "macro.h"
 
 #define REF_BIT_NPOS ((u64)-1)
 #define NODE_NPOS ((u64)-1)
 
-static ConsPtrieNode* _CreateNode(const char* key) {
-    ConsPtrieNode* node = malloc(sizeof(ConsPtrieNode));
-
-    if (key != NULL)
-        node->key = strdup(key);
-    else
+static ConsPtrieNode* _CreateNode(ConsPtrie* trie, const char* key, u64 keyLen) {
+    ConsPtrieNode* node;
+    if (trie->_arena != NULL) {
+        // The key is borrowed.
+        node = ArenaAlloc(trie->_arena, sizeof(ConsPtrieNode));
+        node->key = key;
+    }
+    else {
+        node = malloc(sizeof(ConsPtrieNode));
         node->key = NULL;
+        if (key != NULL) {
+            char* keyCopy = malloc(keyLen + 1);
+            memcpy(keyCopy, key, keyLen);
+            keyCopy[keyLen] = '\0';
+            node->key = keyCopy;
+        }
+    }
+
+    node->keyLen = keyLen;
+
     node->refBit = REF_BIT_NPOS;
     node->left = node;
     node->right = node;
@@ -31,18 +46,20 @@ static void _DestroyNode(ConsPtrieNode* node) {
         return;
 
     if (node->key != NULL)
-        free(node->key);
+        free((char*)node->key);
     free(node);
 }
 
 void PtrieInit(ConsPtrie* trie) {
     trie->nodeCount = 0;
-    trie->root = malloc(sizeof(ConsPtrieNode));
+    trie->_arena = NULL;
+    trie->root = _CreateNode(trie, NULL, 0);
+}
 
-    trie->root->key = NULL;
-    trie->root->refBit = REF_BIT_NPOS;
-    trie->root->left = trie->root;
-    trie->root->right = trie->root;
+void PtrieInitArena(ConsPtrie* trie, ConsArena* arena) {
+    trie->nodeCount = 0;
+    trie->_arena = arena;
+    trie->root = _CreateNode(trie, NULL, 0);
 }
 
 static void _DestroyRecursive(ConsPtrieNode* node, ConsPtrieNode* parent, ConsPtrieNode* root) {
@@ -58,9 +75,11 @@ void PtrieDestroy(ConsPtrie* trie) {
     if (trie == NULL || trie->root == NULL)
         return;
 
-    _DestroyRecursive(trie->root->left, trie->root, trie->root);
-
-    _DestroyNode(trie->root);
+    // Arena-allocated nodes are freed along with the arena.
+    if (trie->_arena == NULL) {
+        _DestroyRecursive(trie->root->left, trie->root, trie->root);
+        _DestroyNode(trie->root);
+    }
     trie->root = NULL;
     trie->nodeCount = 0;
 }
@@ -75,47 +94,18 @@ void PtrieDestroyFlat(ConsFlatPtrie* trie) {
     trie->nodeCount = 0;
 }
 
-static u32 _ExtractRefBit(const char* key, u64 refBit) {
-    u64 len = strlen(key);
-    u64 invByteIdx = refBit >> 3;
-
-    if (invByteIdx >= len)
-        return 0;
-
-    u64 byteIdx = len - 1 - invByteIdx;
-    u64 shift = refBit & 7;
-
-    return ((u8)(key[byteIdx]) >> shift) & 1;
-}
-
-static u64 _GetFirstDifferingBit(const char* a, const char* b) {
-    u64 aLen = strlen(a);
-    u64 bLen = strlen(b);
-
-    u64 maxBits = MAX(aLen, bLen) * 8;
-
-    for (u32 bit = 0; bit < maxBits; bit++) {
-        u32 abit = _ExtractRefBit(a, bit);
-        u32 bbit = _ExtractRefBit(b, bit);
-
-        if (abit != bbit)
-            return bit;
-    }
-
-    if (aLen != bLen)
-        return MIN(aLen, bLen) * 8;
-
-    return REF_BIT_NPOS;
+static bool _NodeKeyEquals(const ConsPtrieNode* node, const char* key, u64 keyLen) {
+    return node->keyLen == keyLen && memcmp(node->key, key, keyLen) == 0;
 }
 
-ConsPtrieNode* PtrieSearch(ConsPtrie* trie, const char* key) {
+ConsPtrieNode* PtrieSearchLen(ConsPtrie* trie, const char* key, u64 keyLen) {
     ConsPtrieNode* node = trie->root->left;
     ConsPtrieNode* prevNode = node;
 
     while (1) {
         prevNode = node;
 
-        u32 bit = _ExtractRefBit(key, node->refBit);
+        u32 bit = PtrieExtractRefBit(key, keyLen, node->refBit);
         node = bit ? node->right : node->left;
 
         if (node == trie->root)
@@ -124,20 +114,24 @@ ConsPtrieNode* PtrieSearch(ConsPtrie* trie, const char* key) {
             break;
     }
 
-    if (strcmp(key, node->key) == 0)
+    if (_NodeKeyEquals(node, key, keyLen))
         return node;
     else
         return NULL;
 }
 
-ConsPtrieNode* PtrieInsert(ConsPtrie* trie, const char* key) {
+ConsPtrieNode* PtrieSearch(ConsPtrie* trie, const char* key) {
+    return PtrieSearchLen(trie, key, strlen(key));
+}
+
+ConsPtrieNode* PtrieInsertLen(ConsPtrie* trie, const char* key, u64 keyLen) {
     if (trie->root == NULL) {
         // Trie is uninitialized.
         return NULL;
     }
 
     if (trie->root->left == trie->root) {
-        trie->root->left = _CreateNode(key);
+        trie->root->left = _CreateNode(trie, key, keyLen);
         trie->nodeCount++;
         return trie->root->left;
     }
@@ -147,33 +141,33 @@ ConsPtrieNode* PtrieInsert(ConsPtrie* trie, const char* key) {
 
     do {
         parent = node;
-        u32 bit = _ExtractRefBit(key, node->refBit);
+        u32 bit = PtrieExtractRefBit(key, keyLen, node->refBit);
         node = bit ? node->right : node->left;
     } while (node->refBit > parent->refBit);
 
     // Node already exists.
-    if (strcmp(key, node->key) == 0)
+    if (_NodeKeyEquals(node, key, keyLen))
         return node;
 
-    u64 diffBit = _GetFirstDifferingBit(key, node->key);
+    u64 diffBit = PtrieGetFirstDifferingBit(key, keyLen, node->key, node->keyLen);
 
     node = trie->root->left;
     ConsPtrieNode* prev = NULL;
     while (node->refBit < diffBit && (prev == NULL || node->refBit > prev->refBit)) {
         prev = node;
-        u32 bit = _ExtractRefBit(key, node->refBit);
+        u32 bit = PtrieExtractRefBit(key, keyLen, node->refBit);
         node = bit ? node->right : node->left;
     }
 
-    ConsPtrieNode* newLeaf = _CreateNode(key);
+    ConsPtrieNode* newLeaf = _CreateNode(trie, key, keyLen);
     trie->nodeCount++;
 
-    ConsPtrieNode* newNode = _CreateNode(NULL);
+    ConsPtrieNode* newNode = _CreateNode(trie, NULL, 0);
     trie->nodeCount++;
 
     newNode->refBit = diffBit;
 
-    u32 keyBit = _ExtractRefBit(key, diffBit);
+    u32 keyBit = PtrieExtractRefBit(key, keyLen, diffBit);
     if (keyBit) {
         newNode->left = node;
         newNode->right = newLeaf;
@@ -187,7 +181,7 @@ ConsPtrieNode* PtrieInsert(ConsPtrie* trie, const char* key) {
         trie->root->left = newNode;
     }
     else {
-        u32 prevBit = _ExtractRefBit(key, prev->refBit);
+        u32 prevBit = PtrieExtractRefBit(key, keyLen, prev->refBit);
         if (prevBit)
             prev->right = newNode;
         else
@@ -197,6 +191,10 @@ ConsPtrieNode* PtrieInsert(ConsPtrie* trie, const char* key) {
     return newLeaf;
 }
 
+ConsPtrieNode* PtrieInsert(ConsPtrie* trie, const char* key) {
+    return PtrieInsertLen(trie, key, strlen(key));
+}
+
 typedef struct _NodeIndexMap {
     ConsPtrieNode* node;
     u64 index;
@@ -225,7 +223,12 @@ static u64 _FlattenNode(
 
     map[index].node = node;
 
-    outNodes[index].key = node->key ? strdup(node->key) : NULL;
+    outNodes[index].key = NULL;
+    if (node->key != NULL) {
+        outNodes[index].key = malloc(node->keyLen + 1);
+        memcpy(outNodes[index].key, node->key, node->keyLen);
+        outNodes[index].key[node->keyLen] = '\0';
+    }
     outNodes[index].refBit = node->refBit;
 
     outNodes[index].leftIndex = 
@@ -276,13 +279,15 @@ ConsFlatPtrieNode* PtrieSearchFlat(ConsFlatPtrie* trie, const char* key) {
     if (trie == NULL)
         return NULL;
 
+    const u64 keyLen = strlen(key);
+
     ConsFlatPtrieNode* node = trie->nodes + trie->nodes->leftIndex;
     ConsFlatPtrieNode* prevNode = node;
 
     while (1) {
         prevNode = node;
 
-        u32 bit = _ExtractRefBit(key, node->refBit);
+        u32 bit = PtrieExtractRefBit(key, keyLen, node->refBit);
         node = trie->nodes + (bit ? node->rightIndex : node->leftIndex);
 
         if (node == trie->nodes)
@@ -339,3 +344,44 @@ void PtrieSwapFlatNode(ConsFlatPtrie* trie, u64 aIdx, u64 bIdx) {
             n->rightIndex = aIdx;
     }
 }
+
+// Load the 8 bytes that lie byteFromEnd bytes before the end of the key. The last character
+// ends up in the most significant byte; bytes before the start of the key read as zero.
+static inline u64 _LoadKeyWord(const char* key, u64 keyLen, u64 byteFromEnd) {
+    u64 word = 0;
+    if (byteFromEnd >= keyLen)
+        return word;
+
+    const u64 available = keyLen - byteFromEnd;
+    const u64 count = MIN(available, 8);
+
+    memcpy((u8*)&word + (8 - count), key + (available - count), count);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    return word;
+}
+
+u64 PtrieGetFirstDifferingBit(const char* a, u64 aLen, const char* b, u64 bLen) {
+    const u64 maxLen = MAX(aLen, bLen);
+
+    for (u64 byteFromEnd = 0; byteFromEnd < maxLen; byteFromEnd += 8) {
+        const u64 diff = _LoadKeyWord(a, aLen, byteFromEnd) ^ _LoadKeyWord(b, bLen, byteFromEnd);
+        if (diff == 0)
+            continue;
+
+        // The highest differing byte is the one closest to the end of the key ..
+        const u32 byteIdx = (u32)__builtin_clzll(diff) >> 3;
+        // .. and within that byte we want the lowest differing bit.
+        const u8 byteDiff = (u8)(diff >> ((7 - byteIdx) * 8));
+
+        return ((byteFromEnd + byteIdx) * 8) + (u64)__builtin_ctz(byteDiff);
+    }
+
+    if (aLen != bLen)
+        return MIN(aLen, bLen) * 8;
+
+    return REF_BIT_NPOS;
+}
@@ -6,7 +6,10 @@
 #include "type.h"
 
 typedef struct ConsPtrieNode {
-    char* key; // Owned by this node. NULL on root node & internal nodes.
+    // Owned by this node, or borrowed if the trie uses an arena. NULL on root node & internal
+    // nodes.
+    const char* key;
+    u64 keyLen;
     u64 refBit; // (u64)-1 means NPOS.
     struct ConsPtrieNode* left; // Will always be followed on root node.
     struct ConsPtrieNode* right;
@@ -18,6 +21,8 @@ typedef struct ConsPtrie {
     // The root node is empty. The first node can be found at root->left (if present).
     // Otherwise, root->left will point to the root node.
     ConsPtrieNode* root;
+
+    struct ConsArena* _arena; // NULL if nodes & keys are heap-allocated.
 } ConsPtrie;
 
 typedef struct ConsFlatPtrieNode {
@@ -34,6 +39,10 @@ typedef struct ConsFlatPtrie {
 
 // Initialize an empty patricia trie.
 void PtrieInit(ConsPtrie* trie);
+// Initialize an empty patricia trie whose nodes are allocated from an arena. Keys aren't copied:
+// the caller keeps every inserted key alive as long as the trie. PtrieDestroy leaves the nodes to
+// the arena.
+void PtrieInitArena(ConsPtrie* trie, struct ConsArena* arena);
 
 // Destroy a patricia trie.
 void PtrieDestroy(ConsPtrie* trie);
@@ -42,10 +51,14 @@ void PtrieDestroyFlat(ConsFlatPtrie* trie);
 
 // Search for a node by it's key.
 ConsPtrieNode* PtrieSearch(ConsPtrie* trie, const char* key);
+// Search for a node by it's key, given with its length (no null terminator needed).
+ConsPtrieNode* PtrieSearchLen(ConsPtrie* trie, const char* key, u64 keyLen);
 ConsFlatPtrieNode* PtrieSearchFlat(ConsFlatPtrie* trie, const char* key);
 
-// Insert a node into the patricia trie (the key will be duplicated).
+// Insert a node into the patricia trie (the key is duplicated, unless the trie uses an arena).
 ConsPtrieNode* PtrieInsert(ConsPtrie* trie, const char* key);
+// Insert a node with a key given with its length (no null terminator needed).
+ConsPtrieNode* PtrieInsertLen(ConsPtrie* trie, const char* key, u64 keyLen);
 
 // Flatten a patricia trie.
 void PtrieFlatten(ConsPtrie* trie, ConsFlatPtrie* flat);
@@ -53,4 +66,17 @@ void PtrieFlatten(ConsPtrie* trie, ConsFlatPtrie* flat);
 // Swap two flat trie nodes.
 void PtrieSwapFlatNode(ConsFlatPtrie* trie, u64 aIdx, u64 bIdx);
 
+// Get the first differing bit between two keys (bit 0 is the lowest bit of the last character).
+// Returns (u64)-1 if the keys are equal.
+u64 PtrieGetFirstDifferingBit(const char* a, u64 aLen, const char* b, u64 bLen);
+
+// Extract a bit from a key (bit 0 is the lowest bit of the last character).
+static inline u32 PtrieExtractRefBit(const char* key, u64 keyLen, u64 refBit) {
+    const u64 invByteIdx = refBit >> 3;
+    if (invByteIdx >= keyLen)
+        return 0;
+
+    return ((u8)(key[keyLen - 1 - invByteIdx]) >> (refBit & 7)) & 1;
+}
+
 #endif // CONS_PTRIE_H
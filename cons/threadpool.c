@@ -0,0 +1,602 @@
+#ifdef __linux__
+#define _GNU_SOURCE // sched_getaffinity
+#endif
+
+#include "threadpool.h"
+
+#include "error.h"
+
+#include "macro.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <string.h>
+
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Tasks submitted from outside the pool that can be queued at once.
+#define POOL_INJECT_QUEUE_CAPACITY (4096)
+
+// Chunks per thread when ThreadPoolParallelFor picks the grain size; more chunks balance uneven
+// work better.
+#define POOL_CHUNKS_PER_THREAD (4)
+
+typedef struct _ConsTask {
+    ConsTaskFunc func;
+    void* userData;
+    ConsTaskGroup* group;
+} _ConsTask;
+
+typedef struct _ConsPoolWorker {
+    struct _ConsPoolState* state;
+    u32 index;
+    pthread_t thread;
+
+    pthread_mutex_t dequeMutex;
+    ConsDeque deque; // _ConsTask; the owner works at the back, thieves at the front.
+} _ConsPoolWorker;
+
+typedef struct _ConsPoolState {
+    _ConsPoolWorker* workers;
+    u32 workerCount;
+
+    ConsMpmcQueue injectQueue; // _ConsTask
+
+    u64 queuedCount; // Tasks in any queue (atomic).
+    u32 sleepingCount; // Threads waiting on cond (atomic).
+    bool stop;
+
+    pthread_mutex_t mutex;
+    // Signaled when a task is queued, broadcast when a group finishes. Idle workers & threads
+    // waiting on a group both wait on it, so a waiting thread also wakes up to help.
+    pthread_cond_t cond;
+} _ConsPoolState;
+
+// Worker the current thread is, if any.
+static _Thread_local _ConsPoolWorker* _currentWorker = NULL;
+
+static _ConsPoolWorker* _GetCurrentWorker(_ConsPoolState* state) {
+    return (_currentWorker != NULL && _currentWorker->state == state) ? _currentWorker : NULL;
+}
+
+// Default thread count
+
+#ifdef __linux__
+
+// Read the first line of a (small) file.
+static bool _ReadFirstLine(const char* path, char* line, int lineSize) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    const bool ok = fgets(line, lineSize, file) != NULL;
+    fclose(file);
+
+    return ok;
+}
+
+// CPUs allowed by a CPU quota (quota / period, rounded up), or 0 if there's no quota.
+static u32 _GetQuotaCpuCount(long long quota, long long period) {
+    if (quota <= 0 || period <= 0)
+        return 0;
+    return (u32)((quota + period - 1) / period);
+}
+
+// Tighter of two CPU limits, where 0 is no limit.
+static u32 _MinCpuLimit(u32 a, u32 b) {
+    if (a == 0 || b == 0)
+        return MAX(a, b);
+    return MIN(a, b);
+}
+
+// Find the cgroup of this process in /proc/self/cgroup: the unified (v2) one if controller is
+// NULL, otherwise the v1 hierarchy that has the controller.
+// Returns true on success, false on failure.
+static bool _GetOwnCgroupPath(const char* controller, char* outPath, int outPathSize) {
+    FILE* file = fopen("/proc/self/cgroup", "r");
+    if (file == NULL)
+        return false;
+
+    bool found = false;
+
+    // "<hierarchy id>:<controllers>:<path>"; v2 has id 0 & no controllers.
+    char line[512];
+    while (!found && fgets(line, sizeof(line), file) != NULL) {
+        char* controllers = strchr(line, ':');
+        char* path = (controllers != NULL) ? strchr(controllers + 1, ':') : NULL;
+        if (path == NULL)
+            continue;
+
+        *controllers++ = '\0';
+        *path++ = '\0';
+        path[strcspn(path, "\n")] = '\0';
+
+        if (controller == NULL)
+            found = strcmp(line, "0") == 0 && *controllers == '\0';
+        else {
+            for (char* name = strtok(controllers, ","); name != NULL && !found; name = strtok(NULL, ","))
+                found = strcmp(name, controller) == 0;
+        }
+
+        if (found)
+            snprintf(outPath, outPathSize, "%s", path);
+    }
+
+    fclose(file);
+    return found;
+}
+
+// Read the CPU limit of one cgroup directory, or 0 if there is none.
+static u32 _GetCgroupDirCpuLimit(const char* dirPath, bool isV2) {
+    char path[768];
+    char line[256];
+
+    if (isV2) {
+        // "max <period>" or "<quota> <period>".
+        snprintf(path, sizeof(path), "%s/cpu.max", dirPath);
+        long long quota, period;
+        if (_ReadFirstLine(path, line, sizeof(line)) && sscanf(line, "%lld %lld", &quota, &period) == 2)
+            return _GetQuotaCpuCount(quota, period);
+        return 0;
+    }
+
+    // The quota is -1 if there is none.
+    char periodLine[64];
+
+    snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dirPath);
+    if (!_ReadFirstLine(path, line, sizeof(line)))
+        return 0;
+
+    snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dirPath);
+    if (!_ReadFirstLine(path, periodLine, sizeof(periodLine)))
+        return 0;
+
+    return _GetQuotaCpuCount(atoll(line), atoll(periodLine));
+}
+
+// Get the tightest CPU limit from the cgroup of this process up to the root of the hierarchy
+// mounted at mountPath (limits of parent cgroups apply to their children too).
+static u32 _GetCgroupTreeCpuLimit(const char* mountPath, const char* cgroupPath, bool isV2) {
+    char dirPath[512];
+    snprintf(dirPath, sizeof(dirPath), "%s%s", mountPath, cgroupPath);
+
+    const u64 mountPathLen = strlen(mountPath);
+
+    u32 limit = 0;
+    while (true) {
+        // Trailing slashes (the path of the root cgroup is "/").
+        u64 dirPathLen = strlen(dirPath);
+        while (dirPathLen > mountPathLen && dirPath[dirPathLen - 1] == '/')
+            dirPath[--dirPathLen] = '\0';
+
+        // Inside a container without a cgroup namespace the path is the host's, which may not
+        // exist under the mount; the directories above it are still checked.
+        limit = _MinCpuLimit(limit, _GetCgroupDirCpuLimit(dirPath, isV2));
+
+        if (dirPathLen <= mountPathLen)
+            break;
+
+        char* lastSlash = strrchr(dirPath, '/');
+        if (lastSlash == NULL || (u64)(lastSlash - dirPath) < mountPathLen)
+            break;
+        *lastSlash = '\0';
+    }
+
+    return limit;
+}
+
+// Get the CPU limit set by the cgroup of this process (or any of its parents), or 0 if there is
+// none.
+static u32 _GetCgroupCpuLimit(void) {
+    char cgroupPath[256];
+
+    // cgroup v2 (unified hierarchy).
+    if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0) {
+        if (!_GetOwnCgroupPath(NULL, cgroupPath, sizeof(cgroupPath)))
+            snprintf(cgroupPath, sizeof(cgroupPath), "/");
+        return _GetCgroupTreeCpuLimit("/sys/fs/cgroup", cgroupPath, true);
+    }
+
+    // cgroup v1: the cpu controller has its own hierarchy.
+    if (!_GetOwnCgroupPath("cpu", cgroupPath, sizeof(cgroupPath)))
+        snprintf(cgroupPath, sizeof(cgroupPath), "/");
+
+    static const char* v1Dirs[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" };
+    for (u32 i = 0; i < ARR_LIT_LEN(v1Dirs); i++) {
+        if (access(v1Dirs[i], F_OK) == 0)
+            return _GetCgroupTreeCpuLimit(v1Dirs[i], cgroupPath, false);
+    }
+
+    return 0;
+}
+
+#endif // __linux__
+
+u32 ThreadPoolGetDefaultThreadCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    long cpuCount = (long)systemInfo.dwNumberOfProcessors;
+#else
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+#ifdef __linux__
+    // CPUs this process may run on (taskset, cpuset cgroups).
+    cpu_set_t cpuSet;
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0 && CPU_COUNT(&cpuSet) > 0)
+        cpuCount = MIN(cpuCount, (long)CPU_COUNT(&cpuSet));
+
+    const u32 cgroupLimit = _GetCgroupCpuLimit();
+    if (cgroupLimit != 0)
+        cpuCount = MIN(cpuCount, (long)cgroupLimit);
+#endif
+
+    return (cpuCount > 0) ? (u32)cpuCount : 1;
+}
+
+// Pool
+
+static void _RunTask(_ConsPoolState* state, _ConsTask* task) {
+    task->func(task->userData);
+
+    // The group may be gone as soon as its count hits zero, so it's not touched after.
+    if (task->group != NULL && __atomic_sub_fetch(&task->group->_pendingCount, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&state->mutex);
+        pthread_cond_broadcast(&state->cond);
+        pthread_mutex_unlock(&state->mutex);
+    }
+}
+
+static bool _PopFromWorker(_ConsPoolWorker* worker, bool fromBack, _ConsTask* outTask) {
+    pthread_mutex_lock(&worker->dequeMutex);
+    const bool found = fromBack ?
+        DequePopBack(&worker->deque, outTask) : DequePopFront(&worker->deque, outTask);
+    pthread_mutex_unlock(&worker->dequeMutex);
+
+    return found;
+}
+
+// Find a task: own deque first, then the shared queue, then steal from the other workers.
+static bool _FindTask(_ConsPoolState* state, _ConsPoolWorker* worker, _ConsTask* outTask) {
+    if (__atomic_load_n(&state->queuedCount, __ATOMIC_ACQUIRE) == 0)
+        return false;
+
+    bool found = worker != NULL && _PopFromWorker(worker, true, outTask);
+
+    if (!found)
+        found = MpmcQueueTryPop(&state->injectQueue, outTask);
+
+    // Start with the next worker, so thieves spread out over the victims.
+    const u32 start = (worker != NULL) ? worker->index + 1 : 0;
+    for (u32 i = 0; !found && i < state->workerCount; i++) {
+        _ConsPoolWorker* victim = state->workers + ((start + i) % state->workerCount);
+        if (victim != worker)
+            found = _PopFromWorker(victim, false, outTask);
+    }
+
+    if (found)
+        __atomic_sub_fetch(&state->queuedCount, 1, __ATOMIC_SEQ_CST);
+    return found;
+}
+
+static void* _PoolWorkerMain(void* userData) {
+    _ConsPoolWorker* worker = userData;
+    _ConsPoolState* state = worker->state;
+
+    _currentWorker = worker;
+
+    while (true) {
+        _ConsTask task;
+        if (_FindTask(state, worker, &task)) {
+            _RunTask(state, &task);
+            continue;
+        }
+
+        pthread_mutex_lock(&state->mutex);
+
+        // Announce the sleep before the last check: a submitter either sees us sleeping (and
+        // signals under the mutex) or we see its task.
+        __atomic_add_fetch(&state->sleepingCount, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&state->queuedCount, __ATOMIC_SEQ_CST) == 0 && !state->stop)
+            pthread_cond_wait(&state->cond, &state->mutex);
+        __atomic_sub_fetch(&state->sleepingCount, 1, __ATOMIC_SEQ_CST);
+
+        const bool stop = state->stop && __atomic_load_n(&state->queuedCount, __ATOMIC_SEQ_CST) == 0;
+
+        pthread_mutex_unlock(&state->mutex);
+
+        if (stop)
+            break;
+    }
+
+    _currentWorker = NULL;
+    return NULL;
+}
+
+void ThreadPoolInit(ConsThreadPool* pool, u32 threadCount) {
+    if (pool == NULL)
+        return;
+
+    if (threadCount == 0)
+        threadCount = ThreadPoolGetDefaultThreadCount();
+
+    _ConsPoolState* state = calloc(1, sizeof(_ConsPoolState));
+
+    MpmcQueueInit(&state->injectQueue, sizeof(_ConsTask), POOL_INJECT_QUEUE_CAPACITY);
+
+    pthread_mutex_init(&state->mutex, NULL);
+    pthread_cond_init(&state->cond, NULL);
+
+    state->workerCount = threadCount;
+    state->workers = calloc(threadCount, sizeof(_ConsPoolWorker));
+
+    for (u32 i = 0; i < threadCount; i++) {
+        _ConsPoolWorker* worker = state->workers + i;
+
+        worker->state = state;
+        worker->index = i;
+
+        pthread_mutex_init(&worker->dequeMutex, NULL);
+        DequeInit(&worker->deque, sizeof(_ConsTask), 64);
+    }
+
+    for (u32 i = 0; i < threadCount; i++) {
+        if (pthread_create(&state->workers[i].thread, NULL, _PoolWorkerMain, state->workers + i) != 0)
+            Panic("ThreadPool: failed to create worker thread");
+    }
+
+    pool->threadCount = threadCount;
+    pool->_state = state;
+}
+
+void ThreadPoolDestroy(ConsThreadPool* pool) {
+    if (pool == NULL || pool->_state == NULL)
+        return;
+
+    _ConsPoolState* state = pool->_state;
+
+    pthread_mutex_lock(&state->mutex);
+    state->stop = true;
+    pthread_cond_broadcast(&state->cond);
+    pthread_mutex_unlock(&state->mutex);
+
+    for (u32 i = 0; i < state->workerCount; i++) {
+        _ConsPoolWorker* worker = state->workers + i;
+
+        pthread_join(worker->thread, NULL);
+
+        DequeDestroy(&worker->deque);
+        pthread_mutex_destroy(&worker->dequeMutex);
+    }
+    free(state->workers);
+
+    pthread_cond_destroy(&state->cond);
+    pthread_mutex_destroy(&state->mutex);
+
+    MpmcQueueDestroy(&state->injectQueue);
+
+    free(state);
+
+    pool->_state = NULL;
+    pool->threadCount = 0;
+}
+
+void ThreadPoolSubmit(ConsThreadPool* pool, ConsTaskGroup* group, ConsTaskFunc func, void* userData) {
+    _ConsPoolState* state = pool->_state;
+
+    _ConsTask task;
+    task.func = func;
+    task.userData = userData;
+    task.group = group;
+
+    if (group != NULL)
+        __atomic_add_fetch(&group->_pendingCount, 1, __ATOMIC_RELAXED);
+
+    // Counted before it's visible, so a worker never sleeps on a queued task.
+    __atomic_add_fetch(&state->queuedCount, 1, __ATOMIC_SEQ_CST);
+
+    _ConsPoolWorker* worker = _GetCurrentWorker(state);
+    if (worker != NULL) {
+        pthread_mutex_lock(&worker->dequeMutex);
+        DequePushBack(&worker->deque, &task);
+        pthread_mutex_unlock(&worker->dequeMutex);
+    }
+    else if (!MpmcQueueTryPush(&state->injectQueue, &task)) {
+        // Full: the submitter does the work itself, which also slows it down.
+        __atomic_sub_fetch(&state->queuedCount, 1, __ATOMIC_SEQ_CST);
+        _RunTask(state, &task);
+        return;
+    }
+
+    if (__atomic_load_n(&state->sleepingCount, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&state->mutex);
+        pthread_cond_signal(&state->cond);
+        pthread_mutex_unlock(&state->mutex);
+    }
+}
+
+void ThreadPoolWait(ConsThreadPool* pool, ConsTaskGroup* group) {
+    _ConsPoolState* state = pool->_state;
+    _ConsPoolWorker* worker = _GetCurrentWorker(state);
+
+    while (__atomic_load_n(&group->_pendingCount, __ATOMIC_ACQUIRE) > 0) {
+        _ConsTask task;
+        if (_FindTask(state, worker, &task)) {
+            _RunTask(state, &task);
+            continue;
+        }
+
+        // Nothing to help with; the rest of the group is running on other threads.
+        pthread_mutex_lock(&state->mutex);
+
+        __atomic_add_fetch(&state->sleepingCount, 1, __ATOMIC_SEQ_CST);
+        while (
+            __atomic_load_n(&group->_pendingCount, __ATOMIC_ACQUIRE) > 0 &&
+            __atomic_load_n(&state->queuedCount, __ATOMIC_SEQ_CST) == 0
+        )
+            pthread_cond_wait(&state->cond, &state->mutex);
+        __atomic_sub_fetch(&state->sleepingCount, 1, __ATOMIC_SEQ_CST);
+
+        pthread_mutex_unlock(&state->mutex);
+    }
+}
+
+u32 ThreadPoolGetThreadIndex(ConsThreadPool* pool) {
+    _ConsPoolWorker* worker = _GetCurrentWorker(pool->_state);
+    return (worker != NULL) ? worker->index : pool->threadCount;
+}
+
+// Parallel for
+
+typedef struct _ParallelForState {
+    ConsRangeFunc func;
+    void* userData;
+
+    u64 count;
+    u64 grainSize;
+    u64 nextStart; // atomic
+} _ParallelForState;
+
+// Take chunks until there are none left; every participating thread runs this.
+static void _ParallelForTask(void* userData) {
+    _ParallelForState* forState = userData;
+
+    while (true) {
+        const u64 start = __atomic_fetch_add(&forState->nextStart, forState->grainSize, __ATOMIC_RELAXED);
+        if (start >= forState->count)
+            break;
+
+        forState->func(forState->userData, start, MIN(start + forState->grainSize, forState->count));
+    }
+}
+
+void ThreadPoolParallelFor(
+    ConsThreadPool* pool, u64 count, u64 grainSize, ConsRangeFunc func, void* userData
+) {
+    if (count == 0)
+        return;
+
+    if (pool == NULL || pool->threadCount == 0) {
+        func(userData, 0, count);
+        return;
+    }
+
+    if (grainSize == 0)
+        grainSize = MAX(count / ((u64)(pool->threadCount + 1) * POOL_CHUNKS_PER_THREAD), 1);
+
+    _ParallelForState forState;
+    forState.func = func;
+    forState.userData = userData;
+    forState.count = count;
+    forState.grainSize = grainSize;
+    forState.nextStart = 0;
+
+    // One task per helping thread; chunks are handed out dynamically, so slow chunks don't hold
+    // up the others.
+    const u64 chunkCount = (count + grainSize - 1) / grainSize;
+    const u32 helperCount = (u32)MIN((u64)pool->threadCount, chunkCount - 1);
+
+    ConsTaskGroup group;
+    TaskGroupInit(&group);
+
+    for (u32 i = 0; i < helperCount; i++)
+        ThreadPoolSubmit(pool, &group, _ParallelForTask, &forState);
+
+    _ParallelForTask(&forState);
+
+    ThreadPoolWait(pool, &group);
+}
+
+// Bounded queue
+
+typedef struct _ConsBoundedQueueSync {
+    pthread_mutex_t mutex;
+    pthread_cond_t notFull;
+    pthread_cond_t notEmpty;
+} _ConsBoundedQueueSync;
+
+void BoundedQueueInit(ConsBoundedQueue* queue, u32 elementSize, u64 capacity) {
+    if (queue == NULL)
+        return;
+
+    queue->capacity = MAX(capacity, 1);
+
+    DequeInit(&queue->_items, elementSize, queue->capacity);
+    queue->_closed = false;
+
+    queue->_sync = malloc(sizeof(_ConsBoundedQueueSync));
+    pthread_mutex_init(&queue->_sync->mutex, NULL);
+    pthread_cond_init(&queue->_sync->notFull, NULL);
+    pthread_cond_init(&queue->_sync->notEmpty, NULL);
+}
+
+bool BoundedQueuePush(ConsBoundedQueue* queue, const void* element) {
+    _ConsBoundedQueueSync* sync = queue->_sync;
+
+    pthread_mutex_lock(&sync->mutex);
+
+    while (queue->_items.elementCount >= queue->capacity && !queue->_closed)
+        pthread_cond_wait(&sync->notFull, &sync->mutex);
+
+    const bool pushed = !queue->_closed;
+    if (pushed) {
+        DequePushBack(&queue->_items, element);
+        pthread_cond_signal(&sync->notEmpty);
+    }
+
+    pthread_mutex_unlock(&sync->mutex);
+    return pushed;
+}
+
+bool BoundedQueuePop(ConsBoundedQueue* queue, void* outElement) {
+    _ConsBoundedQueueSync* sync = queue->_sync;
+
+    pthread_mutex_lock(&sync->mutex);
+
+    while (DequeIsEmpty(&queue->_items) && !queue->_closed)
+        pthread_cond_wait(&sync->notEmpty, &sync->mutex);
+
+    const bool popped = DequePopFront(&queue->_items, outElement);
+    if (popped)
+        pthread_cond_signal(&sync->notFull);
+
+    pthread_mutex_unlock(&sync->mutex);
+    return popped;
+}
+
+void BoundedQueueClose(ConsBoundedQueue* queue) {
+    _ConsBoundedQueueSync* sync = queue->_sync;
+
+    pthread_mutex_lock(&sync->mutex);
+
+    queue->_closed = true;
+    pthread_cond_broadcast(&sync->notFull);
+    pthread_cond_broadcast(&sync->notEmpty);
+
+    pthread_mutex_unlock(&sync->mutex);
+}
+
+void BoundedQueueDestroy(ConsBoundedQueue* queue) {
+    if (queue == NULL || queue->_sync == NULL)
+        return;
+
+    pthread_cond_destroy(&queue->_sync->notEmpty);
+    pthread_cond_destroy(&queue->_sync->notFull);
+    pthread_mutex_destroy(&queue->_sync->mutex);
+    free(queue->_sync);
+    queue->_sync = NULL;
+
+    DequeDestroy(&queue->_items);
+}
@@ -0,0 +1,90 @@
+#ifndef CONS_THREADPOOL_H
+#define CONS_THREADPOOL_H
+
+// CONS -- work-stealing thread pool
+
+#include "deque.h"
+
+#include "type.h"
+
+typedef void (*ConsTaskFunc)(void* userData);
+// Called with a range of indices [start, end).
+typedef void (*ConsRangeFunc)(void* userData, u64 start, u64 end);
+
+// Every worker has its own deque: tasks submitted from a worker go to the back of its deque and
+// are taken back LIFO (the data is likely still in cache), idle workers steal from the front of
+// other deques. Tasks submitted from other threads go through a shared lock-free queue.
+typedef struct ConsThreadPool {
+    u32 threadCount; // Worker threads. A thread waiting on a group runs tasks too.
+
+    struct _ConsPoolState* _state;
+} ConsThreadPool;
+
+// Tasks to wait for together. A group may be reused once waited on.
+typedef struct ConsTaskGroup {
+    u64 _pendingCount;
+} ConsTaskGroup;
+
+// Get the amount of threads to use by default: the CPUs this process may run on, limited by the
+// CPU quotas of its cgroup & the cgroups above it (containers).
+u32 ThreadPoolGetDefaultThreadCount(void);
+
+// Initialize a thread pool with threadCount workers (0 uses ThreadPoolGetDefaultThreadCount).
+void ThreadPoolInit(ConsThreadPool* pool, u32 threadCount);
+
+// Wait for all queued tasks & destroy a thread pool.
+void ThreadPoolDestroy(ConsThreadPool* pool);
+
+// Initialize an empty task group.
+static inline void TaskGroupInit(ConsTaskGroup* group) {
+    group->_pendingCount = 0;
+}
+
+// Queue a task. group may be NULL if the task doesn't need to be waited on. If the shared queue
+// is full (only for tasks submitted from outside the pool), the task runs right away instead.
+void ThreadPoolSubmit(ConsThreadPool* pool, ConsTaskGroup* group, ConsTaskFunc func, void* userData);
+
+// Wait for every task in a group (including tasks they submitted to it). The calling thread runs
+// queued tasks while it waits.
+void ThreadPoolWait(ConsThreadPool* pool, ConsTaskGroup* group);
+
+// Call func over [0, count) in chunks of grainSize indices (0 picks a size), on the pool & the
+// calling thread. Returns once every chunk is done. pool may be NULL to run on the calling
+// thread only.
+void ThreadPoolParallelFor(
+    ConsThreadPool* pool, u64 count, u64 grainSize, ConsRangeFunc func, void* userData
+);
+
+// Get the index of the current thread within the pool: 0 to threadCount-1 for workers,
+// threadCount for any other thread. Useful to index per-thread scratch (threadCount+1 slots).
+u32 ThreadPoolGetThreadIndex(ConsThreadPool* pool);
+
+// Blocking queue with a fixed capacity, to connect pipeline stages: producers wait while it's
+// full, so a fast stage can't run arbitrarily far ahead of a slow one.
+typedef struct ConsBoundedQueue {
+    u64 capacity;
+
+    ConsDeque _items;
+    bool _closed;
+
+    struct _ConsBoundedQueueSync* _sync;
+} ConsBoundedQueue;
+
+// Initialize a bounded queue.
+void BoundedQueueInit(ConsBoundedQueue* queue, u32 elementSize, u64 capacity);
+
+// Push an element, waiting while the queue is full.
+// Returns true on success, false if the queue was closed.
+bool BoundedQueuePush(ConsBoundedQueue* queue, const void* element);
+
+// Pop an element into outElement, waiting while the queue is empty.
+// Returns true on success, false once the queue is closed and empty.
+bool BoundedQueuePop(ConsBoundedQueue* queue, void* outElement);
+
+// Close a queue: pushes fail from now on, pops fail once the remaining elements are taken.
+void BoundedQueueClose(ConsBoundedQueue* queue);
+
+// Destroy a bounded queue. No thread may be waiting on it.
+void BoundedQueueDestroy(ConsBoundedQueue* queue);
+
+#endif // CONS_THREADPOOL_H
@@ -0,0 +1,124 @@
+#ifndef CONS_VEC_H
+#define CONS_VEC_H
+
+// CONS -- typed vector (header-only)
+
+#include "type.h"
+
+#include <stdlib.h> // realloc, free
+
+#include <string.h> // memcpy, memmove
+
+// Unlike ConsList, the element type is known at compile time: element access is plain indexing
+// and pushes inline to a compare & store. Capacity grows geometrically (at least doubling).
+//
+// VEC_DEFINE(Name, Prefix, Type) defines the struct Name and these functions:
+//     void  PrefixInit(Name* vec, u64 initialCapacity);
+//     void  PrefixDestroy(Name* vec);
+//     void  PrefixReserve(Name* vec, u64 capacity);      // Capacity for at least this many.
+//     void  PrefixPush(Name* vec, Type element);
+//     void  PrefixPushUnchecked(Name* vec, Type element); // Capacity must have been reserved.
+//     Type* PrefixPushEmpty(Name* vec);                   // Push an uninitialized element.
+//     void  PrefixAppend(Name* vec, const Type* elements, u64 count);
+//     Type  PrefixGet(const Name* vec, u64 index);        // Unchecked.
+//     Type* PrefixAt(Name* vec, u64 index);               // Unchecked.
+//     void  PrefixRemove(Name* vec, u64 index);           // Keeps the order of the rest.
+//     void  PrefixClear(Name* vec);                       // Keeps the capacity.
+//     Type* PrefixDetach(Name* vec, u64* outCount);       // Caller takes ownership of the data.
+//
+// Everything is static, so a vector type can be defined in any translation unit that needs it
+// (types used across files should be defined in a header).
+
+#define VEC_MIN_CAPACITY (8)
+
+#define VEC_DEFINE(Name, Prefix, Type)                                                        \
+    typedef struct Name {                                                                     \
+        Type* data;                                                                           \
+        u64 count;                                                                            \
+        u64 capacity;                                                                         \
+    } Name;                                                                                   \
+                                                                                              \
+    static inline void Prefix##Init(Name* vec, u64 initialCapacity) {                         \
+        vec->data = (initialCapacity != 0) ? malloc(sizeof(Type) * initialCapacity) : NULL;   \
+        vec->count = 0;                                                                       \
+        vec->capacity = initialCapacity;                                                      \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##Destroy(Name* vec) {                                           \
+        free(vec->data);                                                                      \
+        vec->data = NULL;                                                                     \
+        vec->count = 0;                                                                       \
+        vec->capacity = 0;                                                                    \
+    }                                                                                         \
+                                                                                              \
+    /* Out of line, so the fast paths stay small enough to inline. */                         \
+    static __attribute__((noinline, unused)) void _##Prefix##Grow(Name* vec, u64 minCapacity) { \
+        u64 newCapacity = (vec->capacity != 0) ? vec->capacity * 2 : VEC_MIN_CAPACITY;        \
+        if (newCapacity < minCapacity)                                                        \
+            newCapacity = minCapacity;                                                        \
+                                                                                              \
+        vec->data = realloc(vec->data, sizeof(Type) * newCapacity);                           \
+        vec->capacity = newCapacity;                                                          \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##Reserve(Name* vec, u64 capacity) {                             \
+        if (capacity > vec->capacity)                                                         \
+            _##Prefix##Grow(vec, capacity);                                                   \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##Push(Name* vec, Type element) {                                \
+        if (__builtin_expect(vec->count == vec->capacity, 0))                                 \
+            _##Prefix##Grow(vec, vec->count + 1);                                             \
+        vec->data[vec->count++] = element;                                                    \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##PushUnchecked(Name* vec, Type element) {                       \
+        vec->data[vec->count++] = element;                                                    \
+    }                                                                                         \
+                                                                                              \
+    static inline Type* Prefix##PushEmpty(Name* vec) {                                        \
+        if (__builtin_expect(vec->count == vec->capacity, 0))                                 \
+            _##Prefix##Grow(vec, vec->count + 1);                                             \
+        return vec->data + vec->count++;                                                      \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##Append(Name* vec, const Type* elements, u64 count) {           \
+        if (vec->count + count > vec->capacity)                                               \
+            _##Prefix##Grow(vec, vec->count + count);                                         \
+        if (count != 0)                                                                       \
+            memcpy(vec->data + vec->count, elements, sizeof(Type) * count);                   \
+        vec->count += count;                                                                  \
+    }                                                                                         \
+                                                                                              \
+    static inline Type Prefix##Get(const Name* vec, u64 index) {                              \
+        return vec->data[index];                                                              \
+    }                                                                                         \
+                                                                                              \
+    static inline Type* Prefix##At(Name* vec, u64 index) {                                    \
+        return vec->data + index;                                                             \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##Remove(Name* vec, u64 index) {                                 \
+        memmove(                                                                              \
+            vec->data + index, vec->data + index + 1,                                         \
+            sizeof(Type) * (vec->count - index - 1)                                           \
+        );                                                                                    \
+        vec->count--;                                                                         \
+    }                                                                                         \
+                                                                                              \
+    static inline void Prefix##Clear(Name* vec) {                                             \
+        vec->count = 0;                                                                       \
+    }                                                                                         \
+                                                                                              \
+    static inline Type* Prefix##Detach(Name* vec, u64* outCount) {                            \
+        Type* data = vec->data;                                                               \
+        if (outCount != NULL)                                                                 \
+            *outCount = vec->count;                                                           \
+                                                                                              \
+        vec->data = NULL;                                                                     \
+        vec->count = 0;                                                                       \
+        vec->capacity = 0;                                                                    \
+        return data;                                                                          \
+    }
+
+#endif // CONS_VEC_H
@@ -2,38 +2,69 @@
 
 #include <lua.h>
 #include <lauxlib.h>
-#include <lualib.h>
 
 #include "../cons/error.h"
 
+#include <string.h>
+
 _Static_assert(LUA_VERSION_NUM == 502, "Lua v5.2 is required");
 
-ConsBuffer LuacCompile(const char* luaSource) {
-    lua_State* L = luaL_newstate();
-    luaL_openlibs(L);
+void LuacCompilerInit(LuacCompiler* compiler) {
+    compiler->_state = luaL_newstate();
+    if (compiler->_state == NULL)
+        Panic("LuacCompilerInit: failed to create Lua state");
+}
+
+// lua_dump's writer: the bytecode goes into the builder piece by piece.
+static int _WriteBytecode(lua_State* L, const void* data, size_t size, void* userData) {
+    (void)L;
+
+    BufferBuilderAppend(userData, data, size);
+    return 0;
+}
+
+bool LuacCompilerRun(
+    LuacCompiler* compiler, const char* source, u64 sourceSize, const char* chunkName,
+    ConsBufferBuilder* outBytecode
+) {
+    lua_State* L = compiler->_state;
 
-    if (luaL_loadstring(L, luaSource) != LUA_OK)
-        Panic("LuacCompile: failed to load script: %s", lua_tostring(L, -1));
+    if (luaL_loadbuffer(L, source, sourceSize, chunkName) != LUA_OK) {
+        Warn("LuacCompilerRun: failed to load script: %s", lua_tostring(L, -1));
+        lua_settop(L, 0);
+        return false;
+    }
 
-    // get string.dump function
-    lua_getglobal(L, "string");
-    lua_getfield(L, -1, "dump");
-    lua_remove(L, -2); // Remove the "string" table
+    const bool dumped = lua_dump(L, _WriteBytecode, outBytecode) == 0;
 
-    // swap the compiled chunk and the dump function
-    lua_insert(L, -2); // put compiled chunk below dump
+    // The chunk is left to the garbage collector.
+    lua_settop(L, 0);
+
+    if (!dumped)
+        Warn("LuacCompilerRun: failed to dump bytecode");
+    return dumped;
+}
+
+void LuacCompilerDestroy(LuacCompiler* compiler) {
+    if (compiler->_state != NULL)
+        lua_close(compiler->_state);
+    compiler->_state = NULL;
+}
+
+ConsBuffer LuacCompile(const char* luaSource) {
+    LuacCompiler compiler;
+    LuacCompilerInit(&compiler);
 
-    // call string.dump(compiled_chunk)
-    if (lua_pcall(L, 1, 1, 0) != LUA_OK)
-        Panic("LuacCompile: failed to dump bytecode: %s", lua_tostring(L, -1));
+    const u64 sourceSize = strlen(luaSource);
 
-    size_t bytecodeSize;
-    const void* bytecode = lua_tolstring(L, -1, &bytecodeSize);
+    ConsBufferBuilder builder;
+    BufferBuilderInit(&builder, sourceSize);
 
-    ConsBuffer buffer;
-    BufferInitCopy(&buffer, bytecode, bytecodeSize);
+    // Named by the source itself, like luaL_loadstring does.
+    if (!LuacCompilerRun(&compiler, luaSource, sourceSize, luaSource, &builder))
+        Panic("LuacCompile: failed to compile script");
 
-    lua_close(L);
+    LuacCompilerDestroy(&compiler);
 
-    return buffer;
+    return BufferBuilderFinish(&builder);
 }
@@ -3,6 +3,29 @@
 
 #include "../cons/buffer.h"
 
+#include "../cons/type.h"
+
+// Compiles scripts one after another on one Lua state. No libraries are opened (nothing is
+// run), and the bytecode is dumped straight into the caller's builder. A compiler may only be
+// used by one thread at a time; use one per thread to compile in parallel.
+typedef struct LuacCompiler {
+    struct lua_State* _state;
+} LuacCompiler;
+
+// Initialize a compiler.
+void LuacCompilerInit(LuacCompiler* compiler);
+
+// Compile sourceSize bytes of Lua source & append the bytecode (as written by string.dump) to
+// outBytecode. chunkName is the source name recorded in the bytecode & used in error messages.
+// Returns true on success, false on failure (the error is printed as a warning).
+bool LuacCompilerRun(
+    LuacCompiler* compiler, const char* source, u64 sourceSize, const char* chunkName,
+    ConsBufferBuilder* outBytecode
+);
+
+// Destroy a compiler.
+void LuacCompilerDestroy(LuacCompiler* compiler);
+
 ConsBuffer LuacCompile(const char* luaSource);
 
 #endif // LUAC_INTERFACE_H
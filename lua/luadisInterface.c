@@ -0,0 +1,380 @@
+#include "luadisInterface.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+// Internals: lua_load only hands out a closure, the listing needs its prototype.
+#include <lobject.h>
+#include <lopcodes.h>
+#include <lstate.h>
+#include <lfunc.h>
+
+#include "../cons/error.h"
+
+#include <stdarg.h>
+
+#include <stdio.h>
+
+#include <stdlib.h>
+
+_Static_assert(LUA_VERSION_NUM == 502, "Lua v5.2 is required");
+
+typedef struct _LuadisReaderState {
+    ConsBufferView bytecode;
+    bool done;
+} _LuadisReaderState;
+
+// The whole chunk is handed to the undumper at once; nothing is copied.
+static const char* _ReadBytecode(lua_State* L, void* userData, size_t* outSize) {
+    (void)L;
+
+    _LuadisReaderState* state = userData;
+    if (state->done) {
+        *outSize = 0;
+        return NULL;
+    }
+
+    state->done = true;
+
+    *outSize = state->bytecode.size;
+    return state->bytecode.data_char;
+}
+
+static void _Print(ConsBufferBuilder* out, const char* format, ...) {
+    char text[256];
+
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    if (length < 0)
+        return;
+    if ((size_t)length < sizeof(text)) {
+        BufferBuilderAppend(out, text, length);
+        return;
+    }
+
+    char* longText = malloc(length + 1);
+
+    va_start(args, format);
+    vsnprintf(longText, length + 1, format, args);
+    va_end(args);
+
+    BufferBuilderAppend(out, longText, length);
+    free(longText);
+}
+
+static void _PrintString(ConsBufferBuilder* out, const TString* string) {
+    const char* data = getstr(string);
+    const size_t length = string->tsv.len;
+
+    BufferBuilderAppend(out, "\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        const unsigned char c = (unsigned char)data[i];
+        switch (c) {
+        case '"':  BufferBuilderAppend(out, "\\\"", 2); break;
+        case '\\': BufferBuilderAppend(out, "\\\\", 2); break;
+        case '\a': BufferBuilderAppend(out, "\\a", 2); break;
+        case '\b': BufferBuilderAppend(out, "\\b", 2); break;
+        case '\f': BufferBuilderAppend(out, "\\f", 2); break;
+        case '\n': BufferBuilderAppend(out, "\\n", 2); break;
+        case '\r': BufferBuilderAppend(out, "\\r", 2); break;
+        case '\t': BufferBuilderAppend(out, "\\t", 2); break;
+        case '\v': BufferBuilderAppend(out, "\\v", 2); break;
+        default:
+            if (c >= 0x20 && c < 0x7F)
+                BufferBuilderAppend(out, &c, 1);
+            else
+                _Print(out, "\\%03u", (unsigned)c);
+            break;
+        }
+    }
+    BufferBuilderAppend(out, "\"", 1);
+}
+
+static void _PrintConstant(ConsBufferBuilder* out, const Proto* f, int index) {
+    if (index < 0 || index >= f->sizek) {
+        _Print(out, "<bad constant %d>", index);
+        return;
+    }
+
+    const TValue* constant = f->k + index;
+    switch (ttypenv(constant)) {
+    case LUA_TNIL:
+        _Print(out, "nil");
+        break;
+    case LUA_TBOOLEAN:
+        _Print(out, bvalue(constant) ? "true" : "false");
+        break;
+    case LUA_TNUMBER:
+        _Print(out, LUA_NUMBER_FMT, nvalue(constant));
+        break;
+    case LUA_TSTRING:
+        _PrintString(out, rawtsvalue(constant));
+        break;
+    default: // Can't be in a dumped chunk.
+        _Print(out, "<type %d>", ttype(constant));
+        break;
+    }
+}
+
+static const char* _GetUpvalueName(const Proto* f, int index) {
+    if (index < 0 || index >= f->sizeupvalues || f->upvalues[index].name == NULL)
+        return "-";
+    return getstr(f->upvalues[index].name);
+}
+
+static int _GetLine(const Proto* f, int pc) {
+    return (pc < f->sizelineinfo) ? f->lineinfo[pc] : 0;
+}
+
+// Get the destination pc of a jump instruction, or -1 for other instructions.
+static int _GetJumpTarget(const Proto* f, int pc) {
+    const Instruction i = f->code[pc];
+    switch (GET_OPCODE(i)) {
+    case OP_JMP:
+    case OP_FORLOOP:
+    case OP_FORPREP:
+    case OP_TFORLOOP:
+        return pc + 1 + GETARG_sBx(i);
+    default:
+        return -1;
+    }
+}
+
+static void _PrintCode(ConsBufferBuilder* out, const Proto* f, const char* functionId) {
+    // Mark jump destinations so the control flow can be followed without counting.
+    bool* isJumpTarget = calloc(f->sizecode + 1, sizeof(bool));
+    for (int pc = 0; pc < f->sizecode; pc++) {
+        const int target = _GetJumpTarget(f, pc);
+        if (target >= 0 && target <= f->sizecode)
+            isJumpTarget[target] = true;
+    }
+
+    for (int pc = 0; pc < f->sizecode; pc++) {
+        const Instruction i = f->code[pc];
+        const OpCode o = GET_OPCODE(i);
+
+        const int a = GETARG_A(i);
+        const int b = GETARG_B(i);
+        const int c = GETARG_C(i);
+        const int ax = GETARG_Ax(i);
+        const int bx = GETARG_Bx(i);
+        const int sbx = GETARG_sBx(i);
+
+        if (o >= NUM_OPCODES) {
+            _Print(
+                out, "  %c%5d  %-7s <bad opcode %d>\n",
+                isJumpTarget[pc] ? '>' : ' ', pc + 1, "[-]", (int)o
+            );
+            continue;
+        }
+
+        char line[16] = "[-]";
+        if (_GetLine(f, pc) > 0)
+            snprintf(line, sizeof(line), "[%d]", _GetLine(f, pc));
+
+        _Print(
+            out, "  %c%5d  %-7s %-9s ",
+            isJumpTarget[pc] ? '>' : ' ', pc + 1, line, luaP_opnames[o]
+        );
+
+        // Operands as luac -l shows them: constants are negative (-1 is the first).
+        switch (getOpMode(o)) {
+        case iABC:
+            _Print(out, "%d", a);
+            if (getBMode(o) != OpArgN)
+                _Print(out, " %d", ISK(b) ? (-1 - INDEXK(b)) : b);
+            if (getCMode(o) != OpArgN)
+                _Print(out, " %d", ISK(c) ? (-1 - INDEXK(c)) : c);
+            break;
+        case iABx:
+            _Print(out, "%d", a);
+            if (getBMode(o) == OpArgK)
+                _Print(out, " %d", -1 - bx);
+            if (getBMode(o) == OpArgU)
+                _Print(out, " %d", bx);
+            break;
+        case iAsBx:
+            _Print(out, "%d %d", a, sbx);
+            break;
+        case iAx:
+            _Print(out, "%d", -1 - ax);
+            break;
+        }
+
+        switch (o) {
+        case OP_LOADK:
+            _Print(out, "\t; ");
+            _PrintConstant(out, f, bx);
+            break;
+        case OP_GETUPVAL:
+        case OP_SETUPVAL:
+            _Print(out, "\t; %s", _GetUpvalueName(f, b));
+            break;
+        case OP_GETTABUP:
+            _Print(out, "\t; %s", _GetUpvalueName(f, b));
+            if (ISK(c)) {
+                _Print(out, " ");
+                _PrintConstant(out, f, INDEXK(c));
+            }
+            break;
+        case OP_SETTABUP:
+            _Print(out, "\t; %s", _GetUpvalueName(f, a));
+            if (ISK(b)) {
+                _Print(out, " ");
+                _PrintConstant(out, f, INDEXK(b));
+            }
+            if (ISK(c)) {
+                _Print(out, " ");
+                _PrintConstant(out, f, INDEXK(c));
+            }
+            break;
+        case OP_GETTABLE:
+        case OP_SELF:
+            if (ISK(c)) {
+                _Print(out, "\t; ");
+                _PrintConstant(out, f, INDEXK(c));
+            }
+            break;
+        case OP_SETTABLE:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_POW:
+        case OP_EQ:
+        case OP_LT:
+        case OP_LE:
+            if (ISK(b) || ISK(c)) {
+                _Print(out, "\t; ");
+                if (ISK(b))
+                    _PrintConstant(out, f, INDEXK(b));
+                else
+                    _Print(out, "-");
+                _Print(out, " ");
+                if (ISK(c))
+                    _PrintConstant(out, f, INDEXK(c));
+                else
+                    _Print(out, "-");
+            }
+            break;
+        case OP_JMP:
+        case OP_FORLOOP:
+        case OP_FORPREP:
+        case OP_TFORLOOP:
+            _Print(out, "\t; to %d", _GetJumpTarget(f, pc) + 1);
+            break;
+        case OP_CLOSURE:
+            _Print(out, "\t; function %s.%d", functionId, bx);
+            break;
+        case OP_SETLIST:
+            // With C = 0 the real block number is in the EXTRAARG after it (listed on its own).
+            if (c == 0 && pc + 1 < f->sizecode)
+                _Print(out, "\t; %d", GETARG_Ax(f->code[pc + 1]));
+            else
+                _Print(out, "\t; %d", c);
+            break;
+        case OP_EXTRAARG:
+            // Only a constant index after LOADKX; after SETLIST it's the block number.
+            if (pc > 0 && GET_OPCODE(f->code[pc - 1]) == OP_LOADKX) {
+                _Print(out, "\t; ");
+                _PrintConstant(out, f, ax);
+            }
+            break;
+        default:
+            break;
+        }
+
+        _Print(out, "\n");
+    }
+
+    free(isJumpTarget);
+}
+
+static void _PrintFunction(ConsBufferBuilder* out, const Proto* f, const char* functionId) {
+    // Shortened like in error messages (chunks loaded from a string are named by their source).
+    char source[LUA_IDSIZE];
+    luaO_chunkid(source, (f->source != NULL) ? getstr(f->source) : "=?", LUA_IDSIZE);
+
+    _Print(
+        out, "function %s <%s:%d,%d> (%d instructions)\n",
+        functionId, source, f->linedefined, f->lastlinedefined, f->sizecode
+    );
+    _Print(
+        out, "%d%s params, %d slots, %d upvalues, %d locals, %d constants, %d functions\n",
+        (int)f->numparams, f->is_vararg ? "+" : "", (int)f->maxstacksize, f->sizeupvalues,
+        f->sizelocvars, f->sizek, f->sizep
+    );
+
+    if (f->sizek != 0) {
+        _Print(out, "constants (%d):\n", f->sizek);
+        for (int i = 0; i < f->sizek; i++) {
+            _Print(out, "  %5d  ", -1 - i);
+            _PrintConstant(out, f, i);
+            _Print(out, "\n");
+        }
+    }
+
+    if (f->sizelocvars != 0) {
+        _Print(out, "locals (%d):\n", f->sizelocvars);
+        for (int i = 0; i < f->sizelocvars; i++) {
+            const LocVar* local = f->locvars + i;
+            _Print(
+                out, "  %5d  %-16s pc %d to %d\n", i,
+                (local->varname != NULL) ? getstr(local->varname) : "-",
+                local->startpc + 1, local->endpc + 1
+            );
+        }
+    }
+
+    if (f->sizeupvalues != 0) {
+        _Print(out, "upvalues (%d):\n", f->sizeupvalues);
+        for (int i = 0; i < f->sizeupvalues; i++) {
+            const Upvaldesc* upvalue = f->upvalues + i;
+            _Print(
+                out, "  %5d  %-16s %s %d\n", i, _GetUpvalueName(f, i),
+                upvalue->instack ? "local" : "upvalue", (int)upvalue->idx
+            );
+        }
+    }
+
+    _Print(out, "code:\n");
+    _PrintCode(out, f, functionId);
+
+    for (int i = 0; i < f->sizep; i++) {
+        char childId[256];
+        snprintf(childId, sizeof(childId), "%s.%d", functionId, i);
+
+        _Print(out, "\n");
+        _PrintFunction(out, f->p[i], childId);
+    }
+}
+
+ConsBuffer LuadisRun(ConsBufferView bytecode) {
+    // No libraries are opened: nothing in the chunk is run.
+    lua_State* L = luaL_newstate();
+    if (L == NULL)
+        Panic("LuadisRun: failed to create Lua state");
+
+    _LuadisReaderState readerState = { .bytecode = bytecode, .done = false };
+
+    if (lua_load(L, _ReadBytecode, &readerState, "=bytecode", "b") != LUA_OK) {
+        Warn("LuadisRun: failed to load bytecode: %s", lua_tostring(L, -1));
+        lua_close(L);
+        return (ConsBuffer){ 0 };
+    }
+
+    const Proto* mainProto = clLvalue(L->top - 1)->p;
+
+    ConsBufferBuilder out;
+    BufferBuilderInit(&out, bytecode.size * 8);
+
+    _PrintFunction(&out, mainProto, "main");
+
+    lua_close(L);
+
+    return BufferBuilderFinish(&out);
+}
@@ -0,0 +1,13 @@
+#ifndef LUADIS_INTERFACE_H
+#define LUADIS_INTERFACE_H
+
+#include "../cons/buffer.h"
+
+// Disassemble Lua 5.2 bytecode (as written by string.dump) in-process. The listing covers every
+// function in the chunk: its constants, locals & upvalues, then the instructions annotated with
+// the constants, upvalue names and jump targets they refer to.
+// Returns the listing as text (not null-terminated), or an invalid buffer if the bytecode could
+// not be loaded.
+ConsBuffer LuadisRun(ConsBufferView bytecode);
+
+#endif // LUADIS_INTERFACE_H
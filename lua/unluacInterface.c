@@ -1,6 +1,10 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pipe2
+#endif
+
 #include "unluacInterface.h"
 
-#include "../cons/list.h"
+#include "../cons/vec.h"
 
 #include "../cons/error.h"
 
@@ -10,11 +14,28 @@
 
 #include <string.h>
 
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#define UNLUAC_JAR_PATH "unluac.jar"
+#define UNLUAC_DRIVER_PATH "UnluacDriver.java"
+
+VEC_DEFINE(_UnluacOutput, CharVec, char)
+
 char* UnluacRun(const char* luacPath) {
     char command[1024];
     FILE* fp;
 
-    snprintf(command, sizeof(command), "java -jar unluac.jar \"%s\" 2>&1", luacPath);
+    snprintf(command, sizeof(command), "java -jar " UNLUAC_JAR_PATH " \"%s\" 2>&1", luacPath);
     fp = popen(command, "r");
 
     if (fp == NULL) {
@@ -22,23 +43,214 @@ char* UnluacRun(const char* luacPath) {
         return NULL;
     }
 
-    ConsList outputList;
-    ListInit(&outputList, sizeof(char), 1024);
+    _UnluacOutput output;
+    CharVecInit(&output, 4096);
 
-    char buffer[1024];
-    while (fgets(buffer, sizeof(buffer), fp)) {
-        for (u64 i = 0; buffer[i] != '\0'; ++i)
-            ListAdd(&outputList, &buffer[i]);
-    }
+    char buffer[4096];
+    size_t readSize;
+    while ((readSize = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        CharVecAppend(&output, buffer, readSize);
 
     pclose(fp);
 
-    // Add null terminator.
-    buffer[0] = '\0';
-    ListAdd(&outputList, buffer + 0);
+    // Add null terminator; the data is handed over as the result string.
+    CharVecPush(&output, '\0');
+
+    return CharVecDetach(&output, NULL);
+}
+
+#ifdef _WIN32
+
+bool UnluacWorkerStart(UnluacWorker* worker) {
+    worker->_process = NULL;
+
+    Warn("UnluacWorkerStart: not supported on Windows (use lua_decomp --unluac per file)");
+    return false;
+}
+
+bool UnluacWorkerRun(UnluacWorker* worker, ConsBufferView bytecode, ConsBuffer* outSource) {
+    (void)worker;
+    (void)bytecode;
+    (void)outSource;
+    return false;
+}
 
-    char* outputString = strdup((char*)outputList.data);
-    ListDestroy(&outputList);
+void UnluacWorkerStop(UnluacWorker* worker) {
+    (void)worker;
+}
+
+#else // _WIN32
+
+typedef struct _UnluacProcess {
+    pid_t pid;
+    int requestFd; // Driver's stdin.
+    int responseFd; // Driver's stdout.
+} _UnluacProcess;
+
+static bool _WriteAll(int fd, const void* data, u64 size) {
+    const u8* src = data;
+    while (size > 0) {
+        const ssize_t written = write(fd, src, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        src += written;
+        size -= (u64)written;
+    }
+    return true;
+}
+
+static bool _ReadAll(int fd, void* data, u64 size) {
+    u8* dst = data;
+    while (size > 0) {
+        const ssize_t readSize = read(fd, dst, size);
+        if (readSize < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (readSize == 0) // The driver exited.
+            return false;
+
+        dst += readSize;
+        size -= (u64)readSize;
+    }
+    return true;
+}
+
+// Close-on-exec, so drivers started from other threads don't hold on to these pipes (the driver
+// would never see its stdin close). dup2 clears the flag on the driver's ends.
+static bool _OpenPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    // No pipe2; a driver started in between may still inherit the pipe, which only delays when
+    // that driver sees EOF.
+    if (pipe(fds) != 0)
+        return false;
+
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+static void _WriteU32(u8* dst, u32 value) {
+    dst[0] = (u8)value;
+    dst[1] = (u8)(value >> 8);
+    dst[2] = (u8)(value >> 16);
+    dst[3] = (u8)(value >> 24);
+}
 
-    return outputString;
+static u32 _ReadU32(const u8* src) {
+    return (u32)src[0] | ((u32)src[1] << 8) | ((u32)src[2] << 16) | ((u32)src[3] << 24);
 }
+
+bool UnluacWorkerStart(UnluacWorker* worker) {
+    worker->_process = NULL;
+
+    int requestPipe[2];
+    int responsePipe[2];
+    if (!_OpenPipe(requestPipe))
+        return false;
+    if (!_OpenPipe(responsePipe)) {
+        close(requestPipe[0]);
+        close(requestPipe[1]);
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, requestPipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, responsePipe[1], STDOUT_FILENO);
+
+    char* const args[] = {
+        "java", "-cp", UNLUAC_JAR_PATH, UNLUAC_DRIVER_PATH, NULL
+    };
+
+    pid_t pid;
+    const int spawnResult = posix_spawnp(&pid, "java", &actions, NULL, args, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(requestPipe[0]);
+    close(responsePipe[1]);
+
+    if (spawnResult != 0) {
+        close(requestPipe[1]);
+        close(responsePipe[0]);
+        return false;
+    }
+
+    _UnluacProcess* process = malloc(sizeof(_UnluacProcess));
+    process->pid = pid;
+    process->requestFd = requestPipe[1];
+    process->responseFd = responsePipe[0];
+
+    worker->_process = process;
+    return true;
+}
+
+bool UnluacWorkerRun(UnluacWorker* worker, ConsBufferView bytecode, ConsBuffer* outSource) {
+    _UnluacProcess* process = worker->_process;
+    if (process == NULL || bytecode.size > 0xFFFFFFFFull)
+        return false;
+
+    u8 requestHeader[4];
+    _WriteU32(requestHeader, (u32)bytecode.size);
+
+    u8 responseHeader[5];
+    if (
+        !_WriteAll(process->requestFd, requestHeader, sizeof(requestHeader)) ||
+        !_WriteAll(process->requestFd, bytecode.data_void, bytecode.size) ||
+        !_ReadAll(process->responseFd, responseHeader, sizeof(responseHeader))
+    ) {
+        Warn("UnluacWorkerRun: the unluac driver exited");
+        UnluacWorkerStop(worker);
+        return false;
+    }
+
+    const u8 status = responseHeader[0];
+    const u32 responseSize = _ReadU32(responseHeader + 1);
+
+    ConsBuffer response = { 0 };
+    if (responseSize != 0) {
+        BufferInitUninit(&response, responseSize);
+        if (!_ReadAll(process->responseFd, response.data_void, responseSize)) {
+            Warn("UnluacWorkerRun: the unluac driver exited");
+            BufferDestroy(&response);
+            UnluacWorkerStop(worker);
+            return false;
+        }
+    }
+
+    if (status != 0) {
+        Warn("UnluacWorkerRun: unluac failed: %.*s", (int)response.size, response.data_char);
+        BufferDestroy(&response);
+        return false;
+    }
+
+    *outSource = response;
+    return true;
+}
+
+void UnluacWorkerStop(UnluacWorker* worker) {
+    _UnluacProcess* process = worker->_process;
+    if (process == NULL)
+        return;
+
+    // The driver exits once its stdin is closed.
+    close(process->requestFd);
+    close(process->responseFd);
+
+    while (waitpid(process->pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+
+    free(process);
+    worker->_process = NULL;
+}
+
+#endif // _WIN32
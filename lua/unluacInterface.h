@@ -1,6 +1,36 @@
 #ifndef UNLUAC_INTERFACE_H
 #define UNLUAC_INTERFACE_H
 
+#include "../cons/buffer.h"
+
+#include "../cons/type.h"
+
 char* UnluacRun(const char* luacPath);
 
+// Long-lived unluac process (UnluacDriver.java on unluac.jar, both in the working directory):
+// the JVM starts once, then scripts are streamed through its stdin & stdout. Requests are the
+// bytecode size (u32, little-endian) followed by the bytecode; responses are a status byte (0 if
+// decompiled), the size (u32, little-endian) & the source or error message.
+// A worker may only be used by one thread at a time; run several to decompile in parallel.
+// SIGPIPE should be ignored by the caller, or a driver that died kills the process on the next
+// request write (instead of the request failing).
+typedef struct UnluacWorker {
+    struct _UnluacProcess* _process; // NULL if not running.
+} UnluacWorker;
+
+// Start a worker process.
+// Returns true on success, false on failure (e.g. Java couldn't be run).
+bool UnluacWorkerStart(UnluacWorker* worker);
+
+static inline bool UnluacWorkerIsRunning(const UnluacWorker* worker) {
+    return worker->_process != NULL;
+}
+
+// Decompile bytecode (as written by string.dump) into outSource.
+// Returns true on success, false on failure. If the worker process died, it's stopped.
+bool UnluacWorkerRun(UnluacWorker* worker, ConsBufferView bytecode, ConsBuffer* outSource);
+
+// Stop a worker process. It's safe to pass in a worker that isn't running.
+void UnluacWorkerStop(UnluacWorker* worker);
+
 #endif // UNLUAC_INTERFACE_H
@@ -3,12 +3,21 @@
 
 #include <string.h>
 
+#include <pthread.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
 #include "cons/cons.h"
 
 #include "process/beaProcess.h"
+#include "process/beaIndex.h"
 #include "process/luaProcess.h"
 #include "process/bntxProcess.h"
 
+#include "lua/luacInterface.h"
+#include "lua/luadisInterface.h"
 #include "lua/unluacInterface.h"
 
 #include "stb/stb_image_write.h"
@@ -27,41 +36,323 @@ void usage(char* arg0) {
         "modes:\n"
         "     bea_unpack       Extract all assets from a BEA archive.\n"
         "     bea_pack         Pack the input directory into a BEA archive.\n"
+        "     bea_list         List all assets in a BEA archive. The output file is optional;\n"
+        "                      if given, it's used as a sidecar index (created if stale).\n"
         "\n"
         "     lua_decomp       Decompile a binary lua file.\n"
+        "     lua_decomp_dir   Decompile every lua binary in the input directory into the output\n"
+        "                      directory.\n"
         "     lua_comp         Compile a lua file.\n"
+        "     lua_comp_dir     Compile every lua file in the input directory into the output\n"
+        "                      directory.\n"
+        "\n"
+        "     bntx_extract     Extract all textures from a BNTX texture group.\n"
         "\n"
-        "     bntx_extract     Extract all textures from a BNTX texture group.\n",
+        "options (given as --name=value, anywhere after the mode):\n"
+        "     --jobs=N         Number of threads to use (bea_pack, bea_unpack, bntx_extract,\n"
+        "                      lua_decomp_dir, lua_comp_dir).\n"
+        "                      Defaults to one per CPU available (within the cgroup's quota).\n"
+        "     --compression=X  Compression for every asset (bea_pack): auto, none, zlib or zstd.\n"
+        "                      Defaults to zstd. auto picks per asset, and stores\n"
+        "                      incompressible assets as-is.\n"
+        "     --min-savings=F  (auto) Fraction of the size compression must save. Default 0.05.\n"
+        "     --zlib-advantage=F\n"
+        "                      (auto) How much smaller zlib's output must be than zstd's for zlib\n"
+        "                      to be picked. Default 0.10; 1 never tries zlib.\n"
+        "     --order=FILE     Lay the asset data out in the order of an access trace (bea_pack):\n"
+        "                      a text file with one asset name per line, in load order.\n"
+        "     --listing        Write a luac -l style disassembly instead of decompiling\n"
+        "                      (lua_decomp, lua_decomp_dir). Decompiling needs Java & unluac.jar\n"
+        "                      in the working directory (lua_decomp_dir runs UnluacDriver.java\n"
+        "                      next to it, needing Java 11+); the listing doesn't.\n"
+        "     --incremental    Skip scripts whose output already exists & was compiled from the\n"
+        "                      same source, going by the source hash in it (lua_comp,\n"
+        "                      lua_comp_dir).\n",
         arg0
     );
 }
 
+#define MAX_OPTION_COUNT (32)
+
+// Get the value of an option (--name=value), or NULL if it wasn't given. An option given
+// without a value has an empty value.
+const char* getOption(char** options, int optionCount, const char* name) {
+    const size_t nameLen = strlen(name);
+    for (int i = 0; i < optionCount; i++) {
+        if (strncmp(options[i], name, nameLen) != 0)
+            continue;
+
+        if (options[i][nameLen] == '=')
+            return options[i] + nameLen + 1;
+        if (options[i][nameLen] == '\0')
+            return options[i] + nameLen;
+    }
+    return NULL;
+}
+
+// Get the value of an option as a fraction (0..1), or the default if it wasn't given.
+float getFractionOption(char** options, int optionCount, const char* name, float defaultValue) {
+    const char* option = getOption(options, optionCount, name);
+    if (option == NULL)
+        return defaultValue;
+
+    char* optionEnd;
+    const float value = strtof(option, &optionEnd);
+    if (*option == '\0' || *optionEnd != '\0' || value < 0.f)
+        Panic("Invalid value '%s' for option '%s'", option, name);
+
+    return value;
+}
+
+// Get the --jobs option, or 0 (one per CPU) if it wasn't given.
+u32 getJobCountOption(char** options, int optionCount) {
+    const char* option = getOption(options, optionCount, "jobs");
+    if (option == NULL)
+        return 0;
+
+    char* optionEnd;
+    const u32 jobCount = (u32)strtoul(option, &optionEnd, 10);
+    if (*option == '\0' || *optionEnd != '\0')
+        Panic("Invalid job count '%s'", option);
+
+    return jobCount;
+}
+
+// Decode textures [start, end) of a BNTX & write them out as PNGs.
+void extractTextures(void* userData, u64 start, u64 end) {
+    ConsBufferView bntxView = *(ConsBufferView*)userData;
+
+    for (u32 i = (u32)start; i < (u32)end; i++) {
+        ConsBuffer decoded = BntxDecodeTexture(bntxView, i);
+        if (!BufferIsValid(&decoded))
+            continue;
+
+        char nameBuf[512];
+        snprintf(nameBuf, sizeof(nameBuf), "%s.png", BntxGetTextureName(bntxView, i)->str);
+        int res = stbi_write_png(
+            nameBuf,
+            BntxGetTextureWidth(bntxView, i), BntxGetTextureHeight(bntxView, i),
+            4, decoded.data_void, BntxGetTextureWidth(bntxView, i) * 4
+        );
+        if (res == 0)
+            Warn("Failed to write texture to path '%s' ..", nameBuf);
+
+        BufferDestroy(&decoded);
+    }
+}
+
+// Shared by the tasks of lua_decomp_dir.
+typedef struct DecompileScriptsContext {
+    const char** inputPaths;
+    u64 rootPathLen; // Input paths are the root path, '/' & the relative path.
+    const char* outputDir;
+
+    ConsThreadPool* threadPool;
+    // One per pool thread (threadCount + 1, started when first used); NULL to disassemble
+    // in-process instead.
+    UnluacWorker* workers;
+
+    ConsBulkWriter* writer;
+    pthread_mutex_t writerMutex; // The writer is only used by one thread at a time.
+
+    u64 failedCount;
+    u64 skippedCount; // Not Lua binaries.
+} DecompileScriptsContext;
+
+// Decompile scripts [start, end) of lua_decomp_dir & queue them to be written.
+void decompileScripts(void* userData, u64 start, u64 end) {
+    DecompileScriptsContext* context = userData;
+
+    UnluacWorker* worker = (context->workers != NULL) ?
+        context->workers + ThreadPoolGetThreadIndex(context->threadPool) : NULL;
+
+    for (u64 i = start; i < end; i++) {
+        const char* inputPath = context->inputPaths[i];
+
+        ConsBuffer fileData = FileLoadMem(inputPath);
+        ConsBufferView fileView = BUFFER_TO_VIEW(fileData);
+        if (!BufferIsValid(&fileData) || !LuaIsValid(fileView)) {
+            Warn("Skipping '%s' (not a Lua binary) ..", inputPath);
+            BufferDestroy(&fileData);
+            __atomic_add_fetch(&context->skippedCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        LuaPreprocess(fileView);
+
+        ConsBuffer output = { 0 };
+        bool decompiled;
+        if (worker != NULL) {
+            // Started on first use, and again if a previous script took the driver down.
+            if (!UnluacWorkerIsRunning(worker) && !UnluacWorkerStart(worker))
+                Panic("Failed to start unluac (is Java installed?) ..");
+            decompiled = UnluacWorkerRun(worker, LuaGetBytecode(fileView), &output);
+        }
+        else {
+            output = LuadisRun(LuaGetBytecode(fileView));
+            decompiled = BufferIsValid(&output);
+        }
+
+        BufferDestroy(&fileData);
+
+        if (!decompiled) {
+            Warn("Failed to decompile '%s' ..", inputPath);
+            __atomic_add_fetch(&context->failedCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        char outputPath[1024];
+        snprintf(
+            outputPath, sizeof(outputPath), "%s/%s",
+            context->outputDir, inputPath + context->rootPathLen + 1
+        );
+
+        pthread_mutex_lock(&context->writerMutex);
+        BulkWriterAdd(context->writer, outputPath, output);
+        pthread_mutex_unlock(&context->writerMutex);
+    }
+}
+
+// Shared by the tasks of lua_comp_dir.
+typedef struct CompileScriptsContext {
+    const char** inputPaths;
+    u64 rootPathLen; // Input paths are the root path, '/' & the relative path.
+    const char* outputDir;
+
+    ConsThreadPool* threadPool;
+    LuacCompiler* compilers; // One per pool thread (threadCount + 1).
+
+    ConsBulkWriter* writer;
+    pthread_mutex_t writerMutex; // The writer is only used by one thread at a time.
+
+    bool incremental; // Skip scripts whose output was built from the same source.
+
+    u64 failedCount;
+    u64 upToDateCount;
+} CompileScriptsContext;
+
+// Compile scripts [start, end) of lua_comp_dir & queue them to be written.
+void compileScripts(void* userData, u64 start, u64 end) {
+    CompileScriptsContext* context = userData;
+
+    LuacCompiler* compiler = context->compilers + ThreadPoolGetThreadIndex(context->threadPool);
+
+    for (u64 i = start; i < end; i++) {
+        const char* inputPath = context->inputPaths[i];
+
+        // Read with room for the null terminator, instead of appending it after.
+        ConsFile file;
+        ConsBuffer source = { 0 };
+        u64 sourceSize = 0;
+        bool loaded = FileOpenRead(&file, inputPath);
+        if (loaded) {
+            sourceSize = file.size;
+
+            BufferInitPooled(&source, sourceSize + 1);
+            loaded = FileReadAt(&file, source.data_void, 0, sourceSize);
+            source.data_char[sourceSize] = '\0';
+
+            FileClose(&file);
+        }
+
+        if (!loaded) {
+            Warn("Failed to load '%s' ..", inputPath);
+            BufferDestroy(&source);
+            __atomic_add_fetch(&context->failedCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        char outputPath[1024];
+        snprintf(
+            outputPath, sizeof(outputPath), "%s/%s",
+            context->outputDir, inputPath + context->rootPathLen + 1
+        );
+
+        // The hash is needed for the header anyways; hashing is much cheaper than compiling.
+        u8 sourceHash[LUA_SOURCE_HASH_SIZE];
+        LuaHashSource(source.data_char, sourceSize, sourceHash);
+
+        if (context->incremental && LuaFileMatchesSource(outputPath, sourceHash)) {
+            BufferReleasePooled(&source);
+            __atomic_add_fetch(&context->upToDateCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        ConsBuffer output = LuaBuildWithCompiler(compiler, source.data_char, sourceSize, sourceHash);
+
+        BufferReleasePooled(&source);
+
+        if (!BufferIsValid(&output)) {
+            Warn("Failed to compile '%s' ..", inputPath);
+            __atomic_add_fetch(&context->failedCount, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        pthread_mutex_lock(&context->writerMutex);
+        BulkWriterAdd(context->writer, outputPath, output);
+        pthread_mutex_unlock(&context->writerMutex);
+    }
+}
+
 int main(int argc, char** argv) {
-    if (argc < 4) {
+    // Pull the options out of argv, leaving only the positional arguments.
+    char* options[MAX_OPTION_COUNT];
+    int optionCount = 0;
+
+    int positionalCount = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i >= 2 && strncmp(argv[i], "--", 2) == 0) {
+            if (optionCount >= MAX_OPTION_COUNT)
+                Panic("Too many options (max is %d)", MAX_OPTION_COUNT);
+            options[optionCount++] = argv[i] + 2;
+        }
+        else
+            argv[positionalCount++] = argv[i];
+    }
+    argc = positionalCount;
+
+    if (argc < 3) {
         usage(argv[0]);
         return 1;
     }
 
     const char* mode = argv[1];
 
+    const bool outputOptional = strcasecmp(mode, "bea_list") == 0;
+    if (argc < 4 && !outputOptional) {
+        usage(argv[0]);
+        return 1;
+    }
+
     if (strcasecmp(mode, "bea_unpack") == 0) {
         printf("-- Unpacking BEA at path '%s' --\n\n", argv[2]);
 
-        ConsBuffer beaData = FileLoadMem(argv[2]);
-        if (!BufferIsValid(&beaData))
+        BeaFile beaFile;
+        if (!BeaFileOpen(&beaFile, argv[2]))
             Panic("Failed to load BEA file");
-        ConsBufferView beaView = BUFFER_TO_VIEW(beaData);
-
-        BeaPreprocess(beaView);
+        ConsBufferView beaView = BeaFileGetMetadata(&beaFile);
 
         const NnString* archiveName = BeaGetArchiveName(beaView);
 
         const char* outputDir = argv[3];
 
-        printf("Extracting assets:\n");
+        ConsThreadPool threadPool;
+        ThreadPoolInit(&threadPool, getJobCountOption(options, optionCount));
+
+        // Small assets are written in batches; directories are only created once.
+        ConsBulkWriter writer;
+        BulkWriterInit(&writer, &threadPool);
+
+        printf("Extracting assets (%s):\n", writer.usesIoUring ? "io_uring" : "thread pool");
 
         u32 assetCount = BeaGetAssetCount(beaView);
-        for (u32 i = 0; i < assetCount; i++) {
+
+        // Extract in data order so the payload reads stay sequential.
+        u32* assetOrder = malloc(sizeof(u32) * MAX(assetCount, 1u));
+        BeaGetDataOrder(beaView, assetOrder);
+
+        for (u32 j = 0; j < assetCount; j++) {
+            const u32 i = assetOrder[j];
             const NnString* filename = BeaGetAssetFilename(beaView, i);
 
             printf("    - Extracting: %.*s ..", (int)filename->len, filename->str);
@@ -74,30 +365,60 @@ int main(int argc, char** argv) {
                 (int)archiveName->len, archiveName->str, (int)filename->len, filename->str
             );
 
-            char* lastSlash = strrchr(filePath, '/');
-            if (lastSlash) {
-                *lastSlash = '\0';
-                if (!DirectoryCreateTree(filePath))
-                    Panic("Failed to create directory tree at '%s' ..", filePath);
-
-                *lastSlash = '/';
-            }
+            if (!BeaFileExtractAsset(&beaFile, i, filePath, &writer))
+                Panic("Failed to extract asset '%s' to path '%s' ..", filename->str, filePath);
 
-            ConsBuffer decompressedData = BeaGetDecompressedData(beaView, i);
-            if (!BufferIsValid(&decompressedData))
-                Panic("Failed to decompress asset '%s' ..", filename->str);
+            printf(" OK\n");
+        }
 
-            if (!FileWriteMem(BUFFER_TO_VIEW(decompressedData), filePath))
-                Panic("Failed to write asset '%s' to path '%s' ..", filename->str, filePath);
+        if (!BulkWriterFlush(&writer)) {
+            Panic(
+                "Failed to write %llu of %u assets ..",
+                (unsigned long long)writer.failedCount, assetCount
+            );
+        }
+        BulkWriterDestroy(&writer);
 
-            BufferDestroy(&decompressedData);
+        ThreadPoolDestroy(&threadPool);
 
-            printf(" OK\n");
-        }
+        free(assetOrder);
 
-        BufferDestroy(&beaData);
+        BeaFileClose(&beaFile);
     }
     else if (strcasecmp(mode, "bea_pack") == 0) {
+        // Scanning & compression share one pool.
+        ConsThreadPool threadPool;
+        ThreadPoolInit(&threadPool, getJobCountOption(options, optionCount));
+
+        BeaBuildOptions buildOptions = { 0 };
+        buildOptions.threadPool = &threadPool;
+
+        BeaCompressionType compressionType = BEA_COMPRESSION_TYPE_ZSTD;
+
+        const char* compressionOption = getOption(options, optionCount, "compression");
+        if (compressionOption != NULL) {
+            if (strcasecmp(compressionOption, "auto") == 0)
+                compressionType = BEA_COMPRESSION_TYPE_AUTO;
+            else if (strcasecmp(compressionOption, "none") == 0)
+                compressionType = BEA_COMPRESSION_TYPE_NONE;
+            else if (strcasecmp(compressionOption, "zlib") == 0)
+                compressionType = BEA_COMPRESSION_TYPE_ZLIB;
+            else if (strcasecmp(compressionOption, "zstd") == 0)
+                compressionType = BEA_COMPRESSION_TYPE_ZSTD;
+            else
+                Panic("Invalid compression type '%s'", compressionOption);
+        }
+
+        BeaCompressionPolicy compressionPolicy;
+        compressionPolicy.minSavings = getFractionOption(
+            options, optionCount, "min-savings", BEA_COMPRESSION_POLICY_DEFAULT_MIN_SAVINGS
+        );
+        compressionPolicy.zlibMinAdvantage = getFractionOption(
+            options, optionCount, "zlib-advantage", BEA_COMPRESSION_POLICY_DEFAULT_ZLIB_MIN_ADVANTAGE
+        );
+
+        buildOptions.compressionPolicy = &compressionPolicy;
+
         char* rootDirPath = strdup(argv[2]);
 
         // Remove trailing slashes.
@@ -111,54 +432,131 @@ int main(int argc, char** argv) {
 
         printf("-- Creating archive '%s' from path '%s' --\n\n", archiveName, rootDirPath);
 
-        printf("Loading assets..");
-        fflush(stdout);
-
-        ConsList filePathList = DirectoryGetAllFiles(rootDirPath);
-        const u64 assetCount = filePathList.elementCount;
+        // Paths & asset entries live until the archive is written; free them together.
+        ConsArena packArena;
+        ArenaInit(&packArena, 0);
 
-        if (ListIsEmpty(&filePathList)) {
+        ConsDirScan dirScan;
+        if (!DirectoryScan(&dirScan, rootDirPath, &threadPool, &packArena) || dirScan.fileCount == 0) {
             Panic("Failed to open directory at path '%s'!", argv[2]);
         }
 
+        const u64 assetCount = dirScan.fileCount;
+
         const u64 rootDirPathLen = strlen(rootDirPath);
 
-        BeaBuildAsset* buildAssets = malloc(sizeof(BeaBuildAsset) * assetCount);
+        BeaBuildAsset* buildAssets = ArenaAlloc(&packArena, sizeof(BeaBuildAsset) * assetCount);
         for (u64 i = 0; i < assetCount; i++) {
-            char* filePath = *(char**)ListGet(&filePathList, i);
+            const char* filePath = dirScan.filePaths[i];
 
             buildAssets[i].name = filePath + rootDirPathLen + 1;
-            buildAssets[i].compressionType = BEA_COMPRESSION_TYPE_ZSTD;
+            buildAssets[i].compressionType = compressionType;
             buildAssets[i].alignmentShift = 12; // 4096 byte alignment by default.
 
-            buildAssets[i].data = FileLoadMem(filePath);
-            if (!BufferIsValid(&buildAssets[i].data)) {
-                Panic("Failed to open file at path '%s'!", filePath);
-            }
+            // Streamed from disk while the archive is written.
+            buildAssets[i].data = (ConsBuffer){ 0 };
+            buildAssets[i].path = filePath;
         }
 
-        printf(" OK\n");
+        printf("Writing archive to path '%s'..\n", argv[3]);
 
-        ConsBuffer beaBuffer = BeaBuild(buildAssets, assetCount, archiveName);
+        u32* dataOrder = NULL;
 
-        free(archiveName);
+        const char* orderOption = getOption(options, optionCount, "order");
+        if (orderOption != NULL) {
+            ConsBuffer trace = FileLoadMem(orderOption);
+            if (!BufferIsValid(&trace))
+                Panic("Failed to open access trace at path '%s'", orderOption);
 
-        printf("Writing final archive to path '%s'..", argv[3]);
-        fflush(stdout);
+            dataOrder = malloc(sizeof(u32) * assetCount);
+            const u32 tracedCount = BeaBuildGetTraceOrder(buildAssets, assetCount, BUFFER_TO_VIEW(trace), dataOrder);
+
+            printf("Ordering %u of %llu assets by access trace '%s'\n", tracedCount, (unsigned long long)assetCount, orderOption);
+
+            BufferDestroy(&trace);
+        }
+
+        buildOptions.dataOrder = dataOrder;
 
-        if (!FileWriteMem(BUFFER_TO_VIEW(beaBuffer), argv[3])) {
+        if (!BeaBuildToFile(buildAssets, assetCount, archiveName, argv[3], &buildOptions)) {
             Panic("Failed to write archive to disk!");
         }
 
-        printf(" OK\n");
+        free(dataOrder);
 
+        free(archiveName);
         free(rootDirPath);
 
-        for (u64 i = 0; i < assetCount; i++) {
-            BufferDestroy(&buildAssets[i].data);
-            free(*(char**)ListGet(&filePathList, i));
+        DirectoryScanDestroy(&dirScan);
+        ArenaDestroy(&packArena);
+
+        ThreadPoolDestroy(&threadPool);
+    }
+    else if (strcasecmp(mode, "bea_list") == 0) {
+        const char* beaPath = argv[2];
+        const char* indexPath = (argc >= 4) ? argv[3] : NULL;
+
+        printf("-- Listing BEA at path '%s' --\n\n", beaPath);
+
+        u64 archiveSize;
+        s64 archiveModifyTime;
+        if (!FileGetInfo(beaPath, &archiveSize, &archiveModifyTime))
+            Panic("Failed to open BEA file at path '%s'", beaPath);
+
+        // Only the metadata region is read (if at all); the index never touches the asset data.
+        ConsBuffer indexData = { 0 };
+        bool indexIsMapped = false;
+
+        if (indexPath != NULL) {
+            indexData = FileMapMem(indexPath);
+            indexIsMapped = BeaIndexIsValid(BUFFER_TO_VIEW(indexData), archiveSize, archiveModifyTime);
+            if (!indexIsMapped)
+                FileUnmapMem(&indexData);
         }
-        ListDestroy(&filePathList);
+
+        if (indexIsMapped)
+            printf("Using sidecar index at path '%s'\n\n", indexPath);
+        else {
+            ConsBuffer metadata = BeaLoadMetadata(beaPath);
+            if (!BufferIsValid(&metadata))
+                Panic("Failed to load BEA metadata");
+
+            indexData = BeaIndexBuild(BUFFER_TO_VIEW(metadata), archiveSize, archiveModifyTime);
+            BufferDestroy(&metadata);
+
+            if (indexPath != NULL && !FileWriteMem(BUFFER_TO_VIEW(indexData), indexPath))
+                Warn("Failed to write index to path '%s' ..", indexPath);
+        }
+
+        ConsBufferView indexView = BUFFER_TO_VIEW(indexData);
+
+        static const char* compressionNames[BEA_COMPRESSION_TYPE_COUNT] = { "none", "zlib", "zstd" };
+
+        const BeaIndexHeader* indexHeader = BeaIndexGetHeader(indexView);
+        const BeaIndexEntry* entries = BeaIndexGetEntries(indexView);
+
+        printf(
+            "%s (%u assets)\n\n    %-4s %12s %12s  %s\n",
+            BeaIndexGetArchiveName(indexView), indexHeader->entryCount,
+            "comp", "size", "stored", "name"
+        );
+        for (u32 i = 0; i < indexHeader->entryCount; i++) {
+            const BeaIndexEntry* entry = entries + i;
+
+            const char* compressionName = (entry->compressionType < BEA_COMPRESSION_TYPE_COUNT) ?
+                compressionNames[entry->compressionType] : "????";
+
+            printf(
+                "    %-4s %12u %12u  %.*s\n",
+                compressionName, entry->decompressedSize, entry->compressedSize,
+                (int)entry->nameLen, BeaIndexGetEntryName(indexView, entry)
+            );
+        }
+
+        if (indexIsMapped)
+            FileUnmapMem(&indexData);
+        else
+            BufferDestroy(&indexData);
     }
     else if (strcasecmp(mode, "lua_decomp") == 0) {
         printf("-- Decompiling Lua at path '%s' --\n\n", argv[2]);
@@ -174,33 +572,136 @@ int main(int argc, char** argv) {
         LuaPreprocess(luaView);
 
         ConsBufferView luacView = LuaGetBytecode(luaView);
-    
-        char tempFilePath[] = "bemt_luadec_temp_XXXXXX";
-        if (mkstemp(tempFilePath) == -1)
-            Panic("mkstemp failed ..");
 
-        if (!FileWriteMem(luacView, tempFilePath))
-            Panic("Failed to write temporary luac file ..");
+        // unluac gives back source, but needs Java & a file to read; a listing is disassembled
+        // in-process.
+        if (getOption(options, optionCount, "listing") == NULL) {
+            char tempFilePath[] = "bemt_luadec_temp_XXXXXX";
+            if (mkstemp(tempFilePath) == -1)
+                Panic("mkstemp failed ..");
+
+            if (!FileWriteMem(luacView, tempFilePath))
+                Panic("Failed to write temporary luac file ..");
+
+            BufferDestroy(&buffer);
+
+            printf(" OK\nRunning unluac..");
+            fflush(stdout);
 
-        BufferDestroy(&buffer);
+            char* decompiled = UnluacRun(tempFilePath);
+            if (decompiled == NULL)
+                Panic("Failed to decompile Lua ..");
 
-        printf(" OK\nRunning unluac..");
+            printf(" OK\n");
+
+            if (!FileRemove(tempFilePath))
+                Warn("Failed to remove temporary luac file ..");
+
+            if (!FileWriteMem(BufferViewFromCstr(decompiled), argv[3])) {
+                Panic("Failed to write decompiled lua to disk!");
+            }
+
+            free(decompiled);
+        }
+        else {
+            printf(" OK\nDisassembling..");
+            fflush(stdout);
+
+            ConsBuffer listing = LuadisRun(luacView);
+            if (!BufferIsValid(&listing))
+                Panic("Failed to disassemble Lua ..");
+
+            BufferDestroy(&buffer);
+
+            printf(" OK\n");
+
+            if (!FileWriteMem(BUFFER_TO_VIEW(listing), argv[3])) {
+                Panic("Failed to write disassembled lua to disk!");
+            }
+
+            BufferDestroy(&listing);
+        }
+    }
+    else if (strcasecmp(mode, "lua_decomp_dir") == 0) {
+        char* rootDirPath = strdup(argv[2]);
+
+        // Remove trailing slashes.
+        char* rootDirPathEnd = rootDirPath + strlen(rootDirPath) - 1;
+        while (rootDirPathEnd > rootDirPath && *rootDirPathEnd == '/') {
+            *rootDirPathEnd = '\0';
+            rootDirPathEnd--;
+        }
+
+        printf("-- Decompiling Lua in directory '%s' --\n\n", rootDirPath);
+
+        ConsThreadPool threadPool;
+        ThreadPoolInit(&threadPool, getJobCountOption(options, optionCount));
+
+        ConsDirScan dirScan;
+        if (!DirectoryScan(&dirScan, rootDirPath, &threadPool, NULL))
+            Panic("Failed to scan directory '%s' ..", rootDirPath);
+
+        // Every pool thread streams its scripts through its own unluac process, so the JVM
+        // only starts once per thread.
+        const bool useUnluac = getOption(options, optionCount, "listing") == NULL;
+
+#ifndef _WIN32
+        // A driver that died would otherwise kill us on the next request write.
+        if (useUnluac)
+            signal(SIGPIPE, SIG_IGN);
+#endif
+
+        // The writes don't go through the pool: a task waiting to queue a write would hold up
+        // the worker that should carry it out.
+        ConsBulkWriter writer;
+        BulkWriterInit(&writer, NULL);
+
+        DecompileScriptsContext context;
+        context.inputPaths = dirScan.filePaths;
+        context.rootPathLen = strlen(rootDirPath);
+        context.outputDir = argv[3];
+        context.threadPool = &threadPool;
+        context.workers = useUnluac ?
+            calloc(threadPool.threadCount + 1, sizeof(UnluacWorker)) : NULL;
+        context.writer = &writer;
+        pthread_mutex_init(&context.writerMutex, NULL);
+        context.failedCount = 0;
+        context.skippedCount = 0;
+
+        printf(
+            "%s %llu files (%u threads)..",
+            useUnluac ? "Decompiling" : "Disassembling", (unsigned long long)dirScan.fileCount,
+            threadPool.threadCount
+        );
         fflush(stdout);
 
-        char* decompiled = UnluacRun(tempFilePath);
-        if (decompiled == NULL)
-            Panic("Failed to decompile Lua ..");
+        ThreadPoolParallelFor(&threadPool, dirScan.fileCount, 1, decompileScripts, &context);
 
-        printf(" OK\n");
+        if (!BulkWriterFlush(&writer)) {
+            Panic(
+                "Failed to write %llu of %llu scripts ..",
+                (unsigned long long)writer.failedCount, (unsigned long long)dirScan.fileCount
+            );
+        }
+        BulkWriterDestroy(&writer);
 
-        if (!FileRemove(tempFilePath))
-            Warn("Failed to remove temporary luac file ..");
+        printf(
+            " OK (%llu failed, %llu skipped)\n",
+            (unsigned long long)context.failedCount, (unsigned long long)context.skippedCount
+        );
 
-        if (!FileWriteMem(BufferViewFromCstr(decompiled), argv[3])) {
-            Panic("Failed to write decompiled lua to disk!");
+        if (context.workers != NULL) {
+            for (u32 i = 0; i < threadPool.threadCount + 1; i++)
+                UnluacWorkerStop(context.workers + i);
+            free(context.workers);
         }
 
-        free(decompiled);
+        pthread_mutex_destroy(&context.writerMutex);
+
+        ThreadPoolDestroy(&threadPool);
+
+        DirectoryScanDestroy(&dirScan);
+        free(rootDirPath);
     }
     else if (strcasecmp(mode, "lua_comp") == 0) {
         printf("-- Compiling Lua --\n\n");
@@ -216,17 +717,107 @@ int main(int argc, char** argv) {
         BufferGrow(&sourceData, 1);
         sourceData.data_char[sourceData.size - 1] = '\0';
 
-        ConsBuffer compiledBuf = LuaBuild(sourceData.data_char);
+        bool upToDate = false;
+        if (getOption(options, optionCount, "incremental") != NULL) {
+            u8 sourceHash[LUA_SOURCE_HASH_SIZE];
+            LuaHashSource(sourceData.data_char, sourceData.size - 1, sourceHash);
+
+            upToDate = LuaFileMatchesSource(argv[3], sourceHash);
+        }
+
+        if (upToDate) {
+            BufferDestroy(&sourceData);
+
+            printf(" OK (up to date)\n");
+        }
+        else {
+            ConsBuffer compiledBuf = LuaBuild(sourceData.data_char);
+
+            BufferDestroy(&sourceData);
+
+            printf(" OK\n");
+
+            if (!FileWriteMem(BUFFER_TO_VIEW(compiledBuf), argv[3])) {
+                Panic("Failed to write lua binary to disk!");
+            }
+
+            BufferDestroy(&compiledBuf);
+        }
+    }
+    else if (strcasecmp(mode, "lua_comp_dir") == 0) {
+        char* rootDirPath = strdup(argv[2]);
+
+        // Remove trailing slashes.
+        char* rootDirPathEnd = rootDirPath + strlen(rootDirPath) - 1;
+        while (rootDirPathEnd > rootDirPath && *rootDirPathEnd == '/') {
+            *rootDirPathEnd = '\0';
+            rootDirPathEnd--;
+        }
+
+        printf("-- Compiling Lua in directory '%s' --\n\n", rootDirPath);
+
+        ConsThreadPool threadPool;
+        ThreadPoolInit(&threadPool, getJobCountOption(options, optionCount));
+
+        ConsDirScan dirScan;
+        if (!DirectoryScan(&dirScan, rootDirPath, &threadPool, NULL))
+            Panic("Failed to scan directory '%s' ..", rootDirPath);
+
+        // Not through the pool, see lua_decomp_dir.
+        ConsBulkWriter writer;
+        BulkWriterInit(&writer, NULL);
+
+        CompileScriptsContext context;
+        context.inputPaths = dirScan.filePaths;
+        context.rootPathLen = strlen(rootDirPath);
+        context.outputDir = argv[3];
+        context.threadPool = &threadPool;
+        context.compilers = malloc(sizeof(LuacCompiler) * (threadPool.threadCount + 1));
+        context.writer = &writer;
+        pthread_mutex_init(&context.writerMutex, NULL);
+        context.incremental = getOption(options, optionCount, "incremental") != NULL;
+        context.failedCount = 0;
+        context.upToDateCount = 0;
+
+        for (u32 i = 0; i < threadPool.threadCount + 1; i++)
+            LuacCompilerInit(context.compilers + i);
+
+        printf(
+            "Compiling %llu files (%u threads)..",
+            (unsigned long long)dirScan.fileCount, threadPool.threadCount
+        );
+        fflush(stdout);
 
-        BufferDestroy(&sourceData);
+        ThreadPoolParallelFor(&threadPool, dirScan.fileCount, 0, compileScripts, &context);
 
-        printf(" OK\n");
+        if (!BulkWriterFlush(&writer)) {
+            Panic(
+                "Failed to write %llu of %llu scripts ..",
+                (unsigned long long)writer.failedCount, (unsigned long long)dirScan.fileCount
+            );
+        }
+        BulkWriterDestroy(&writer);
 
-        if (!FileWriteMem(BUFFER_TO_VIEW(compiledBuf), argv[3])) {
-            Panic("Failed to write lua binary to disk!");
+        if (context.incremental) {
+            printf(
+                " OK (%llu failed, %llu up to date)\n",
+                (unsigned long long)context.failedCount, (unsigned long long)context.upToDateCount
+            );
+        }
+        else {
+            printf(" OK (%llu failed)\n", (unsigned long long)context.failedCount);
         }
 
-        BufferDestroy(&compiledBuf);
+        for (u32 i = 0; i < threadPool.threadCount + 1; i++)
+            LuacCompilerDestroy(context.compilers + i);
+        free(context.compilers);
+
+        pthread_mutex_destroy(&context.writerMutex);
+
+        ThreadPoolDestroy(&threadPool);
+
+        DirectoryScanDestroy(&dirScan);
+        free(rootDirPath);
     }
     else if (strcasecmp(mode, "bntx_test") == 0) {
         ConsBuffer bufferTiled = FileLoadMem("/Users/angelo/Downloads/128_bc3_tiled.bin");
@@ -239,34 +830,32 @@ int main(int argc, char** argv) {
     else if (strcasecmp(mode, "bntx_extract") == 0) {
         printf("-- Extracting BNTX --\n");
 
-        ConsBuffer bntxData = FileLoadMem(argv[2]);
+        ConsBuffer bntxData = FileMapMem(argv[2]);
         if (!BufferIsValid(&bntxData))
             Panic("Failed to load BNTX file");
         ConsBufferView bntxView = BUFFER_TO_VIEW(bntxData);
 
         BntxPreprocess(bntxView);
+        if (!BntxRelocate(bntxView))
+            Panic("BNTX relocation table is invalid");
 
         const char* groupName = BntxGetTextureGroupName(bntxView);
         u32 textureCount = BntxGetTextureCount(bntxView);
 
         printf("%s (%u textures)\n", groupName, textureCount);
 
-        for (u32 i = 0; i < textureCount; i++) {
+        for (u32 i = 0; i < textureCount; i++)
             printf("    - %s (%u %u)\n", BntxGetTextureName(bntxView, i)->str, BntxGetTextureFormat(bntxView, i), BntxGetTextureTileMode(bntxView,i));
-            ConsBuffer decoded = BntxDecodeTexture(bntxView, i);
-            if (BufferIsValid(&decoded)) {
-                char nameBuf[512];
-                snprintf(nameBuf, sizeof(nameBuf), "%s.png", BntxGetTextureName(bntxView, i)->str);
-                int res = stbi_write_png(
-                    nameBuf,
-                    BntxGetTextureWidth(bntxView, i), BntxGetTextureHeight(bntxView, i),
-                    4, decoded.data_void, BntxGetTextureWidth(bntxView, i) * 4
-                );
-                BufferDestroy(&decoded);
-            }
-        }
 
-        BufferDestroy(&bntxData);
+        // Textures are decoded & encoded independently; one at a time per thread.
+        ConsThreadPool threadPool;
+        ThreadPoolInit(&threadPool, getJobCountOption(options, optionCount));
+
+        ThreadPoolParallelFor(&threadPool, textureCount, 1, extractTextures, &bntxView);
+
+        ThreadPoolDestroy(&threadPool);
+
+        FileUnmapMem(&bntxData);
     }
     else {
         Error("Invalid mode '%s' ..\n", mode);
@@ -0,0 +1,127 @@
+#include "beaIndex.h"
+
+#include "beaProcess.h"
+
+#include "../cons/error.h"
+
+#include "../cons/hash.h"
+
+#include <stdlib.h>
+
+#include <string.h>
+
+static int _CompareNames(const char* a, u64 aLen, const char* b, u64 bLen) {
+    const int cmp = memcmp(a, b, MIN(aLen, bLen));
+    if (cmp != 0)
+        return cmp;
+    return (aLen > bLen) - (aLen < bLen);
+}
+
+typedef struct _SortItem {
+    const NnString* name;
+    u32 assetIndex;
+} _SortItem;
+
+static int _CompareSortItems(const void* a, const void* b) {
+    const NnString* nameA = ((const _SortItem*)a)->name;
+    const NnString* nameB = ((const _SortItem*)b)->name;
+    return _CompareNames(nameA->str, nameA->len, nameB->str, nameB->len);
+}
+
+ConsBuffer BeaIndexBuild(ConsBufferView beaData, u64 archiveSize, s64 archiveModifyTime) {
+    const u32 assetCount = BeaGetAssetCount(beaData);
+    const NnString* archiveName = BeaGetArchiveName(beaData);
+
+    _SortItem* items = malloc(sizeof(_SortItem) * (assetCount ? assetCount : 1));
+
+    u64 stringPoolSize = archiveName->len + 1;
+    for (u32 i = 0; i < assetCount; i++) {
+        items[i].name = BeaGetAssetFilename(beaData, i);
+        items[i].assetIndex = i;
+
+        stringPoolSize += items[i].name->len + 1;
+    }
+
+    qsort(items, assetCount, sizeof(_SortItem), _CompareSortItems);
+
+    const u64 entriesOffset = sizeof(BeaIndexHeader);
+    const u64 stringPoolOffset = entriesOffset + (sizeof(BeaIndexEntry) * assetCount);
+    const u64 indexSize = stringPoolOffset + stringPoolSize;
+
+    if (indexSize > 0xFFFFFFFF)
+        Panic("BeaIndexBuild: index size exceeds max of 0xFFFFFFFF");
+
+    ConsBuffer indexBuffer;
+    BufferInit(&indexBuffer, indexSize);
+
+    BeaIndexHeader* header = indexBuffer.data_void;
+
+    header->identifier = BEA_INDEX_ID;
+    header->version = BEA_INDEX_VERSION;
+    header->archiveSize = archiveSize;
+    header->archiveModifyTime = archiveModifyTime;
+    header->entryCount = assetCount;
+    header->entriesOffset = (u32)entriesOffset;
+    header->stringPoolOffset = (u32)stringPoolOffset;
+    header->archiveNameOffset = (u32)stringPoolOffset;
+
+    u64 nextStringOffset = stringPoolOffset;
+
+    memcpy(indexBuffer.data_u8 + nextStringOffset, archiveName->str, archiveName->len);
+    nextStringOffset += archiveName->len + 1;
+
+    BeaIndexEntry* entries = (BeaIndexEntry*)(indexBuffer.data_u8 + entriesOffset);
+    for (u32 i = 0; i < assetCount; i++) {
+        const u32 assetIndex = items[i].assetIndex;
+        const NnString* name = items[i].name;
+
+        BeaIndexEntry* entry = entries + i;
+
+        entry->nameHash = HashXxh3(name->str, name->len, 0);
+        entry->dataOffset = BeaGetAssetDataOffset(beaData, assetIndex);
+        entry->compressedSize = BeaGetAssetCompressedSize(beaData, assetIndex);
+        entry->decompressedSize = BeaGetAssetDecompressedSize(beaData, assetIndex);
+
+        entry->nameOffset = (u32)nextStringOffset;
+        entry->nameLen = name->len;
+        entry->compressionType = (u8)BeaGetAssetCompressionType(beaData, assetIndex);
+        entry->alignmentShift = (u8)__builtin_ctzll(BeaGetAssetAlignment(beaData, assetIndex));
+
+        memcpy(indexBuffer.data_u8 + nextStringOffset, name->str, name->len);
+        nextStringOffset += name->len + 1;
+    }
+
+    free(items);
+
+    return indexBuffer;
+}
+
+bool BeaIndexIsValid(ConsBufferView indexData, u64 archiveSize, s64 archiveModifyTime) {
+    if (!BufferViewIsValid(&indexData) || indexData.size < sizeof(BeaIndexHeader))
+        return false;
+
+    const BeaIndexHeader* header = BeaIndexGetHeader(indexData);
+
+    if (header->identifier != BEA_INDEX_ID || header->version != BEA_INDEX_VERSION)
+        return false;
+    if (header->archiveSize != archiveSize || header->archiveModifyTime != archiveModifyTime)
+        return false;
+
+    const u64 entriesEnd = (u64)header->entriesOffset + (sizeof(BeaIndexEntry) * header->entryCount);
+    if (entriesEnd > indexData.size || header->stringPoolOffset > indexData.size)
+        return false;
+    if (header->archiveNameOffset >= indexData.size)
+        return false;
+
+    const BeaIndexEntry* entries = BeaIndexGetEntries(indexData);
+    for (u32 i = 0; i < header->entryCount; i++) {
+        if ((u64)entries[i].nameOffset + entries[i].nameLen >= indexData.size)
+            return false;
+    }
+
+    // The strings are written back-to-back, so only the last one has to be checked.
+    if (indexData.data_u8[indexData.size - 1] != '\0')
+        return false;
+
+    return true;
+}
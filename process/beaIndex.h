@@ -0,0 +1,65 @@
+#ifndef BEA_INDEX_H
+#define BEA_INDEX_H
+
+// Sidecar index for BEA archives: a flat listing of every asset, sorted by name, that can be
+// mapped and read directly. It's tied to the size & modification time of the archive it was
+// built from, so a stale index is detected without touching the archive itself.
+
+#include "../cons/buffer.h"
+
+#include "../cons/type.h"
+#include "../cons/macro.h"
+
+#define BEA_INDEX_ID IDENTIFIER_TO_U32('B','I','D','X')
+#define BEA_INDEX_VERSION (2)
+
+typedef struct __attribute__((packed)) {
+    u32 identifier; // Compare to BEA_INDEX_ID.
+    u32 version; // Compare to BEA_INDEX_VERSION.
+
+    u64 archiveSize;
+    s64 archiveModifyTime; // In nanoseconds.
+
+    u32 entryCount;
+    u32 entriesOffset; // Offset to the entries (BeaIndexEntry), sorted by name.
+    u32 stringPoolOffset;
+    u32 archiveNameOffset; // Offset to the null-terminated archive name.
+} BeaIndexHeader;
+STRUCT_SIZE_ASSERT(BeaIndexHeader, 0x28);
+
+typedef struct __attribute__((packed)) {
+    u64 nameHash; // XXH3 hash of the name (see HashXxh3, seed 0).
+    u64 dataOffset; // Offset to the (compressed) data in the archive.
+    u32 compressedSize;
+    u32 decompressedSize;
+
+    u32 nameOffset; // Offset to the null-terminated name.
+    u16 nameLen;
+    u8 compressionType; // See BeaCompressionType.
+    u8 alignmentShift;
+} BeaIndexEntry;
+STRUCT_SIZE_ASSERT(BeaIndexEntry, 0x20);
+
+// Build an index from an archive (the metadata region is enough, see BeaLoadMetadata).
+ConsBuffer BeaIndexBuild(ConsBufferView beaData, u64 archiveSize, s64 archiveModifyTime);
+
+// Check if an index is well-formed and was built from an archive with this size & modify time.
+bool BeaIndexIsValid(ConsBufferView indexData, u64 archiveSize, s64 archiveModifyTime);
+
+static inline const BeaIndexHeader* BeaIndexGetHeader(ConsBufferView indexData) {
+    return (const BeaIndexHeader*)indexData.data_void;
+}
+
+static inline const BeaIndexEntry* BeaIndexGetEntries(ConsBufferView indexData) {
+    return (const BeaIndexEntry*)(indexData.data_u8 + BeaIndexGetHeader(indexData)->entriesOffset);
+}
+
+static inline const char* BeaIndexGetEntryName(ConsBufferView indexData, const BeaIndexEntry* entry) {
+    return (const char*)(indexData.data_u8 + entry->nameOffset);
+}
+
+static inline const char* BeaIndexGetArchiveName(ConsBufferView indexData) {
+    return (const char*)(indexData.data_u8 + BeaIndexGetHeader(indexData)->archiveNameOffset);
+}
+
+#endif // BEA_INDEX_H
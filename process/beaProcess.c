@@ -6,15 +6,19 @@
 
 #include "../cons/comp.h"
 
-#include "../cons/list.h"
-#include "../cons/ptrie.h"
+#include "../cons/vec.h"
+#include "../cons/file.h"
+#include "../cons/threadpool.h"
 
+#include <stdlib.h>
 #include <stdio.h>
 
 #include <string.h>
 
 #include <stddef.h>
 
+#include <pthread.h>
+
 #define SCNE_ID IDENTIFIER_TO_U32('S','C','N','E')
 #define ASST_ID IDENTIFIER_TO_U32('A','S','S','T')
 
@@ -69,10 +73,45 @@ void BeaPreprocess(ConsBufferView beaData) {
         Panic("BeaPreprocess: unsupported version (expected v1.1.0)");
 }
 
+static ConsBuffer _ReadMetadata(ConsFile* file) {
+    BeaFileHeader fileHeader;
+    if (!FileReadAt(file, &fileHeader, 0, sizeof(BeaFileHeader)))
+        return (ConsBuffer){ 0 };
+
+    BeaPreprocess(BufferViewFromPtr(&fileHeader, sizeof(BeaFileHeader)));
+
+    const u32 memoryLoadSize = fileHeader._00.memoryLoadSize;
+    if (memoryLoadSize < sizeof(BeaFileHeader))
+        Panic("BeaLoadMetadata: memory load size is too small (%u)", memoryLoadSize);
+
+    ConsBuffer metadata;
+    BufferInit(&metadata, memoryLoadSize);
+
+    if (!FileReadAt(file, metadata.data_void, 0, memoryLoadSize))
+        BufferDestroy(&metadata);
+
+    return metadata;
+}
+
+ConsBuffer BeaLoadMetadata(const char* path) {
+    ConsFile file;
+    if (!FileOpenRead(&file, path))
+        return (ConsBuffer){ 0 };
+
+    ConsBuffer metadata = _ReadMetadata(&file);
+
+    FileClose(&file);
+    return metadata;
+}
+
+bool BeaRelocate(ConsBufferView beaData) {
+    return NnRelocTableApply(beaData.data_void, beaData.size);
+}
+
 NnString* BeaGetArchiveName(ConsBufferView beaData) {
     const BeaFileHeader* fileHeader = beaData.data_void;
 
-    return (NnString*)(beaData.data_u8 + fileHeader->archiveNamePtr);
+    return (NnString*)NnBinResolvePtr(beaData.data_void, fileHeader->archiveNamePtr);
 }
 
 u32 BeaGetAssetCount(ConsBufferView beaData) {
@@ -82,9 +121,11 @@ u32 BeaGetAssetCount(ConsBufferView beaData) {
 
 s64 BeaFindAssetIndex(ConsBufferView beaData, const char* filename) {
     const BeaFileHeader* fileHeader = beaData.data_void;
-    const NnDic* dic = (NnDic*)(beaData.data_u8 + fileHeader->dicPtr);
+    const NnDic* dic = (NnDic*)NnBinResolvePtr(beaData.data_void, fileHeader->dicPtr);
 
-    const NnDicNode* node = NnDicFind(beaData.data_void, dic, filename);
+    const NnDicNode* node = NnDicFind(
+        NnFileHeaderIsRelocated(&fileHeader->_00) ? NULL : beaData.data_void, dic, filename
+    );
     if (node == NULL)
         return -1;
 
@@ -96,9 +137,9 @@ static BeaAssetBlock* _IndexAsset(ConsBufferView beaData, u32 assetIndex) {
     if (assetIndex >= fileHeader->assetCount)
         return NULL;
 
-    u64* assetPointers = (u64*)(beaData.data_u8 + fileHeader->assetPointersPtr);
+    u64* assetPointers = (u64*)NnBinResolvePtr(beaData.data_void, fileHeader->assetPointersPtr);
 
-    return (BeaAssetBlock*)(beaData.data_u8 + assetPointers[assetIndex]);
+    return (BeaAssetBlock*)NnBinResolvePtr(beaData.data_void, assetPointers[assetIndex]);
 }
 
 NnString* BeaGetAssetFilename(ConsBufferView beaData, u32 assetIndex) {
@@ -106,7 +147,7 @@ NnString* BeaGetAssetFilename(ConsBufferView beaData, u32 assetIndex) {
     if (asset == NULL)
         return NULL;
 
-    return (NnString*)(beaData.data_u8 + asset->filenamePtr);
+    return (NnString*)NnBinResolvePtr(beaData.data_void, asset->filenamePtr);
 }
 
 BeaCompressionType BeaGetAssetCompressionType(ConsBufferView beaData, u32 assetIndex) {
@@ -141,6 +182,14 @@ u32 BeaGetAssetDecompressedSize(ConsBufferView beaData, u32 assetIndex) {
     return asset->decompressedDataSize;
 }
 
+u64 BeaGetAssetDataOffset(ConsBufferView beaData, u32 assetIndex) {
+    BeaAssetBlock* asset = _IndexAsset(beaData, assetIndex);
+    if (asset == NULL)
+        return 0;
+
+    return asset->dataOffset;
+}
+
 ConsBufferView BeaGetCompressedData(ConsBufferView beaData, u32 assetIndex) {
     BeaAssetBlock* asset = _IndexAsset(beaData, assetIndex);
     if (asset == NULL)
@@ -153,17 +202,9 @@ ConsBufferView BeaGetCompressedData(ConsBufferView beaData, u32 assetIndex) {
     return view;
 }
 
-ConsBuffer BeaGetDecompressedData(ConsBufferView beaData, u32 assetIndex) {
-    BeaAssetBlock* asset = _IndexAsset(beaData, assetIndex);
-    if (asset == NULL)
-        return (ConsBuffer){ 0 };
-
+static ConsBuffer _DecompressAsset(const BeaAssetBlock* asset, ConsBufferView dataView) {
     ConsBuffer buffer;
 
-    ConsBufferView dataView;
-    dataView.data_u8 = beaData.data_u8 + asset->dataOffset;
-    dataView.size = asset->dataSize;
-
     switch ((BeaCompressionType)asset->compressionType) {
     case BEA_COMPRESSION_TYPE_NONE:
         BufferInitCopyView(&buffer, dataView);
@@ -183,32 +224,246 @@ ConsBuffer BeaGetDecompressedData(ConsBufferView beaData, u32 assetIndex) {
     return buffer;
 }
 
-#define BEA_BUILD_ENABLE_DIC_TEST
+ConsBuffer BeaGetDecompressedData(ConsBufferView beaData, u32 assetIndex) {
+    BeaAssetBlock* asset = _IndexAsset(beaData, assetIndex);
+    if (asset == NULL)
+        return (ConsBuffer){ 0 };
 
-ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* archiveName) {
-    if (assets == NULL)
-        Panic("BeaBuild: assets is NULL");
-    if (archiveName == NULL)
-        Panic("BeaBuild: archiveName is NULL");
+    ConsBufferView dataView;
+    dataView.data_u8 = beaData.data_u8 + asset->dataOffset;
+    dataView.size = asset->dataSize;
 
-    if (assetCount > 0xFFFF)
-        Panic("BeaBuild: too many assets: exceeds max of 65535!");
+    return _DecompressAsset(asset, dataView);
+}
 
-    ConsList compressedDataList;
-    ListInit(&compressedDataList, sizeof(ConsBuffer), assetCount);
+typedef struct _DataOrderItem {
+    u64 dataOffset;
+    u32 assetIndex;
+} _DataOrderItem;
+
+static int _CompareDataOrder(const void* a, const void* b) {
+    const _DataOrderItem* itemA = a;
+    const _DataOrderItem* itemB = b;
+    if (itemA->dataOffset != itemB->dataOffset)
+        return (itemA->dataOffset > itemB->dataOffset) ? 1 : -1;
+    return (itemA->assetIndex > itemB->assetIndex) - (itemA->assetIndex < itemB->assetIndex);
+}
 
-    printf("Compressing assets:\n");
+void BeaGetDataOrder(ConsBufferView beaData, u32* outAssetIndices) {
+    const u32 assetCount = BeaGetAssetCount(beaData);
+    if (assetCount == 0)
+        return;
 
+    _DataOrderItem* items = malloc(sizeof(_DataOrderItem) * assetCount);
     for (u32 i = 0; i < assetCount; i++) {
-        const BeaBuildAsset* asset = assets + i;
+        items[i].dataOffset = _IndexAsset(beaData, i)->dataOffset;
+        items[i].assetIndex = i;
+    }
 
-        if (!BufferIsValid(&asset->data))
-            Panic("BeaBuild: asset no. %u ('%s') has an invalid data view", i+1, asset->name);
-        if (asset->data.size > 0xFFFFFFFF) {
-            double gibibytes = (double)asset->data.size / (1024. * 1024. * 1024.);
-            Panic("BeaBuild: asset no. %u ('%s') data is too big (%.4f gib)", i+1, asset->name, gibibytes);
+    qsort(items, assetCount, sizeof(_DataOrderItem), _CompareDataOrder);
+
+    for (u32 i = 0; i < assetCount; i++)
+        outAssetIndices[i] = items[i].assetIndex;
+
+    free(items);
+}
+
+// On-demand reader
+
+#define BEA_FILE_WINDOW_SIZE (8 * 1024 * 1024)
+
+// Assets at least this large (decompressed) are streamed to disk instead of being decompressed
+// into memory first.
+#define BEA_FILE_STREAM_THRESHOLD (BEA_FILE_WINDOW_SIZE)
+
+bool BeaFileOpen(BeaFile* beaFile, const char* path) {
+    if (beaFile == NULL)
+        return false;
+
+    if (!FileOpenRead(&beaFile->file, path))
+        return false;
+
+    beaFile->metadata = _ReadMetadata(&beaFile->file);
+    if (!BufferIsValid(&beaFile->metadata)) {
+        FileClose(&beaFile->file);
+        return false;
+    }
+
+    // The metadata is a private copy, so it can be relocated right away.
+    if (!BeaRelocate(BUFFER_TO_VIEW(beaFile->metadata))) {
+        Warn("BeaFileOpen: relocation table is invalid");
+        BufferDestroy(&beaFile->metadata);
+        FileClose(&beaFile->file);
+        return false;
+    }
+
+    beaFile->_window = (ConsBuffer){ 0 };
+    beaFile->_windowOffset = 0;
+    beaFile->_windowSize = 0;
+
+    return true;
+}
+
+void BeaFileClose(BeaFile* beaFile) {
+    if (beaFile == NULL)
+        return;
+
+    BufferDestroy(&beaFile->metadata);
+    BufferDestroy(&beaFile->_window);
+
+    FileClose(&beaFile->file);
+}
+
+ConsBufferView BeaFileReadCompressedData(BeaFile* beaFile, u32 assetIndex) {
+    BeaAssetBlock* asset = _IndexAsset(BUFFER_TO_VIEW(beaFile->metadata), assetIndex);
+    if (asset == NULL)
+        return (ConsBufferView){ 0 };
+
+    const u64 dataOffset = asset->dataOffset;
+    const u64 dataSize = asset->dataSize;
+
+    if (dataOffset > beaFile->file.size || dataSize > beaFile->file.size - dataOffset) {
+        Warn("BeaFileReadCompressedData: asset no. %u data is out of bounds", assetIndex + 1);
+        return (ConsBufferView){ 0 };
+    }
+
+    const bool inWindow =
+        dataOffset >= beaFile->_windowOffset &&
+        dataOffset + dataSize <= beaFile->_windowOffset + beaFile->_windowSize;
+
+    if (!inWindow) {
+        // Read ahead from the start of this asset; the data of the following assets
+        // comes along with it.
+        u64 readSize = MAX(dataSize, (u64)BEA_FILE_WINDOW_SIZE);
+        readSize = MIN(readSize, beaFile->file.size - dataOffset);
+
+        if (beaFile->_window.size < readSize)
+            BufferResizeUninit(&beaFile->_window, readSize);
+
+        beaFile->_windowOffset = dataOffset;
+        beaFile->_windowSize = 0;
+
+        if (readSize > 0 && !FileReadAt(&beaFile->file, beaFile->_window.data_void, dataOffset, readSize)) {
+            Warn("BeaFileReadCompressedData: failed to read asset no. %u", assetIndex + 1);
+            return (ConsBufferView){ 0 };
         }
-    
+
+        beaFile->_windowSize = readSize;
+    }
+
+    return BufferViewFromPtr(
+        beaFile->_window.data_u8 + (dataOffset - beaFile->_windowOffset), dataSize
+    );
+}
+
+ConsBuffer BeaFileReadDecompressedData(BeaFile* beaFile, u32 assetIndex) {
+    BeaAssetBlock* asset = _IndexAsset(BUFFER_TO_VIEW(beaFile->metadata), assetIndex);
+    if (asset == NULL)
+        return (ConsBuffer){ 0 };
+
+    ConsBufferView dataView = BeaFileReadCompressedData(beaFile, assetIndex);
+    if (dataView.data_void == NULL)
+        return (ConsBuffer){ 0 };
+
+    return _DecompressAsset(asset, dataView);
+}
+
+static bool _StreamAsset(BeaFile* beaFile, const BeaAssetBlock* asset, ConsFile* outFile) {
+    switch ((BeaCompressionType)asset->compressionType) {
+    case BEA_COMPRESSION_TYPE_NONE: {
+        // Copy through the window buffer; its contents are invalidated.
+        if (beaFile->_window.size < BEA_FILE_WINDOW_SIZE)
+            BufferResizeUninit(&beaFile->_window, BEA_FILE_WINDOW_SIZE);
+        beaFile->_windowSize = 0;
+
+        u64 copiedSize = 0;
+        while (copiedSize < asset->dataSize) {
+            const u64 chunkSize = MIN(asset->dataSize - copiedSize, (u64)BEA_FILE_WINDOW_SIZE);
+            if (
+                !FileReadAt(&beaFile->file, beaFile->_window.data_void, asset->dataOffset + copiedSize, chunkSize) ||
+                !FileWriteAt(outFile, beaFile->_window.data_void, copiedSize, chunkSize)
+            )
+                return false;
+
+            copiedSize += chunkSize;
+        }
+        return true;
+    }
+    case BEA_COMPRESSION_TYPE_ZLIB:
+        return DecompressZlibStream(
+            &beaFile->file, asset->dataOffset, asset->dataSize,
+            outFile, 0, asset->decompressedDataSize
+        );
+    case BEA_COMPRESSION_TYPE_ZSTD:
+        return DecompressZstdStream(
+            &beaFile->file, asset->dataOffset, asset->dataSize,
+            outFile, 0, asset->decompressedDataSize
+        );
+    default:
+        Warn("BeaFileExtractAsset: invalid compression type (%u)", (u32)asset->compressionType);
+        return false;
+    }
+}
+
+bool BeaFileExtractAsset(BeaFile* beaFile, u32 assetIndex, const char* path, ConsBulkWriter* writer) {
+    BeaAssetBlock* asset = _IndexAsset(BUFFER_TO_VIEW(beaFile->metadata), assetIndex);
+    if (asset == NULL)
+        return false;
+
+    if (asset->decompressedDataSize < BEA_FILE_STREAM_THRESHOLD) {
+        ConsBuffer decompressedData = BeaFileReadDecompressedData(beaFile, assetIndex);
+        if (!BufferIsValid(&decompressedData) && asset->decompressedDataSize != 0)
+            return false;
+
+        if (writer != NULL) {
+            BulkWriterAdd(writer, path, decompressedData);
+            return true;
+        }
+
+        const bool ok = FileWriteMem(BUFFER_TO_VIEW(decompressedData), path);
+
+        BufferReleasePooled(&decompressedData);
+        return ok;
+    }
+
+    const u64 dataOffset = asset->dataOffset;
+    const u64 dataSize = asset->dataSize;
+    if (dataOffset > beaFile->file.size || dataSize > beaFile->file.size - dataOffset) {
+        Warn("BeaFileExtractAsset: asset no. %u data is out of bounds", assetIndex + 1);
+        return false;
+    }
+
+    if (writer != NULL && !BulkWriterCreateParentDirs(writer, path))
+        return false;
+
+    ConsFile outFile;
+    if (!FileOpenWrite(&outFile, path))
+        return false;
+
+    const bool ok = _StreamAsset(beaFile, asset, &outFile);
+
+    FileClose(&outFile);
+    return ok;
+}
+
+#define BEA_BUILD_ENABLE_DIC_TEST
+
+static void _PrintAssetProgress(u32 assetIndex, const char* name, u64 size) {
+    printf("    %u. %s", assetIndex+1, name);
+    if (size < 1024)
+        printf(" (%llub)\n", (unsigned long long)size);
+    else
+        printf(" (%llukib)\n", (unsigned long long)(size / 1024));
+
+    fflush(stdout);
+}
+
+// Build the metadata region (everything up to memoryLoadSize). Its layout doesn't depend on the
+// asset data, so the data fields of the asset blocks are left zeroed; see _SetAssetData.
+static ConsBuffer _BuildMetadata(const BeaBuildAsset* assets, u32 assetCount, const char* archiveName) {
+    for (u32 i = 0; i < assetCount; i++) {
+        const BeaBuildAsset* asset = assets + i;
+
         if (asset->alignmentShift > 63) {
             Panic(
                 "BeaBuild: asset no. %u ('%s') has an invalid alignment shift (%u > 63)",
@@ -216,37 +471,13 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
                 asset->alignmentShift
             );
         }
-
-        printf("    %u. %s", i+1, asset->name);
-        if (asset->data.size < 1024)
-            printf(" (%llub)\n", asset->data.size);
-        else
-            printf(" (%llukib)\n", asset->data.size / 1024);
-
-        fflush(stdout);
-
-        ConsBuffer compressedData;
-        switch (asset->compressionType) {
-        case BEA_COMPRESSION_TYPE_NONE:
-            BufferInitCopyView(&compressedData, BUFFER_TO_VIEW(asset->data));
-            break;
-        case BEA_COMPRESSION_TYPE_ZLIB:
-            compressedData = CompressZlib(BUFFER_TO_VIEW(asset->data));
-            break;
-        case BEA_COMPRESSION_TYPE_ZSTD:
-            compressedData = CompressZstd(BUFFER_TO_VIEW(asset->data));
-            break;
-        default:
+        if (
+            (u32)asset->compressionType >= BEA_COMPRESSION_TYPE_COUNT &&
+            asset->compressionType != BEA_COMPRESSION_TYPE_AUTO
+        )
             Panic("BeaBuild: asset no. %u ('%s') has an invalid compression type (%u)", i+1, asset->name, (u32)asset->compressionType);
-            break;
-        }
-
-        if (!BufferIsValid(&compressedData))
-            Panic("BeaBuild: failed to compress asset no. %u ('%s')", i+1, asset->name);
-        
-        ListAdd(&compressedDataList, &compressedData);
     }
-    
+
     u64 stringPoolSize = sizeof(NnStringPool);
 
     u64 emptyStringOffset = stringPoolSize; // Offset of string pool is added later.
@@ -260,52 +491,35 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
     u64 archiveNameOffset = stringPoolSize; // Offset of string pool is added later.
     stringPoolSize += ALIGN_UP_2(sizeof(NnString) + strlen(archiveName) + 1); // Archive name.
 
-    // There's three in the file header right out of the gate (assetPointersPtr, dicPtr, and archiveNamePtr).
-    u64 relocationCount = 3;
-    relocationCount += 1 * assetCount; // 1 for every asset block (namePtr).
-
     printf("Constructing dictionary ..");
     fflush(stdout);
 
-    // This implementation won't generate an exactly matching tree as it utilizes internal
-    // nodes. I don't hate it enough to do anything about it
-
-    ConsPtrie dicTrie;
-    PtrieInit(&dicTrie);
+    // Node i + 1 refers to asset i, so no sorting is needed afterwards.
 
+    const char** assetNames = malloc(sizeof(char*) * assetCount);
     for (u32 i = 0; i < assetCount; i++)
-        PtrieInsert(&dicTrie, assets[i].name);
+        assetNames[i] = assets[i].name;
 
-    ConsFlatPtrie dicTrieFlat;
-    PtrieFlatten(&dicTrie, &dicTrieFlat);
+    ConsBuffer dicBuffer;
+    BufferInit(&dicBuffer, NnDicGetSize(assetCount));
 
-    PtrieDestroy(&dicTrie);
+    if (!NnDicBuild((NnDic*)dicBuffer.data_void, assetNames, NULL, assetCount))
+        Panic("BeaBuild: failed to build dictionary (are there duplicate asset names?)");
 
-    // Sort trie.
-    for (u32 i = 0; i < assetCount; i++) {
-        ConsFlatPtrieNode* found = PtrieSearchFlat(&dicTrieFlat, assets[i].name);
-        if (found == NULL) {
-            Panic("BeaBuild: PtrieSearchFlat failed .. something is very wrong");
-        }
-
-        PtrieSwapFlatNode(&dicTrieFlat, i + 1, (found - dicTrieFlat.nodes));
-    }
+    free(assetNames);
 
     printf(" OK\nConstructing binary ..");
     fflush(stdout);
 
-    relocationCount += 1 * (1 + dicTrieFlat.nodeCount); // 1 for every dictionary node (namePtr).
-
     u64 binSize = sizeof(BeaFileHeader);
 
     const u64 assetBlockPointersOffset = binSize;
-    relocationCount += 1 * assetCount; // 1 for every asset block pointer.
 
     binSize += 8 * assetCount; // Asset block pointers.
     binSize += 40 * assetCount; // Unknown zeroed 40 bytes per asset?
 
     const u64 dictionaryOffset = binSize;
-    binSize += sizeof(NnDic) + (sizeof(NnDicNode) * (dicTrieFlat.nodeCount + 1)); // Dictionary.
+    binSize += dicBuffer.size; // Dictionary.
 
     const u64 firstBlockOffset = binSize;
     binSize += sizeof(BeaAssetBlock) * assetCount; // Asset blocks.
@@ -322,25 +536,48 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
     archiveNameOffset += stringPoolOffset;
     assetNamesOffset += stringPoolOffset;
 
+    // Every pointer in the metadata lives in a single section.
+    NnRelocBuilder relocBuilder;
+    NnRelocBuilderInit(&relocBuilder);
+    NnRelocBuilderBeginSection(&relocBuilder, 0, (u32)stringPoolEndOffset);
+
+    // File header.
+    NnRelocBuilderAddPointer(&relocBuilder, offsetof(BeaFileHeader, assetPointersPtr));
+    NnRelocBuilderAddPointer(&relocBuilder, offsetof(BeaFileHeader, dicPtr));
+    NnRelocBuilderAddPointer(&relocBuilder, offsetof(BeaFileHeader, archiveNamePtr));
+
+    // Asset block pointers.
+    for (u32 i = 0; i < assetCount; i++)
+        NnRelocBuilderAddPointer(&relocBuilder, assetBlockPointersOffset + (sizeof(u64) * i));
+
+    // Dictionary nodes (namePtr).
+    const u64 dicNodesOffset = dictionaryOffset + offsetof(NnDic, nodes);
+    for (u32 i = 0; i < assetCount + 1; i++) {
+        NnRelocBuilderAddPointer(
+            &relocBuilder, dicNodesOffset + (sizeof(NnDicNode) * i) + offsetof(NnDicNode, namePtr)
+        );
+    }
+
+    // Asset blocks (filenamePtr).
+    for (u32 i = 0; i < assetCount; i++) {
+        NnRelocBuilderAddPointer(
+            &relocBuilder, firstBlockOffset + (sizeof(BeaAssetBlock) * i) + offsetof(BeaAssetBlock, filenamePtr)
+        );
+    }
+
+    NnRelocBuilderFinalize(&relocBuilder);
+
     // Relocation table needs to be aligned to 8 bytes.
     binSize = ALIGN_UP_8(binSize);
 
     const u64 relocationTableOffset = binSize;
-    binSize += sizeof(NnRelocTable) + sizeof(NnRelocSection) + (sizeof(NnRelocEntry) * relocationCount);
+    binSize += NnRelocBuilderGetSize(&relocBuilder);
 
     if (relocationTableOffset > 0xFFFFFFFF)
         Panic("BeaBuild: reloc table offset exceeds max of 0xFFFFFFFF");
 
     const u64 memoryLoadSize = binSize;
 
-    const u64 dataStartOffset = binSize;
-
-    // Asset data.
-    for (u32 i = 0; i < assetCount; i++) {
-        ConsBuffer* compressedData = ListGet(&compressedDataList, i);
-        binSize += compressedData->size;
-    }
-
     ConsBuffer beaBuffer;
     BufferInit(&beaBuffer, binSize);
 
@@ -383,10 +620,9 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
     for (u32 i = 0; i < assetCount; i++)
         assetPointers[i] = firstBlockOffset + (sizeof(BeaAssetBlock) * i);
 
-    u64 nextDataOffset = dataStartOffset;
     u64 nextAssetNameOffset = assetNamesOffset;
 
-    // Asset blocks, asset data & asset names.
+    // Asset blocks & asset names. The data fields are filled in by _SetAssetData.
     for (u32 i = 0; i < assetCount; i++) {
         const BeaBuildAsset* asset = assets + i;
         BeaAssetBlock* assetBlock = (BeaAssetBlock*)(beaBuffer.data_u8 + assetPointers[i]);
@@ -396,25 +632,10 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
         assetBlock->_00.blockSize = sizeof(BeaAssetBlock);
         assetBlock->_00._reserved = 0x00000000;
 
-        ConsBuffer* compressedData = ListGet(&compressedDataList, i);
-
-        assetBlock->compressionType = (u8)asset->compressionType;
         assetBlock->_pad8 = 0x00;
         assetBlock->alignmentShift = (u16)asset->alignmentShift;
-        assetBlock->dataSize = (u32)compressedData->size;
-        assetBlock->decompressedDataSize = (u32)asset->data.size;
         assetBlock->_reserved = 0x00000000;
 
-        // Move asset data.
-        memcpy(beaBuffer.data_u8 + nextDataOffset, compressedData->data_void, compressedData->size);
-
-        assetBlock->dataOffset = nextDataOffset;
-
-        // Don't bother aligning; this data gets streamed into memory from the file on request.
-        nextDataOffset += compressedData->size;
-
-        BufferDestroy(compressedData);
-
         // Copy asset name.
         NnString* assetName = (NnString*)(beaBuffer.data_u8 + nextAssetNameOffset);
         assetName->len = (u16)strlen(asset->name);
@@ -424,32 +645,20 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
         nextAssetNameOffset += ALIGN_UP_2(sizeof(NnString) + assetName->len + 1);
     }
 
-    // We can clean up compressedDataList; all data has been moved out.
-    ListDestroy(&compressedDataList);
-
     // The dictionary. We handle this after the asset blocks so we can
     // steal the name offsets.
     NnDic* dic = (NnDic*)(beaBuffer.data_u8 + dictionaryOffset);
+    memcpy(dic, dicBuffer.data_void, dicBuffer.size);
 
-    dic->signature = NN__DIC_MAGIC;
-    dic->nodeCount = dicTrieFlat.nodeCount;
-    for (u64 i = 0; i < dicTrieFlat.nodeCount + 1; i++) {
-        dic->nodes[i].refBitPos = (s32)dicTrieFlat.nodes[i].refBit;
-        dic->nodes[i].leftIndex = (u16)dicTrieFlat.nodes[i].leftIndex;
-        dic->nodes[i].rightIndex = (u16)dicTrieFlat.nodes[i].rightIndex;
+    BufferDestroy(&dicBuffer);
 
-        if (i == 0 || i > assetCount) {
-            dic->nodes[i].namePtr = emptyStringOffset;
-        }
-        else {
-            BeaAssetBlock* assetBlock = (BeaAssetBlock*)(beaBuffer.data_u8 + assetPointers[i - 1]);
-            dic->nodes[i].namePtr = assetBlock->filenamePtr;
-        }
+    // The root node points to the empty string.
+    dic->nodes[0].namePtr = emptyStringOffset;
+    for (u32 i = 0; i < assetCount; i++) {
+        BeaAssetBlock* assetBlock = (BeaAssetBlock*)(beaBuffer.data_u8 + assetPointers[i]);
+        dic->nodes[i + 1].namePtr = assetBlock->filenamePtr;
     }
 
-    // We don't need the flat trie anymore, we can get rid of it
-    PtrieDestroyFlat(&dicTrieFlat);
-
     // String pool (really just the block header & misc. strings, we just wrote the asset names).
     NnStringPool* stringPool = (NnStringPool*)(beaBuffer.data_u8 + stringPoolOffset);
 
@@ -470,112 +679,917 @@ ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* arc
     strcpy(currentString->str, archiveName);
 
     // Relocation table.
-    NnRelocTable* relocTable = (NnRelocTable*)(beaBuffer.data_u8 + relocationTableOffset);
-    
-    relocTable->signature = NN__RLT_MAGIC;
-    relocTable->selfOffset = (u32)relocationTableOffset;
-    relocTable->sectionCount = 1;
-    relocTable->_pad32 = 0x00000000;
+    NnRelocBuilderWrite(&relocBuilder, beaBuffer.data_void, relocationTableOffset);
+    NnRelocBuilderDestroy(&relocBuilder);
 
-    NnRelocSection* relocSection = relocTable->sections + 0;
+    printf(" OK\n");
 
-    relocSection->_dataAddress = 0x0000000000000000;
-    relocSection->dataOffset = 0;
-    relocSection->dataSize = (u32)stringPoolEndOffset;
-    relocSection->firstEntryIndex = 0;
-    relocSection->entryCount = (u32)relocationCount;
+#ifdef BEA_BUILD_ENABLE_DIC_TEST
+    printf("Testing dictionary ..");
+    fflush(stdout);
+    for (u32 i = 0; i < assetCount; i++) {
+        const char* targetKey = assets[i].name;
 
-    NnRelocEntry* relocEntriesStart = (NnRelocEntry*)NnRelocTableGetEntries(relocTable);
-    NnRelocEntry* curRelocEntry = relocEntriesStart;
+        const NnDicNode* node = NnDicFind(beaBuffer.data_void, dic, targetKey);
+        if (node == NULL) {
+            Panic("BeaBuild: dic test failed: node with key '%s' not found", targetKey);
+        }
 
-    // First up is the file header.
+        const u32 nodeIndex = (node - dic->nodes) - 1;
+        if (nodeIndex != i) {
+            Panic("BeaBuild: dic test failed: node with key '%s' has wrong index %u (expected %u)", targetKey, nodeIndex, i);
+        }
+    }
+    printf(" OK\n");
+#endif
 
-    // assetPointersPtr
-    curRelocEntry->offsetToPointerList = offsetof(BeaFileHeader, assetPointersPtr);
-    curRelocEntry->pointerListCount = 1;
-    curRelocEntry->pointersPerList = 1;
-    curRelocEntry->pointerListSkip = 0;
+    fflush(stdout);
 
-    curRelocEntry++;
+    return beaBuffer;
+}
 
-    // dicPtr
-    curRelocEntry->offsetToPointerList = offsetof(BeaFileHeader, dicPtr);
-    curRelocEntry->pointerListCount = 1;
-    curRelocEntry->pointersPerList = 1;
-    curRelocEntry->pointerListSkip = 0;
+static void _SetAssetData(
+    ConsBuffer* metadata, u32 assetIndex, BeaCompressionType compressionType,
+    u64 dataOffset, u64 dataSize, u64 decompressedSize
+) {
+    BeaAssetBlock* assetBlock = _IndexAsset(BUFFER_TO_VIEW(*metadata), assetIndex);
 
-    curRelocEntry++;
+    if (dataSize > 0xFFFFFFFF || decompressedSize > 0xFFFFFFFF) {
+        double gibibytes = (double)MAX(dataSize, decompressedSize) / (1024. * 1024. * 1024.);
+        Panic("BeaBuild: asset no. %u data is too big (%.4f gib)", assetIndex+1, gibibytes);
+    }
 
-    // archiveNamePtr
-    curRelocEntry->offsetToPointerList = offsetof(BeaFileHeader, archiveNamePtr);
-    curRelocEntry->pointerListCount = 1;
-    curRelocEntry->pointersPerList = 1;
-    curRelocEntry->pointerListSkip = 0;
+    assetBlock->compressionType = (u8)compressionType;
+    assetBlock->dataOffset = dataOffset;
+    assetBlock->dataSize = (u32)dataSize;
+    assetBlock->decompressedDataSize = (u32)decompressedSize;
+}
 
-    curRelocEntry++;
+// Assets up to this size are trial-compressed whole for BEA_COMPRESSION_TYPE_AUTO.
+#define BEA_BUILD_TRIAL_MAX_SIZE (256 * 1024)
 
-    // The asset block pointers..
-    for (u32 i = 0; i < assetCount; i++) {
-        curRelocEntry->offsetToPointerList = assetBlockPointersOffset + (sizeof(u64) * i);
-        curRelocEntry->pointerListCount = 1;
-        curRelocEntry->pointersPerList = 1;
-        curRelocEntry->pointerListSkip = 0;
+#define BEA_BUILD_SAMPLE_COUNT (4)
+#define BEA_BUILD_SAMPLE_SIZE (32 * 1024)
 
-        curRelocEntry++;
+static const BeaCompressionPolicy _defaultCompressionPolicy = {
+    .minSavings = BEA_COMPRESSION_POLICY_DEFAULT_MIN_SAVINGS,
+    .zlibMinAdvantage = BEA_COMPRESSION_POLICY_DEFAULT_ZLIB_MIN_ADVANTAGE
+};
+
+// Pick a compression type from trial results. zlibSize is UINT64_MAX if zlib wasn't tried.
+static BeaCompressionType _PickCompression(
+    const BeaCompressionPolicy* policy, u64 size, u64 zstdSize, u64 zlibSize
+) {
+    BeaCompressionType type = BEA_COMPRESSION_TYPE_ZSTD;
+    u64 bestSize = zstdSize;
+
+    if ((double)zlibSize <= (double)zstdSize * (1. - policy->zlibMinAdvantage)) {
+        type = BEA_COMPRESSION_TYPE_ZLIB;
+        bestSize = zlibSize;
     }
 
-    // The dictionary nodes..
-    u64 dicNodesOffset = dictionaryOffset + offsetof(NnDic, nodes);
-    for (u32 i = 0; i < dic->nodeCount + 1; i++) {
-        // namePtr
-        curRelocEntry->offsetToPointerList = dicNodesOffset + (sizeof(NnDicNode) * i) + offsetof(NnDicNode, namePtr);        
-        curRelocEntry->pointerListCount = 1;
-        curRelocEntry->pointersPerList = 1;
-        curRelocEntry->pointerListSkip = 0;
+    if ((double)bestSize > (double)size * (1. - policy->minSavings))
+        return BEA_COMPRESSION_TYPE_NONE;
+    return type;
+}
+
+static inline bool _PolicyTriesZlib(const BeaCompressionPolicy* policy) {
+    return policy->zlibMinAdvantage < 1.f;
+}
+
+// Pick a compression type for a large asset by compressing samples spread over it. The samples
+// are read from file if it isn't NULL, otherwise from data.
+static BeaCompressionType _PickCompressionFromSamples(
+    const BeaCompressionPolicy* policy, ConsFile* file, ConsBufferView data, u64 size
+) {
+    ConsBuffer sample;
+    BufferInitUninit(&sample, BEA_BUILD_SAMPLE_SIZE);
+
+    u64 sampledSize = 0;
+    u64 zstdSize = 0;
+    u64 zlibSize = _PolicyTriesZlib(policy) ? 0 : UINT64_MAX;
+
+    for (u32 i = 0; i < BEA_BUILD_SAMPLE_COUNT; i++) {
+        // Evenly spaced, with the first at the start & the last at the end.
+        const u64 sampleOffset = ((size - BEA_BUILD_SAMPLE_SIZE) / (BEA_BUILD_SAMPLE_COUNT - 1)) * i;
+
+        if (file != NULL) {
+            if (!FileReadAt(file, sample.data_void, sampleOffset, BEA_BUILD_SAMPLE_SIZE))
+                break;
+        }
+        else
+            memcpy(sample.data_void, data.data_u8 + sampleOffset, BEA_BUILD_SAMPLE_SIZE);
+
+        ConsBuffer zstdData = CompressZstd(BUFFER_TO_VIEW(sample));
+        zstdSize += zstdData.size;
+        BufferDestroy(&zstdData);
 
-        curRelocEntry++;
+        if (zlibSize != UINT64_MAX) {
+            ConsBuffer zlibData = CompressZlib(BUFFER_TO_VIEW(sample));
+            zlibSize += zlibData.size;
+            BufferDestroy(&zlibData);
+        }
+
+        sampledSize += BEA_BUILD_SAMPLE_SIZE;
     }
 
-    // Finally, the asset blocks.
-    for (u32 i = 0; i < assetCount; i++) {
-        // filenamePtr
-        curRelocEntry->offsetToPointerList = assetPointers[i] + offsetof(BeaAssetBlock, filenamePtr);
-        curRelocEntry->pointerListCount = 1;
-        curRelocEntry->pointersPerList = 1;
-        curRelocEntry->pointerListSkip = 0;
+    BufferDestroy(&sample);
+
+    // Couldn't read the samples; fall back to zstd, the file read proper will report the error.
+    if (sampledSize == 0)
+        return BEA_COMPRESSION_TYPE_ZSTD;
 
-        curRelocEntry++;
+    return _PickCompression(policy, sampledSize, zstdSize, zlibSize);
+}
+
+static ConsBuffer _CompressAs(BeaCompressionType compressionType, ConsBufferView data) {
+    switch (compressionType) {
+    case BEA_COMPRESSION_TYPE_NONE: {
+        ConsBuffer buffer;
+        BufferInitCopyView(&buffer, data);
+        return buffer;
     }
+    case BEA_COMPRESSION_TYPE_ZLIB:
+        return CompressZlib(data);
+    case BEA_COMPRESSION_TYPE_ZSTD:
+        return CompressZstd(data);
+    default:
+        return (ConsBuffer){ 0 };
+    }
+}
 
-    if ((curRelocEntry - relocEntriesStart) > relocationCount) {
-        Panic("BeaBuild: too many relocations written!\n");
+// Compress an asset in memory, resolving BEA_COMPRESSION_TYPE_AUTO. The type used is written to
+// outCompressionType. Ownership belongs to caller.
+static ConsBuffer _CompressAsset(
+    BeaCompressionType compressionType, const BeaCompressionPolicy* policy, ConsBufferView data,
+    BeaCompressionType* outCompressionType
+) {
+    if (compressionType == BEA_COMPRESSION_TYPE_AUTO && data.size > BEA_BUILD_TRIAL_MAX_SIZE)
+        compressionType = _PickCompressionFromSamples(policy, NULL, data, data.size);
+
+    if (compressionType != BEA_COMPRESSION_TYPE_AUTO) {
+        *outCompressionType = compressionType;
+        return _CompressAs(compressionType, data);
     }
-    else if ((curRelocEntry - relocEntriesStart) < relocationCount) {
-        Panic("BeaBuild: too little relocations written!\n");
+
+    // Trial-compress the whole asset & keep the winner.
+    ConsBuffer zstdData = CompressZstd(data);
+    ConsBuffer zlibData = _PolicyTriesZlib(policy) ? CompressZlib(data) : (ConsBuffer){ 0 };
+
+    const u64 zlibSize = BufferIsValid(&zlibData) ? zlibData.size : UINT64_MAX;
+
+    *outCompressionType = _PickCompression(policy, data.size, zstdData.size, zlibSize);
+    switch (*outCompressionType) {
+    case BEA_COMPRESSION_TYPE_ZSTD:
+        BufferDestroy(&zlibData);
+        return zstdData;
+    case BEA_COMPRESSION_TYPE_ZLIB:
+        BufferDestroy(&zstdData);
+        return zlibData;
+    default:
+        BufferDestroy(&zstdData);
+        BufferDestroy(&zlibData);
+        return _CompressAs(BEA_COMPRESSION_TYPE_NONE, data);
     }
+}
 
-    printf(" OK\n");
+// Compress an asset from file to file, through fixed-size buffers.
+static bool _StreamCompressAsset(
+    BeaCompressionType compressionType, ConsFile* inFile, ConsFile* outFile, u64 outOffset,
+    u32 workerCount, u64* outDataSize
+) {
+    switch (compressionType) {
+    case BEA_COMPRESSION_TYPE_NONE: {
+        const u64 chunkCapacity = 1024 * 1024;
+        u8* chunk = malloc(chunkCapacity);
+
+        bool ok = true;
+        for (u64 copiedSize = 0; ok && copiedSize < inFile->size; ) {
+            const u64 chunkSize = MIN(inFile->size - copiedSize, chunkCapacity);
+            ok =
+                FileReadAt(inFile, chunk, copiedSize, chunkSize) &&
+                FileWriteAt(outFile, chunk, outOffset + copiedSize, chunkSize);
+            copiedSize += chunkSize;
+        }
+
+        free(chunk);
+
+        *outDataSize = inFile->size;
+        return ok;
+    }
+    case BEA_COMPRESSION_TYPE_ZLIB:
+        return CompressZlibStream(inFile, 0, inFile->size, outFile, outOffset, outDataSize);
+    case BEA_COMPRESSION_TYPE_ZSTD:
+        return CompressZstdStream(inFile, 0, inFile->size, outFile, outOffset, workerCount, outDataSize);
+    default:
+        return false;
+    }
+}
+
+// Payload layout. Uncompressed payloads are aligned to their declared alignment so they can be
+// used straight from a mapped archive; compressed payloads are always decompressed into a new
+// buffer, so they're left unaligned and used to fill the padding in front of aligned payloads.
+
+typedef struct _PayloadGap {
+    u64 offset;
+    u64 size;
+} _PayloadGap;
+
+VEC_DEFINE(_PayloadGapVec, GapVec, _PayloadGap)
+
+typedef struct _PayloadLayout {
+    u64 end;
+    _PayloadGapVec gaps;
+
+    // Gaps that end further than this behind the end aren't filled anymore; this keeps
+    // payloads that are meant to be read in order close together.
+    u64 gapReach;
+
+    u64 paddingSize; // Total size of the gaps left open.
+} _PayloadLayout;
+
+static void _PayloadLayoutInit(_PayloadLayout* layout, u64 startOffset) {
+    layout->end = startOffset;
+    GapVecInit(&layout->gaps, 16);
+    layout->gapReach = UINT64_MAX;
+    layout->paddingSize = 0;
+}
+
+static void _PayloadLayoutDestroy(_PayloadLayout* layout) {
+    GapVecDestroy(&layout->gaps);
+}
+
+// Always the full alignment the asset block declares, as readers may rely on it.
+static u64 _GetPayloadAlignment(BeaCompressionType compressionType, u32 alignmentShift) {
+    if (compressionType != BEA_COMPRESSION_TYPE_NONE)
+        return 1;
+    return 1ull << (alignmentShift & 63);
+}
+
+// Get the offset for a payload whose size isn't known yet (it's streamed); it always goes at the
+// end. Call _PayloadLayoutSetEnd once the size is known.
+static u64 _PayloadLayoutAppend(_PayloadLayout* layout, u64 alignment) {
+    const u64 offset = ALIGN_UP(layout->end, alignment);
+    if (offset > layout->end) {
+        _PayloadGap gap = { .offset = layout->end, .size = offset - layout->end };
+        GapVecPush(&layout->gaps, gap);
+        layout->paddingSize += gap.size;
+    }
+
+    layout->end = offset;
+    return offset;
+}
+
+static void _PayloadLayoutSetEnd(_PayloadLayout* layout, u64 end) {
+    layout->end = end;
+}
+
+// Get the offset for a payload of a known size: the smallest gap it fits in, or the end.
+static u64 _PayloadLayoutPlace(_PayloadLayout* layout, u64 size, u64 alignment) {
+    // Nothing to align; don't point past the end.
+    if (size == 0)
+        return layout->end;
+
+    s64 bestGapIndex = -1;
+    u64 bestGapSize = UINT64_MAX;
+    for (u64 i = 0; i < layout->gaps.count; i++) {
+        const _PayloadGap* gap = GapVecAt(&layout->gaps, i);
+
+        if (layout->end - (gap->offset + gap->size) > layout->gapReach)
+            continue;
+
+        const u64 alignedOffset = ALIGN_UP(gap->offset, alignment);
+        if (alignedOffset + size <= gap->offset + gap->size && gap->size < bestGapSize) {
+            bestGapIndex = (s64)i;
+            bestGapSize = gap->size;
+        }
+    }
+
+    if (bestGapIndex < 0) {
+        const u64 offset = _PayloadLayoutAppend(layout, alignment);
+        layout->end = offset + size;
+        return offset;
+    }
+
+    const _PayloadGap gap = GapVecGet(&layout->gaps, (u64)bestGapIndex);
+    GapVecRemove(&layout->gaps, (u64)bestGapIndex);
+
+    const u64 offset = ALIGN_UP(gap.offset, alignment);
+
+    // Keep whatever is left on either side.
+    _PayloadGap gapBefore = { .offset = gap.offset, .size = offset - gap.offset };
+    _PayloadGap gapAfter = { .offset = offset + size, .size = (gap.offset + gap.size) - (offset + size) };
+    if (gapBefore.size > 0)
+        GapVecPush(&layout->gaps, gapBefore);
+    if (gapAfter.size > 0)
+        GapVecPush(&layout->gaps, gapAfter);
+
+    layout->paddingSize -= size;
+    return offset;
+}
+
+ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* archiveName) {
+    if (assets == NULL)
+        Panic("BeaBuild: assets is NULL");
+    if (archiveName == NULL)
+        Panic("BeaBuild: archiveName is NULL");
+
+    if (assetCount > 0xFFFF)
+        Panic("BeaBuild: too many assets: exceeds max of 65535!");
+
+    ConsBuffer beaBuffer = _BuildMetadata(assets, assetCount, archiveName);
+
+    _PayloadLayout layout;
+    _PayloadLayoutInit(&layout, beaBuffer.size);
+
+    printf("Compressing assets:\n");
 
-#ifdef BEA_BUILD_ENABLE_DIC_TEST
-    printf("Testing dictionary ..");
-    fflush(stdout);
     for (u32 i = 0; i < assetCount; i++) {
-        const char* targetKey = assets[i].name;
+        const BeaBuildAsset* asset = assets + i;
 
-        const NnDicNode* node = NnDicFind(beaBuffer.data_void, dic, targetKey);
-        if (node == NULL) {
-            Panic("BeaBuild: dic test failed: node with key '%s' not found", targetKey);
+        ConsBuffer loadedData = { 0 };
+        ConsBufferView data = BUFFER_TO_VIEW(asset->data);
+        if (asset->path != NULL) {
+            loadedData = FileLoadMem(asset->path);
+            data = BUFFER_TO_VIEW(loadedData);
         }
 
-        const u32 nodeIndex = (node - dic->nodes) - 1;
-        if (nodeIndex != i) {
-            Panic("BeaBuild: dic test failed: node with key '%s' has wrong index %u (expected %u)", targetKey, nodeIndex, i);
+        if (!BufferViewIsValid(&data))
+            Panic("BeaBuild: asset no. %u ('%s') has an invalid data view", i+1, asset->name);
+
+        _PrintAssetProgress(i, asset->name, data.size);
+
+        BeaCompressionType compressionType;
+        ConsBuffer compressedData = _CompressAsset(
+            asset->compressionType, &_defaultCompressionPolicy, data, &compressionType
+        );
+        if (!BufferIsValid(&compressedData))
+            Panic("BeaBuild: failed to compress asset no. %u ('%s')", i+1, asset->name);
+
+        const u64 dataOffset = _PayloadLayoutPlace(
+            &layout, compressedData.size, _GetPayloadAlignment(compressionType, asset->alignmentShift)
+        );
+        _SetAssetData(&beaBuffer, i, compressionType, dataOffset, compressedData.size, data.size);
+
+        if (layout.end > beaBuffer.size)
+            BufferResize(&beaBuffer, layout.end); // New bytes (padding) are zeroed.
+        memcpy(beaBuffer.data_u8 + dataOffset, compressedData.data_void, compressedData.size);
+
+        BufferDestroy(&compressedData);
+        BufferReleasePooled(&loadedData);
+    }
+
+    _PayloadLayoutDestroy(&layout);
+
+    return beaBuffer;
+}
+
+// Assets read from a file at least this large are streamed (with zstd spreading each one over
+// every job); smaller ones are compressed in memory, one per job.
+#define BEA_BUILD_LARGE_ASSET_SIZE (32 * 1024 * 1024)
+
+// Compressed small assets that may wait for the writer, per job.
+#define BEA_BUILD_RESULTS_PER_JOB (4)
+
+// How far back a payload may be moved to fill a gap when the data order is given.
+#define BEA_BUILD_ORDERED_GAP_REACH (64 * 1024)
+
+// Threads reading small assets ahead of the jobs that compress them. They mostly wait on I/O,
+// so they aren't counted as jobs.
+#define BEA_BUILD_LOADER_COUNT (4)
+
+typedef enum _BuildLoadState {
+    BUILD_LOAD_STATE_PENDING,
+    BUILD_LOAD_STATE_LOADING,
+    BUILD_LOAD_STATE_LOADED
+} _BuildLoadState;
+
+typedef struct _BuildQueue {
+    const BeaBuildAsset* assets;
+    const BeaCompressionPolicy* compressionPolicy;
+
+    const u32* assetIndices;
+    const bool* isLarge; // Large assets are streamed by the writer, not by the workers.
+    u32 count;
+
+    ConsBuffer* compressedData;
+    BeaCompressionType* compressionTypes;
+    u64* decompressedSizes;
+    bool* isDone;
+
+    ConsBuffer* loadedData;
+    _BuildLoadState* loadStates;
+    u32 nextLoad;
+
+    u32 nextJob; // Next job to hand to the pool (only touched by the writer).
+    u32 writtenJobs;
+    u32 maxPendingJobs;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_cond_t loadCond; // Loaders wait here for the writer to make room.
+} _BuildQueue;
+
+static bool _BuildJobNeedsLoad(const _BuildQueue* queue, u32 job) {
+    return !queue->isLarge[job] && queue->assets[queue->assetIndices[job]].path != NULL;
+}
+
+static void* _BuildLoader(void* userData) {
+    _BuildQueue* queue = userData;
+
+    pthread_mutex_lock(&queue->mutex);
+
+    while (true) {
+        // Skip jobs that read nothing, or that a worker already picked up.
+        while (
+            queue->nextLoad < queue->count &&
+            (!_BuildJobNeedsLoad(queue, queue->nextLoad) || queue->loadStates[queue->nextLoad] != BUILD_LOAD_STATE_PENDING)
+        )
+            queue->nextLoad++;
+
+        if (queue->nextLoad >= queue->count)
+            break;
+
+        // Only load what the workers are allowed to compress, to keep memory use bounded.
+        if (queue->nextLoad >= queue->writtenJobs + queue->maxPendingJobs) {
+            pthread_cond_wait(&queue->loadCond, &queue->mutex);
+            continue;
         }
+
+        const u32 job = queue->nextLoad++;
+        queue->loadStates[job] = BUILD_LOAD_STATE_LOADING;
+
+        pthread_mutex_unlock(&queue->mutex);
+
+        ConsBuffer data = FileLoadMem(queue->assets[queue->assetIndices[job]].path);
+
+        pthread_mutex_lock(&queue->mutex);
+
+        queue->loadedData[job] = data;
+        queue->loadStates[job] = BUILD_LOAD_STATE_LOADED;
+
+        pthread_cond_broadcast(&queue->cond);
     }
-    printf(" OK\n");
-#endif
 
+    pthread_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+// Take a job's data from the loaders, or load it here if they haven't got to it yet.
+static ConsBuffer _BuildTakeLoadedData(_BuildQueue* queue, u32 job) {
+    pthread_mutex_lock(&queue->mutex);
+
+    if (queue->loadStates[job] == BUILD_LOAD_STATE_PENDING) {
+        queue->loadStates[job] = BUILD_LOAD_STATE_LOADING;
+        pthread_mutex_unlock(&queue->mutex);
+
+        return FileLoadMem(queue->assets[queue->assetIndices[job]].path);
+    }
+
+    while (queue->loadStates[job] != BUILD_LOAD_STATE_LOADED)
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+
+    ConsBuffer data = queue->loadedData[job];
+    queue->loadedData[job] = (ConsBuffer){ 0 };
+
+    pthread_mutex_unlock(&queue->mutex);
+    return data;
+}
+
+typedef struct _BuildTask {
+    _BuildQueue* queue;
+    u32 job;
+} _BuildTask;
+
+// Compress one small asset (a pool task).
+static void _BuildCompressTask(void* userData) {
+    const _BuildTask* task = userData;
+    _BuildQueue* queue = task->queue;
+    const u32 job = task->job;
+
+    const u32 i = queue->assetIndices[job];
+    const BeaBuildAsset* asset = queue->assets + i;
+
+    ConsBuffer loadedData = { 0 };
+    ConsBufferView data = BUFFER_TO_VIEW(asset->data);
+    if (asset->path != NULL) {
+        loadedData = _BuildTakeLoadedData(queue, job);
+        data = BUFFER_TO_VIEW(loadedData);
+    }
+
+    if (!BufferViewIsValid(&data))
+        Panic("BeaBuild: asset no. %u ('%s') has an invalid data view", i+1, asset->name);
+
+    BeaCompressionType compressionType;
+    ConsBuffer compressedData = _CompressAsset(
+        asset->compressionType, queue->compressionPolicy, data, &compressionType
+    );
+    if (!BufferIsValid(&compressedData))
+        Panic("BeaBuild: failed to compress asset no. %u ('%s')", i+1, asset->name);
+
+    BufferReleasePooled(&loadedData);
+
+    pthread_mutex_lock(&queue->mutex);
+
+    queue->compressedData[job] = compressedData;
+    queue->compressionTypes[job] = compressionType;
+    queue->decompressedSizes[job] = data.size;
+    queue->isDone[job] = true;
+
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+// Hand the pool small assets to compress, as far ahead of the writer as memory use allows. Large
+// assets are left to the writer.
+static void _BuildSubmitJobs(
+    _BuildQueue* queue, _BuildTask* tasks, ConsThreadPool* threadPool, ConsTaskGroup* group
+) {
+    while (queue->nextJob < queue->count && queue->nextJob < queue->writtenJobs + queue->maxPendingJobs) {
+        const u32 job = queue->nextJob++;
+        if (queue->isLarge[job])
+            continue;
+
+        tasks[job].queue = queue;
+        tasks[job].job = job;
+        ThreadPoolSubmit(threadPool, group, _BuildCompressTask, tasks + job);
+    }
+}
+
+typedef struct _CompressionReportEntry {
+    char extension[16];
+    u32 assetCounts[BEA_COMPRESSION_TYPE_COUNT];
+    u64 size;
+    u64 storedSize;
+} _CompressionReportEntry;
+
+VEC_DEFINE(_CompressionReport, ReportVec, _CompressionReportEntry)
+
+static void _AddToCompressionReport(
+    _CompressionReport* report, const char* name, BeaCompressionType compressionType, u64 size, u64 storedSize
+) {
+    const char* lastSlash = strrchr(name, '/');
+    const char* extension = strrchr((lastSlash != NULL) ? lastSlash : name, '.');
+    if (extension == NULL)
+        extension = "(none)";
+
+    _CompressionReportEntry* entry = NULL;
+    for (u64 i = 0; i < report->count; i++) {
+        _CompressionReportEntry* currentEntry = ReportVecAt(report, i);
+        if (strncmp(currentEntry->extension, extension, sizeof(currentEntry->extension) - 1) == 0) {
+            entry = currentEntry;
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        _CompressionReportEntry newEntry = { 0 };
+        strncpy(newEntry.extension, extension, sizeof(newEntry.extension) - 1);
+
+        ReportVecPush(report, newEntry);
+        entry = ReportVecAt(report, report->count - 1);
+    }
+
+    entry->assetCounts[compressionType]++;
+    entry->size += size;
+    entry->storedSize += storedSize;
+}
+
+static void _PrintCompressionReportLine(const _CompressionReportEntry* entry) {
+    const double savedPercent = (entry->size != 0) ?
+        (1. - (double)entry->storedSize / (double)entry->size) * 100. : 0.;
+
+    printf(
+        "    %-12s %6u %6u %6u %14llu %14llu %6.1f%%\n",
+        entry->extension,
+        entry->assetCounts[BEA_COMPRESSION_TYPE_NONE],
+        entry->assetCounts[BEA_COMPRESSION_TYPE_ZLIB],
+        entry->assetCounts[BEA_COMPRESSION_TYPE_ZSTD],
+        (unsigned long long)entry->size, (unsigned long long)entry->storedSize, savedPercent
+    );
+}
+
+static void _PrintCompressionReport(_CompressionReport* report) {
+    printf(
+        "Compression report:\n    %-12s %6s %6s %6s %14s %14s %7s\n",
+        "type", "none", "zlib", "zstd", "size", "stored", "saved"
+    );
+
+    _CompressionReportEntry total = { .extension = "total" };
+    for (u64 i = 0; i < report->count; i++) {
+        const _CompressionReportEntry* entry = ReportVecAt(report, i);
+        _PrintCompressionReportLine(entry);
+
+        for (u32 j = 0; j < BEA_COMPRESSION_TYPE_COUNT; j++)
+            total.assetCounts[j] += entry->assetCounts[j];
+        total.size += entry->size;
+        total.storedSize += entry->storedSize;
+    }
+
+    _PrintCompressionReportLine(&total);
     fflush(stdout);
+}
 
-    return beaBuffer;
+bool BeaBuildToFile(
+    const BeaBuildAsset* assets, u32 assetCount, const char* archiveName, const char* path,
+    const BeaBuildOptions* options
+) {
+    if (assets == NULL)
+        Panic("BeaBuild: assets is NULL");
+    if (archiveName == NULL)
+        Panic("BeaBuild: archiveName is NULL");
+
+    if (assetCount > 0xFFFF)
+        Panic("BeaBuild: too many assets: exceeds max of 65535!");
+
+    // One job per pool thread.
+    ConsThreadPool ownThreadPool;
+    ConsThreadPool* threadPool = (options != NULL) ? options->threadPool : NULL;
+    if (threadPool == NULL) {
+        ThreadPoolInit(&ownThreadPool, 0);
+        threadPool = &ownThreadPool;
+    }
+
+    const u32 jobCount = threadPool->threadCount;
+    const BeaCompressionPolicy* compressionPolicy = (options != NULL && options->compressionPolicy != NULL) ?
+        options->compressionPolicy : &_defaultCompressionPolicy;
+
+    _CompressionReport report;
+    ReportVecInit(&report, 16);
+
+    ConsBuffer metadata = _BuildMetadata(assets, assetCount, archiveName);
+
+    ConsFile outFile;
+    if (!FileOpenWrite(&outFile, path)) {
+        BufferDestroy(&metadata);
+        ReportVecDestroy(&report);
+        if (threadPool == &ownThreadPool)
+            ThreadPoolDestroy(&ownThreadPool);
+        return false;
+    }
+
+    // The payloads are laid out in data order (asset order unless given). Large assets are
+    // streamed one at a time using every job, small ones are compressed side by side (one per job)
+    // ahead of the writer.
+    u32* jobAssetIndices = malloc(sizeof(u32) * MAX(assetCount, 1u));
+    bool* jobIsLarge = malloc(sizeof(bool) * MAX(assetCount, 1u));
+    bool* isAssetQueued = calloc(MAX(assetCount, 1u), sizeof(bool));
+
+    const u32* dataOrder = (options != NULL) ? options->dataOrder : NULL;
+
+    for (u32 j = 0; j < assetCount; j++) {
+        const u32 i = (dataOrder != NULL) ? dataOrder[j] : j;
+        if (i >= assetCount || isAssetQueued[i])
+            Panic("BeaBuild: data order is not a permutation of the assets");
+        isAssetQueued[i] = true;
+
+        u64 size = 0;
+        if (assets[i].path != NULL && !FileGetInfo(assets[i].path, &size, NULL))
+            Panic("BeaBuild: failed to open asset no. %u ('%s') at path '%s'", i+1, assets[i].name, assets[i].path);
+
+        jobAssetIndices[j] = i;
+        jobIsLarge[j] = assets[i].path != NULL && size >= BEA_BUILD_LARGE_ASSET_SIZE;
+    }
+
+    free(isAssetQueued);
+
+    printf("Compressing assets (%u jobs):\n", jobCount);
+
+    // The asset data goes after the metadata, which is written last (once the data fields are known).
+    // Gaps left by the layout are never written, so they read back as zeroes.
+    _PayloadLayout layout;
+    _PayloadLayoutInit(&layout, metadata.size);
+
+    // With an explicit order, don't move payloads far back to fill a gap.
+    if (dataOrder != NULL)
+        layout.gapReach = BEA_BUILD_ORDERED_GAP_REACH;
+
+    _BuildQueue queue;
+    queue.assets = assets;
+    queue.compressionPolicy = compressionPolicy;
+    queue.assetIndices = jobAssetIndices;
+    queue.isLarge = jobIsLarge;
+    queue.count = assetCount;
+
+    queue.compressedData = calloc(MAX(assetCount, 1u), sizeof(ConsBuffer));
+    queue.compressionTypes = calloc(MAX(assetCount, 1u), sizeof(BeaCompressionType));
+    queue.decompressedSizes = calloc(MAX(assetCount, 1u), sizeof(u64));
+    queue.isDone = calloc(MAX(assetCount, 1u), sizeof(bool));
+
+    queue.loadedData = calloc(MAX(assetCount, 1u), sizeof(ConsBuffer));
+    queue.loadStates = calloc(MAX(assetCount, 1u), sizeof(_BuildLoadState)); // All pending.
+    queue.nextLoad = 0;
+
+    queue.nextJob = 0;
+    queue.writtenJobs = 0;
+    queue.maxPendingJobs = jobCount * BEA_BUILD_RESULTS_PER_JOB;
+
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.cond, NULL);
+    pthread_cond_init(&queue.loadCond, NULL);
+
+    // Every small asset is a task on the pool; this thread hands them out & writes.
+    _BuildTask* tasks = malloc(sizeof(_BuildTask) * MAX(assetCount, 1u));
+
+    ConsTaskGroup compressGroup;
+    TaskGroupInit(&compressGroup);
+
+    // Small assets are read ahead by the loaders while the workers compress, so reading and
+    // compressing overlap even when there are as many jobs as CPUs. They block on I/O, so they
+    // get their own threads instead of holding up pool threads.
+    const u32 loaderCount = MIN((u32)BEA_BUILD_LOADER_COUNT, assetCount);
+    pthread_t* loaders = malloc(sizeof(pthread_t) * MAX(loaderCount, 1u));
+    for (u32 l = 0; l < loaderCount; l++) {
+        if (pthread_create(loaders + l, NULL, _BuildLoader, &queue) != 0)
+            Panic("BeaBuild: failed to create loader thread");
+    }
+
+    bool ok = true;
+
+    // Write the payloads in order as they come in.
+    for (u32 j = 0; j < assetCount; j++) {
+        const u32 i = jobAssetIndices[j];
+        const BeaBuildAsset* asset = assets + i;
+
+        if (jobIsLarge[j] && ok) {
+            // zstd uses every job for a large asset: let the small assets handed out so far
+            // finish first (helping with them), and hand out no more until it's written.
+            ThreadPoolWait(threadPool, &compressGroup);
+
+            ConsFile inFile;
+            if (!FileOpenRead(&inFile, asset->path))
+                Panic("BeaBuild: failed to open asset no. %u ('%s') at path '%s'", i+1, asset->name, asset->path);
+
+            _PrintAssetProgress(i, asset->name, inFile.size);
+
+            BeaCompressionType compressionType = asset->compressionType;
+            if (compressionType == BEA_COMPRESSION_TYPE_AUTO) {
+                compressionType = _PickCompressionFromSamples(
+                    compressionPolicy, &inFile, (ConsBufferView){ 0 }, inFile.size
+                );
+            }
+
+            // Streamed payloads go at the end; only uncompressed ones are aligned.
+            const u64 dataOffset = _PayloadLayoutAppend(
+                &layout, _GetPayloadAlignment(compressionType, asset->alignmentShift)
+            );
+
+            u64 dataSize;
+            ok = _StreamCompressAsset(compressionType, &inFile, &outFile, dataOffset, jobCount, &dataSize);
+            if (ok) {
+                _PayloadLayoutSetEnd(&layout, dataOffset + dataSize);
+
+                _SetAssetData(&metadata, i, compressionType, dataOffset, dataSize, inFile.size);
+                _AddToCompressionReport(&report, asset->name, compressionType, inFile.size, dataSize);
+            }
+
+            FileClose(&inFile);
+        }
+        else if (!jobIsLarge[j]) {
+            _BuildSubmitJobs(&queue, tasks, threadPool, &compressGroup);
+
+            pthread_mutex_lock(&queue.mutex);
+            while (!queue.isDone[j])
+                pthread_cond_wait(&queue.cond, &queue.mutex);
+            pthread_mutex_unlock(&queue.mutex);
+
+            ConsBuffer* compressedData = queue.compressedData + j;
+
+            _PrintAssetProgress(i, asset->name, queue.decompressedSizes[j]);
+
+            if (ok) {
+                const u64 dataOffset = _PayloadLayoutPlace(
+                    &layout, compressedData->size,
+                    _GetPayloadAlignment(queue.compressionTypes[j], asset->alignmentShift)
+                );
+
+                ok = FileWriteAt(&outFile, compressedData->data_void, dataOffset, compressedData->size);
+                if (ok) {
+                    _SetAssetData(
+                        &metadata, i, queue.compressionTypes[j],
+                        dataOffset, compressedData->size, queue.decompressedSizes[j]
+                    );
+                    _AddToCompressionReport(
+                        &report, asset->name, queue.compressionTypes[j],
+                        queue.decompressedSizes[j], compressedData->size
+                    );
+                }
+            }
+
+            BufferDestroy(compressedData);
+        }
+
+        pthread_mutex_lock(&queue.mutex);
+        queue.writtenJobs++;
+        pthread_cond_broadcast(&queue.loadCond);
+        pthread_mutex_unlock(&queue.mutex);
+    }
+
+    ThreadPoolWait(threadPool, &compressGroup);
+    free(tasks);
+
+    for (u32 l = 0; l < loaderCount; l++)
+        pthread_join(loaders[l], NULL);
+    free(loaders);
+
+    pthread_cond_destroy(&queue.loadCond);
+    pthread_cond_destroy(&queue.cond);
+    pthread_mutex_destroy(&queue.mutex);
+
+    free(queue.loadStates);
+    free(queue.loadedData);
+
+    free(queue.isDone);
+    free(queue.decompressedSizes);
+    free(queue.compressionTypes);
+    free(queue.compressedData);
+
+    free(jobIsLarge);
+    free(jobAssetIndices);
+
+    if (ok)
+        ok = FileWriteAt(&outFile, metadata.data_void, 0, metadata.size);
+
+    FileClose(&outFile);
+    BufferDestroy(&metadata);
+
+    if (ok) {
+        _PrintCompressionReport(&report);
+        printf("Alignment padding: %llu bytes\n", (unsigned long long)layout.paddingSize);
+    }
+    ReportVecDestroy(&report);
+    _PayloadLayoutDestroy(&layout);
+
+    if (threadPool == &ownThreadPool)
+        ThreadPoolDestroy(&ownThreadPool);
+
+    return ok;
+}
+
+typedef struct _TraceName {
+    const char* name;
+    u32 nameLen;
+    u32 assetIndex;
+} _TraceName;
+
+static int _CompareTraceNames(const void* a, const void* b) {
+    const _TraceName* nameA = a;
+    const _TraceName* nameB = b;
+
+    const int cmp = memcmp(nameA->name, nameB->name, MIN(nameA->nameLen, nameB->nameLen));
+    if (cmp != 0)
+        return cmp;
+    return (nameA->nameLen > nameB->nameLen) - (nameA->nameLen < nameB->nameLen);
+}
+
+u32 BeaBuildGetTraceOrder(
+    const BeaBuildAsset* assets, u32 assetCount, ConsBufferView trace, u32* outDataOrder
+) {
+    _TraceName* names = malloc(sizeof(_TraceName) * MAX(assetCount, 1u));
+    for (u32 i = 0; i < assetCount; i++) {
+        names[i].name = assets[i].name;
+        names[i].nameLen = (u32)strlen(assets[i].name);
+        names[i].assetIndex = i;
+    }
+    qsort(names, assetCount, sizeof(_TraceName), _CompareTraceNames);
+
+    bool* isOrdered = calloc(MAX(assetCount, 1u), sizeof(bool));
+    u32 orderedCount = 0;
+
+    const char* traceEnd = trace.data_char + trace.size;
+    for (const char* line = trace.data_char; line < traceEnd; ) {
+        const char* lineEnd = memchr(line, '\n', traceEnd - line);
+        if (lineEnd == NULL)
+            lineEnd = traceEnd;
+
+        const char* nextLine = lineEnd + 1;
+
+        if (lineEnd > line && lineEnd[-1] == '\r')
+            lineEnd--;
+
+        if (lineEnd > line && *line != '#') {
+            const _TraceName key = { .name = line, .nameLen = (u32)(lineEnd - line) };
+            const _TraceName* found = bsearch(&key, names, assetCount, sizeof(_TraceName), _CompareTraceNames);
+
+            if (found != NULL && !isOrdered[found->assetIndex]) {
+                isOrdered[found->assetIndex] = true;
+                outDataOrder[orderedCount++] = found->assetIndex;
+            }
+        }
+
+        line = nextLine;
+    }
+
+    const u32 tracedCount = orderedCount;
+
+    // Everything that wasn't traced keeps its relative order.
+    for (u32 i = 0; i < assetCount; i++) {
+        if (!isOrdered[i])
+            outDataOrder[orderedCount++] = i;
+    }
+
+    free(isOrdered);
+    free(names);
+
+    return tracedCount;
 }
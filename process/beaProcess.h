@@ -2,6 +2,9 @@
 #define BEA_PROCESS_H
 
 #include "../cons/buffer.h"
+#include "../cons/bulkwrite.h"
+#include "../cons/file.h"
+#include "../cons/threadpool.h"
 
 #include "nnBin.h"
 
@@ -10,11 +13,24 @@ typedef enum BeaCompressionType {
     BEA_COMPRESSION_TYPE_ZLIB = 1,
     BEA_COMPRESSION_TYPE_ZSTD = 2,
 
-    BEA_COMPRESSION_TYPE_COUNT = 3
+    BEA_COMPRESSION_TYPE_COUNT = 3,
+
+    // Only for building: pick one of the above per asset (see BeaCompressionPolicy).
+    BEA_COMPRESSION_TYPE_AUTO = 0xFF
 } BeaCompressionType;
 
 void BeaPreprocess(ConsBufferView beaData);
 
+// Load only the metadata region of a BEA archive (everything up to memoryLoadSize); the asset
+// data is left on disk. The returned buffer works with every accessor except the data getters.
+// Returns an invalid buffer on failure.
+ConsBuffer BeaLoadMetadata(const char* path);
+
+// Relocate the archive metadata in place. Afterwards the accessors follow the stored pointers
+// directly instead of treating them as offsets. beaData must be writable (see FileMapMem).
+// Returns true on success, false if the relocation table is invalid (nothing is relocated then).
+bool BeaRelocate(ConsBufferView beaData);
+
 // Ownership belongs to beaData.
 NnString* BeaGetArchiveName(ConsBufferView beaData);
 
@@ -30,19 +46,101 @@ BeaCompressionType BeaGetAssetCompressionType(ConsBufferView beaData, u32 assetI
 u64 BeaGetAssetAlignment(ConsBufferView beaData, u32 assetIndex);
 u32 BeaGetAssetCompressedSize(ConsBufferView beaData, u32 assetIndex);
 u32 BeaGetAssetDecompressedSize(ConsBufferView beaData, u32 assetIndex);
+// Offset of the (compressed) data, relative to the start of the archive.
+u64 BeaGetAssetDataOffset(ConsBufferView beaData, u32 assetIndex);
 
 // Ownership belongs to beaData.
 ConsBufferView BeaGetCompressedData(ConsBufferView beaData, u32 assetIndex);
 // Ownership belongs to caller.
 ConsBuffer BeaGetDecompressedData(ConsBufferView beaData, u32 assetIndex);
 
+// Get the asset indices ordered by the position of their data in the archive.
+// outAssetIndices must hold BeaGetAssetCount entries.
+void BeaGetDataOrder(ConsBufferView beaData, u32* outAssetIndices);
+
+// A BEA archive that's read on demand: only the metadata region is kept in memory, and asset
+// data is read from the file when requested. Reads are served from a read-ahead window, so
+// walking the assets in data order (see BeaGetDataOrder) turns into a few large sequential reads.
+typedef struct BeaFile {
+    ConsFile file;
+    ConsBuffer metadata; // Relocated metadata region; use it with the accessors above.
+
+    ConsBuffer _window;
+    u64 _windowOffset;
+    u64 _windowSize;
+} BeaFile;
+
+// Returns true on success, false on failure.
+bool BeaFileOpen(BeaFile* beaFile, const char* path);
+void BeaFileClose(BeaFile* beaFile);
+
+static inline ConsBufferView BeaFileGetMetadata(const BeaFile* beaFile) {
+    return BUFFER_TO_VIEW(beaFile->metadata);
+}
+
+// Ownership belongs to beaFile; the view is valid until the next read from beaFile.
+ConsBufferView BeaFileReadCompressedData(BeaFile* beaFile, u32 assetIndex);
+// Ownership belongs to caller.
+ConsBuffer BeaFileReadDecompressedData(BeaFile* beaFile, u32 assetIndex);
+
+// Decompress an asset into a file. Large assets are streamed through fixed-size buffers, so peak
+// memory use doesn't depend on the asset size. If a bulk writer is given, small assets are queued
+// on it (their write errors are reported by BulkWriterFlush) and parent directories are created.
+// Returns true on success, false on failure.
+bool BeaFileExtractAsset(BeaFile* beaFile, u32 assetIndex, const char* path, ConsBulkWriter* writer);
+
 typedef struct BeaBuildAsset {
     const char* name; // Not owned by this structure.
     u32 alignmentShift; // Alignment is 1 << alignmentShift.
     ConsBuffer data;
+    // If not NULL, the data is read from this file instead of data. Not owned by this structure.
+    const char* path;
     BeaCompressionType compressionType;
 } BeaBuildAsset;
 
 ConsBuffer BeaBuild(const BeaBuildAsset* assets, u32 assetCount, const char* archiveName);
 
+// How BEA_COMPRESSION_TYPE_AUTO picks a compression type. Small assets are trial-compressed
+// whole; larger ones are judged on a few samples spread over the data.
+typedef struct BeaCompressionPolicy {
+    // Compression has to save at least this fraction of the size, or the asset is stored as-is
+    // (already compressed media would only cost decode time).
+    float minSavings;
+    // zlib decodes several times slower than zstd, so it's only picked if its output is at least
+    // this fraction smaller than zstd's. 1 or above never tries zlib.
+    float zlibMinAdvantage;
+} BeaCompressionPolicy;
+
+#define BEA_COMPRESSION_POLICY_DEFAULT_MIN_SAVINGS (0.05f)
+#define BEA_COMPRESSION_POLICY_DEFAULT_ZLIB_MIN_ADVANTAGE (0.10f)
+
+typedef struct BeaBuildOptions {
+    // Runs the compression jobs (one per thread). NULL creates a pool for the build.
+    ConsThreadPool* threadPool;
+    const BeaCompressionPolicy* compressionPolicy; // NULL uses the defaults.
+
+    // Order to lay the asset data out in, as a permutation of the asset indices (see
+    // BeaBuildGetTraceOrder). NULL keeps the asset order. The asset order itself (and with it
+    // the dictionary) is never changed.
+    const u32* dataOrder;
+} BeaBuildOptions;
+
+// Build an archive straight into a file. Assets with a path are streamed through fixed-size
+// buffers, so memory use doesn't depend on the asset sizes. Large assets are compressed one at
+// a time using every job; the rest are compressed side by side, one per job. options may be NULL.
+// Prints a report of the savings per file extension when done.
+// Returns true on success, false on failure.
+bool BeaBuildToFile(
+    const BeaBuildAsset* assets, u32 assetCount, const char* archiveName, const char* path,
+    const BeaBuildOptions* options
+);
+
+// Get a data order from an access trace: a text file listing asset names (one per line) in the
+// order they're read. Lines starting with '#' are ignored, as are unknown names & repeats. Assets
+// missing from the trace follow in asset order. outDataOrder must hold assetCount entries.
+// Returns the amount of assets that were found in the trace.
+u32 BeaBuildGetTraceOrder(
+    const BeaBuildAsset* assets, u32 assetCount, ConsBufferView trace, u32* outDataOrder
+);
+
 #endif
@@ -106,7 +106,7 @@ typedef struct __attribute__((packed)) {
     u64 _unk98; // Relocated offset to ?
 } BntxTextureBlock;
 
-void BntxPreprocess(ConsBuffer bntxData) {
+void BntxPreprocess(ConsBufferView bntxData) {
     const BntxFileHeader* fileHeader = bntxData.data_void;
 
     if (fileHeader->_00.identifier != BNTX_ID)
@@ -129,48 +129,54 @@ void BntxPreprocess(ConsBuffer bntxData) {
         Panic("BntxPreprocess: texture count is zero");
 }
 
-const char* BntxGetTextureGroupName(ConsBuffer bntxData) {
+bool BntxRelocate(ConsBufferView bntxData) {
+    return NnRelocTableApply(bntxData.data_void, bntxData.size);
+}
+
+const char* BntxGetTextureGroupName(ConsBufferView bntxData) {
     const BntxFileHeader* fileHeader = bntxData.data_void;
 
     return (const char*)(bntxData.data_u8 + fileHeader->_00.filenameOffset);
 }
 
-u32 BntxGetTextureCount(ConsBuffer bntxData) {
+u32 BntxGetTextureCount(ConsBufferView bntxData) {
     const BntxFileHeader* fileHeader = bntxData.data_void;
 
     return fileHeader->_20.textureCount;
 }
 
-s64 BntxFindTextureIndex(ConsBuffer bntxData, const char* textureName) {
+s64 BntxFindTextureIndex(ConsBufferView bntxData, const char* textureName) {
     const BntxFileHeader* fileHeader = bntxData.data_void;
-    const NnDic* dic = (NnDic*)(bntxData.data_u8 + fileHeader->_20.dicPtr);
+    const NnDic* dic = (NnDic*)NnBinResolvePtr(bntxData.data_void, fileHeader->_20.dicPtr);
 
-    const NnDicNode* node = NnDicFind(bntxData.data_void, dic, textureName);
+    const NnDicNode* node = NnDicFind(
+        NnFileHeaderIsRelocated(&fileHeader->_00) ? NULL : bntxData.data_void, dic, textureName
+    );
     if (node == NULL)
         return -1;
 
     return (s64)NnDicNodeGetIndex(dic, node);
 }
 
-static BntxTextureBlock* _IndexTexture(ConsBuffer bntxData, u32 textureIndex) {
+static BntxTextureBlock* _IndexTexture(ConsBufferView bntxData, u32 textureIndex) {
     const BntxFileHeader* fileHeader = bntxData.data_void;
     if (textureIndex >= fileHeader->_20.textureCount)
         return NULL;
 
-    u64* texturePointers = (u64*)(bntxData.data_u8 + fileHeader->_20.texturePointersPtr);
+    u64* texturePointers = (u64*)NnBinResolvePtr(bntxData.data_void, fileHeader->_20.texturePointersPtr);
 
-    return (BntxTextureBlock*)(bntxData.data_u8 + texturePointers[textureIndex]);
+    return (BntxTextureBlock*)NnBinResolvePtr(bntxData.data_void, texturePointers[textureIndex]);
 }
 
-NnString* BntxGetTextureName(ConsBuffer bntxData, u32 textureIndex) {
+NnString* BntxGetTextureName(ConsBufferView bntxData, u32 textureIndex) {
     BntxTextureBlock* texture = _IndexTexture(bntxData, textureIndex);
     if (texture == NULL)
         return NULL;
 
-    return (NnString*)(bntxData.data_u8 + texture->namePtr);
+    return (NnString*)NnBinResolvePtr(bntxData.data_void, texture->namePtr);
 }
 
-u32 BntxGetTextureFormat(ConsBuffer bntxData, u32 textureIndex) {
+u32 BntxGetTextureFormat(ConsBufferView bntxData, u32 textureIndex) {
     BntxTextureBlock* texture = _IndexTexture(bntxData, textureIndex);
     if (texture == NULL)
         return 0;
@@ -178,7 +184,7 @@ u32 BntxGetTextureFormat(ConsBuffer bntxData, u32 textureIndex) {
     return texture->imageFormat;
 }
 
-u32 BntxGetTextureTileMode(ConsBuffer bntxData, u32 textureIndex) {
+u32 BntxGetTextureTileMode(ConsBufferView bntxData, u32 textureIndex) {
     BntxTextureBlock* texture = _IndexTexture(bntxData, textureIndex);
     if (texture == NULL)
         return 0;
@@ -186,20 +192,20 @@ u32 BntxGetTextureTileMode(ConsBuffer bntxData, u32 textureIndex) {
     return texture->tileMode;
 }
 
-u32 BntxGetTextureWidth(ConsBuffer bntxData, u32 textureIndex) {
+u32 BntxGetTextureWidth(ConsBufferView bntxData, u32 textureIndex) {
     BntxTextureBlock* texture = _IndexTexture(bntxData, textureIndex);
     if (texture == NULL)
         return 0;
     return texture->width;
 }
-u32 BntxGetTextureHeight(ConsBuffer bntxData, u32 textureIndex) {
+u32 BntxGetTextureHeight(ConsBufferView bntxData, u32 textureIndex) {
     BntxTextureBlock* texture = _IndexTexture(bntxData, textureIndex);
     if (texture == NULL)
         return 0;
     return texture->height;
 }
 
-ConsBuffer BntxDecodeTexture(ConsBuffer bntxData, u32 textureIndex) {
+ConsBuffer BntxDecodeTexture(ConsBufferView bntxData, u32 textureIndex) {
     BntxTextureBlock* texture = _IndexTexture(bntxData, textureIndex);
     if (texture == NULL)
         return (ConsBuffer){ 0 };
@@ -207,10 +213,10 @@ ConsBuffer BntxDecodeTexture(ConsBuffer bntxData, u32 textureIndex) {
     ConsBuffer buffer;
     BufferInit(&buffer, texture->width * texture->height * 4);
 
-    u64* dataPointers = (u64*)(bntxData.data_u8 + texture->dataPointersPtr);
+    u64* dataPointers = (u64*)NnBinResolvePtr(bntxData.data_void, texture->dataPointersPtr);
 
     ConsBufferView swizzledView = BufferViewFromPtr(
-        bntxData.data_u8 + dataPointers[0], texture->dataSize
+        NnBinResolvePtr(bntxData.data_void, dataPointers[0]), texture->dataSize
     );
 
     ConsBuffer deswizzled = deswizzle_block_linear(
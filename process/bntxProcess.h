@@ -5,23 +5,27 @@
 
 #include "nnBin.h"
 
-void BntxPreprocess(ConsBuffer bntxData);
+void BntxPreprocess(ConsBufferView bntxData);
 
-const char* BntxGetTextureGroupName(ConsBuffer bntxData);
+// Relocate the texture group in place; see BeaRelocate.
+// Returns true on success, false if the relocation table is invalid.
+bool BntxRelocate(ConsBufferView bntxData);
 
-u32 BntxGetTextureCount(ConsBuffer bntxData);
+const char* BntxGetTextureGroupName(ConsBufferView bntxData);
+
+u32 BntxGetTextureCount(ConsBufferView bntxData);
 
 // Returns <0 if texture is not found.
-s64 BntxFindTextureIndex(ConsBuffer bntxData, const char* textureName);
+s64 BntxFindTextureIndex(ConsBufferView bntxData, const char* textureName);
 
-NnString* BntxGetTextureName(ConsBuffer bntxData, u32 textureIndex);
+NnString* BntxGetTextureName(ConsBufferView bntxData, u32 textureIndex);
 
-u32 BntxGetTextureFormat(ConsBuffer bntxData, u32 textureIndex);
-u32 BntxGetTextureTileMode(ConsBuffer bntxData, u32 textureIndex);
+u32 BntxGetTextureFormat(ConsBufferView bntxData, u32 textureIndex);
+u32 BntxGetTextureTileMode(ConsBufferView bntxData, u32 textureIndex);
 
-u32 BntxGetTextureWidth(ConsBuffer bntxData, u32 textureIndex);
-u32 BntxGetTextureHeight(ConsBuffer bntxData, u32 textureIndex);
+u32 BntxGetTextureWidth(ConsBufferView bntxData, u32 textureIndex);
+u32 BntxGetTextureHeight(ConsBufferView bntxData, u32 textureIndex);
 
-ConsBuffer BntxDecodeTexture(ConsBuffer bntxData, u32 textureIndex);
+ConsBuffer BntxDecodeTexture(ConsBufferView bntxData, u32 textureIndex);
 
 #endif // BNTX_PROCESS_H
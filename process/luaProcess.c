@@ -4,6 +4,10 @@
 
 #include "../cons/error.h"
 
+#include "../cons/file.h"
+
+#include "../cons/hash.h"
+
 #include <string.h>
 
 #include <stddef.h>
@@ -32,18 +36,28 @@ typedef struct __attribute__((packed)) {
 
 typedef struct __attribute__((packed)) {
     u32 identifier; // Compare to BZLA_MAGIC.
-    char sourceHash[16]; // MD5 (?) hash of the original source file.
+    char sourceHash[LUA_SOURCE_HASH_SIZE]; // MD5 hash of the original source file.
     u8 bytecode[0];
 } LuaFileHeader;
 
+bool LuaIsValid(ConsBufferView luaData) {
+    if (luaData.size < sizeof(LuaFileHeader) + sizeof(LuaBytecodeHeader))
+        return false;
+
+    const LuaFileHeader* fileHeader = luaData.data_void;
+    const LuaBytecodeHeader* bytecodeHeader = (LuaBytecodeHeader*)fileHeader->bytecode;
+
+    return fileHeader->identifier == BZLA_MAGIC && bytecodeHeader->identifier == _LUA_MAGIC;
+}
+
 void LuaPreprocess(ConsBufferView luaData) {
     const LuaFileHeader* fileHeader = luaData.data_void;
     
     if (fileHeader->identifier != BZLA_MAGIC)
         Panic("LuaPreprocess: header identifier is nonmatching");
 
-    static const char emptyHash[16] = { 0 };
-    if (memcmp(fileHeader->sourceHash, emptyHash, 16) == 0)
+    static const char emptyHash[LUA_SOURCE_HASH_SIZE] = { 0 };
+    if (memcmp(fileHeader->sourceHash, emptyHash, LUA_SOURCE_HASH_SIZE) == 0)
         Warn("LuaPreprocess: source file hash is empty");
 
     const LuaBytecodeHeader* bytecodeHeader = (LuaBytecodeHeader*)fileHeader->bytecode;
@@ -79,22 +93,63 @@ ConsBufferView LuaGetBytecode(ConsBufferView luaData) {
     );
 }
 
-ConsBuffer LuaBuild(const char* luaSource) {
-    ConsBuffer bytecodeBuffer = LuacCompile(luaSource);
-    if (!BufferIsValid(&bytecodeBuffer))
-        Panic("LuaBuild: failed to compile lua");
-    
-    ConsBuffer luaBuffer;
-    BufferInit(&luaBuffer, sizeof(LuaFileHeader) + bytecodeBuffer.size);
+void LuaHashSource(const char* luaSource, u64 luaSourceSize, u8 outHash[LUA_SOURCE_HASH_SIZE]) {
+    HashMd5(luaSource, luaSourceSize, outHash);
+}
 
-    LuaFileHeader* fileHeader = luaBuffer.data_void;
+bool LuaFileMatchesSource(const char* luaPath, const u8 sourceHash[LUA_SOURCE_HASH_SIZE]) {
+    // Only the headers are read, the bytecode doesn't matter.
+    u8 headers[sizeof(LuaFileHeader) + sizeof(LuaBytecodeHeader)];
 
-    fileHeader->identifier = BZLA_MAGIC;
-    memset(fileHeader->sourceHash, 0xFF, 16); // TODO: replace with MD5 impl
+    ConsFile file;
+    if (!FileOpenRead(&file, luaPath))
+        return false;
 
-    memcpy(fileHeader->bytecode, bytecodeBuffer.data_void, bytecodeBuffer.size);
+    const bool read = FileReadAt(&file, headers, 0, sizeof(headers));
+    FileClose(&file);
+
+    if (!read || !LuaIsValid(BufferViewFromPtr(headers, sizeof(headers))))
+        return false;
+
+    const LuaFileHeader* fileHeader = (LuaFileHeader*)headers;
+    return memcmp(fileHeader->sourceHash, sourceHash, LUA_SOURCE_HASH_SIZE) == 0;
+}
+
+ConsBuffer LuaBuildWithCompiler(
+    LuacCompiler* compiler, const char* luaSource, u64 luaSourceSize,
+    const u8 sourceHash[LUA_SOURCE_HASH_SIZE]
+) {
+    // Bytecode is usually smaller than its source.
+    ConsBufferBuilder builder;
+    BufferBuilderInit(&builder, sizeof(LuaFileHeader) + luaSourceSize);
+
+    LuaFileHeader fileHeader = { 0 };
+    fileHeader.identifier = BZLA_MAGIC;
+    if (sourceHash != NULL)
+        memcpy(fileHeader.sourceHash, sourceHash, LUA_SOURCE_HASH_SIZE);
+    else
+        LuaHashSource(luaSource, luaSourceSize, (u8*)fileHeader.sourceHash);
+
+    BufferBuilderAppend(&builder, &fileHeader, sizeof(LuaFileHeader));
+
+    // Dumped right after the header, without an intermediate copy.
+    if (!LuacCompilerRun(compiler, luaSource, luaSourceSize, luaSource, &builder)) {
+        BufferBuilderDestroy(&builder);
+        return (ConsBuffer){ 0 };
+    }
+
+    return BufferBuilderFinish(&builder);
+}
+
+ConsBuffer LuaBuild(const char* luaSource) {
+    LuacCompiler compiler;
+    LuacCompilerInit(&compiler);
+
+    ConsBuffer file = LuaBuildWithCompiler(&compiler, luaSource, strlen(luaSource), NULL);
+    if (!BufferIsValid(&file))
+        Panic("LuaBuild: failed to compile lua");
 
-    BufferDestroy(&bytecodeBuffer);
+    LuacCompilerDestroy(&compiler);
 
-    return luaBuffer;
+    return file;
 }
@@ -3,13 +3,38 @@
 
 #include "../cons/buffer.h"
 
+#include "../lua/luacInterface.h"
+
+// Check if data looks like a BZLA file (only the size & identifiers are checked), e.g. to skip
+// other files in a directory.
+bool LuaIsValid(ConsBufferView luaData);
+
 void LuaPreprocess(ConsBufferView luaData);
 
-// 128-bit hash (probably MD5) of the source file.
+#define LUA_SOURCE_HASH_SIZE (16)
+
+// 128-bit hash (MD5) of the source file.
 const char* LuaGetSourceHash(ConsBufferView luaData);
 
+// Hash Lua source like it's stored in a BZLA file (the terminator, if any, is not included).
+void LuaHashSource(const char* luaSource, u64 luaSourceSize, u8 outHash[LUA_SOURCE_HASH_SIZE]);
+
+// Check if the file at luaPath is a BZLA file built from source with the given hash, i.e. it
+// doesn't need to be rebuilt. Only the headers are read.
+// Returns false if it doesn't match, or the file is missing or invalid.
+bool LuaFileMatchesSource(const char* luaPath, const u8 sourceHash[LUA_SOURCE_HASH_SIZE]);
+
 ConsBufferView LuaGetBytecode(ConsBufferView luaData);
 
 ConsBuffer LuaBuild(const char* luaSource);
 
+// Build a BZLA file with a reusable compiler (see LuacCompiler). luaSource must be
+// null-terminated (like in LuaBuild, the source names itself in the bytecode).
+// sourceHash is stored in the header; pass NULL to hash the source here (see LuaHashSource).
+// Returns the file, or an invalid buffer if the source failed to compile.
+ConsBuffer LuaBuildWithCompiler(
+    LuacCompiler* compiler, const char* luaSource, u64 luaSourceSize,
+    const u8 sourceHash[LUA_SOURCE_HASH_SIZE]
+);
+
 #endif // LUA_PROCESS_H
@@ -1,7 +1,16 @@
 #include "nnBin.h"
 
+#include "../cons/ptrie.h"
+#include "../cons/error.h"
+
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 bool NnFileHeaderCheckVer(
     const NnFileHeader* fileHeader, u16 versionMajor, u8 versionMinor, u8 versionBugfix
 ) {
@@ -36,7 +45,7 @@ static u32 _NnDicExtractRefBit(const char* key, u32 keyLen, u32 refBit) {
 }
 
 const NnDicNode* NnDicFind(void* baseData, const NnDic* dic, const char* key) {
-    if (baseData == NULL || dic == NULL || key == NULL)
+    if (dic == NULL || key == NULL)
         return NULL;
 
     const u32 keyLength = strlen(key);
@@ -56,7 +65,9 @@ const NnDicNode* NnDicFind(void* baseData, const NnDic* dic, const char* key) {
         node = dic->nodes + nextIndex;
     }
 
-    const NnString* nodeKey = (NnString*)((u8*)baseData + node->namePtr);
+    const NnString* nodeKey = (baseData == NULL) ?
+        (NnString*)node->namePtr :
+        (NnString*)((u8*)baseData + node->namePtr);
     if (nodeKey->len != keyLength)
         return NULL;
     if (strncmp(nodeKey->str, key, nodeKey->len) != 0)
@@ -65,33 +76,387 @@ const NnDicNode* NnDicFind(void* baseData, const NnDic* dic, const char* key) {
     return node;
 }
 
-void NnRelocTableApply(NnRelocTable* table) {
-    if (table == NULL)
-        return;
+bool NnDicBuild(NnDic* dic, const char* const* keys, const u32* keyLens, u32 keyCount) {
+    if (dic == NULL || (keys == NULL && keyCount > 0))
+        return false;
+    // Node indices are 16-bit, and the root node takes up one of them.
+    if (keyCount > 0xFFFF)
+        return false;
+
+    // Key lengths by node index; the root node holds the empty string.
+    u64* nodeKeyLens = malloc(sizeof(u64) * (keyCount + 1));
+    nodeKeyLens[0] = 0;
+    for (u32 i = 0; i < keyCount; i++)
+        nodeKeyLens[i + 1] = keyLens ? keyLens[i] : strlen(keys[i]);
+
+    NnDicNode* nodes = dic->nodes;
+
+    dic->signature = NN__DIC_MAGIC;
+    dic->nodeCount = (s32)keyCount;
+
+    nodes[0].refBitPos = -1;
+    nodes[0].leftIndex = 0;
+    nodes[0].rightIndex = 0;
+    nodes[0].namePtr = 0;
+
+    for (u32 i = 0; i < keyCount; i++) {
+        const char* key = keys[i];
+        const u64 keyLen = nodeKeyLens[i + 1];
+        const u16 nodeIndex = (u16)(i + 1);
+
+        // Find the existing key that's closest to the new one ..
+        const NnDicNode* parent = nodes;
+        u16 childIndex = nodes[0].leftIndex;
+        while (parent->refBitPos < nodes[childIndex].refBitPos) {
+            parent = nodes + childIndex;
+            childIndex = PtrieExtractRefBit(key, keyLen, (u64)parent->refBitPos) ?
+                parent->rightIndex : parent->leftIndex;
+        }
+
+        const char* closestKey = (childIndex == 0) ? "" : keys[childIndex - 1];
+        const u64 diffBit = PtrieGetFirstDifferingBit(
+            key, keyLen, closestKey, nodeKeyLens[childIndex]
+        );
+        if (diffBit == (u64)-1) {
+            free(nodeKeyLens);
+            return false;
+        }
+
+        // .. then walk down again, stopping where the new node's bit belongs.
+        NnDicNode* insertParent = nodes;
+        childIndex = nodes[0].leftIndex;
+        while (
+            insertParent->refBitPos < nodes[childIndex].refBitPos &&
+            (u64)nodes[childIndex].refBitPos < diffBit
+        ) {
+            insertParent = nodes + childIndex;
+            childIndex = PtrieExtractRefBit(key, keyLen, (u64)insertParent->refBitPos) ?
+                insertParent->rightIndex : insertParent->leftIndex;
+        }
+
+        NnDicNode* node = nodes + nodeIndex;
+
+        node->refBitPos = (s32)diffBit;
+        node->namePtr = 0;
+        if (PtrieExtractRefBit(key, keyLen, diffBit)) {
+            node->leftIndex = childIndex;
+            node->rightIndex = nodeIndex;
+        }
+        else {
+            node->leftIndex = nodeIndex;
+            node->rightIndex = childIndex;
+        }
+
+        // The root node (bit npos) always follows it's left branch.
+        if (PtrieExtractRefBit(key, keyLen, (u64)(s64)insertParent->refBitPos))
+            insertParent->rightIndex = nodeIndex;
+        else
+            insertParent->leftIndex = nodeIndex;
+    }
+
+    free(nodeKeyLens);
+    return true;
+}
+
+// Add base to every non-null pointer in the list, two pointers at a time where possible.
+static inline void _RelocPointerList(u64* restrict pointers, u32 count, u64 base) {
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    const __m128i vBase = _mm_set1_epi64x((long long)base);
+    const __m128i vZero = _mm_setzero_si128();
+    for (; i + 2 <= count; i += 2) {
+        __m128i vPtr = _mm_loadu_si128((const __m128i*)(pointers + i));
+
+        // SSE2 has no 64-bit compare; combine the two 32-bit halves instead.
+        __m128i isZero32 = _mm_cmpeq_epi32(vPtr, vZero);
+        __m128i isZero64 = _mm_and_si128(isZero32, _mm_shuffle_epi32(isZero32, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        vPtr = _mm_add_epi64(vPtr, _mm_andnot_si128(isZero64, vBase));
+        _mm_storeu_si128((__m128i*)(pointers + i), vPtr);
+    }
+#elif defined(__aarch64__)
+    const uint64x2_t vBase = vdupq_n_u64(base);
+    for (; i + 2 <= count; i += 2) {
+        uint64x2_t vPtr = vld1q_u64(pointers + i);
+        uint64x2_t isNonZero = vtstq_u64(vPtr, vPtr);
 
-    void* binStart = (void*)((u8*)table - table->selfOffset);
-    // NnFileHeader* fileHeader = (NnFileHeader*)binStart;
+        vst1q_u64(pointers + i, vaddq_u64(vPtr, vandq_u64(isNonZero, vBase)));
+    }
+#endif
+
+    for (; i < count; i++)
+        pointers[i] += base & (0 - (u64)(pointers[i] != 0));
+}
+
+// Check that every section, entry & pointer list of the table lies within the binary, and that
+// no pointer list overlaps the table itself (patching it would change entries still to be read).
+static bool _RelocTableIsValid(const NnRelocTable* table, u64 tableOffset, u64 binSize) {
+    if (table->signature != NN__RLT_MAGIC || table->selfOffset != tableOffset)
+        return false;
+
+    const u64 sectionsEnd = tableOffset + sizeof(NnRelocTable) +
+        (sizeof(NnRelocSection) * (u64)table->sectionCount);
+    if (sectionsEnd > binSize)
+        return false;
 
-    const NnRelocEntry* entries = (NnRelocEntry*)(table->sections + table->sectionCount);
+    const u64 maxEntryCount = (binSize - sectionsEnd) / sizeof(NnRelocEntry);
 
+    u64 entryCount = 0;
     for (u32 sectionIndex = 0; sectionIndex < table->sectionCount; sectionIndex++) {
         const NnRelocSection* section = table->sections + sectionIndex;
 
-        for (u32 entryIndex = 0; entryIndex < section->entryCount; entryIndex++) {
-            const NnRelocEntry* entry = entries + section->firstEntryIndex + entryIndex;
+        if ((u64)section->dataOffset + section->dataSize > binSize)
+            return false;
+        if (section->firstEntryIndex < 0)
+            return false;
+
+        const u64 entriesEnd = (u64)section->firstEntryIndex + section->entryCount;
+        if (entriesEnd > maxEntryCount)
+            return false;
+
+        entryCount = MAX(entryCount, entriesEnd);
+    }
+
+    const u64 tableEnd = sectionsEnd + (sizeof(NnRelocEntry) * entryCount);
+
+    const NnRelocEntry* entries = NnRelocTableGetEntries(table);
+    for (u64 i = 0; i < entryCount; i++) {
+        const NnRelocEntry* entry = entries + i;
+        if (entry->pointerListCount == 0 || entry->pointersPerList == 0)
+            continue;
+
+        // The skip after the last list isn't touched. Can't overflow: at most 65535 lists of
+        // 510 pointers.
+        const u64 listStride = (u64)entry->pointersPerList + entry->pointerListSkip;
+        const u64 runStart = entry->offsetToPointerList;
+        const u64 runEnd = runStart + sizeof(u64) *
+            ((listStride * (entry->pointerListCount - 1)) + entry->pointersPerList);
+
+        if (runEnd > binSize)
+            return false;
+        if (runStart < tableEnd && runEnd > tableOffset)
+            return false;
+    }
+
+    return true;
+}
+
+bool NnRelocTableApply(void* binStart, u64 binSize) {
+    NnFileHeader* fileHeader = (NnFileHeader*)binStart;
+    if (binStart == NULL || binSize < sizeof(NnFileHeader))
+        return false;
+
+    if (NnFileHeaderIsRelocated(fileHeader))
+        return true;
+
+    const u64 tableOffset = fileHeader->relocationTableOffset;
+    if (tableOffset + sizeof(NnRelocTable) > binSize)
+        return false;
+
+    NnRelocTable* table = (NnRelocTable*)((u8*)binStart + tableOffset);
+
+    // Nothing is patched unless the whole table checks out.
+    if (!_RelocTableIsValid(table, tableOffset, binSize))
+        return false;
+
+    const u64 base = (u64)binStart;
+    const NnRelocEntry* entries = NnRelocTableGetEntries(table);
+
+    for (u32 sectionIndex = 0; sectionIndex < table->sectionCount; sectionIndex++) {
+        NnRelocSection* section = table->sections + sectionIndex;
+        section->_dataAddress = base + section->dataOffset;
+
+        const NnRelocEntry* entry = entries + section->firstEntryIndex;
+        const NnRelocEntry* entriesEnd = entry + section->entryCount;
 
+        for (; entry < entriesEnd; entry++) {
             u64* currentPointerList = (u64*)((u8*)binStart + entry->offsetToPointerList);
+
+            const u32 pointersPerList = entry->pointersPerList;
+            const u32 listStride = pointersPerList + entry->pointerListSkip;
+
             for (u32 pointerListIdx = 0; pointerListIdx < entry->pointerListCount; pointerListIdx++) {
-                for (u32 pointerIndex = 0; pointerIndex < entry->pointersPerList; pointerIndex++) {
-                    if (*currentPointerList != 0)
-                        *currentPointerList += (u64)binStart;
-                    currentPointerList++;
+                _RelocPointerList(currentPointerList, pointersPerList, base);
+                currentPointerList += listStride;
+            }
+        }
+    }
+
+    fileHeader->flags |= NN_FILE_FLAG_RELOCATED;
+    return true;
+}
+
+typedef struct _NnRelocBuilderSection {
+    u32 dataOffset;
+    u32 dataSize;
+
+    ConsList pointerOffsets; // u64
+    ConsList entries; // NnRelocEntry
+} _NnRelocBuilderSection;
+
+void NnRelocBuilderInit(NnRelocBuilder* builder) {
+    ListInit(&builder->sections, sizeof(_NnRelocBuilderSection), 1);
+    builder->entryCount = 0;
+}
+
+void NnRelocBuilderDestroy(NnRelocBuilder* builder) {
+    if (builder == NULL)
+        return;
+
+    for (u64 i = 0; i < builder->sections.elementCount; i++) {
+        _NnRelocBuilderSection* section = ListGet(&builder->sections, i);
+        ListDestroy(&section->pointerOffsets);
+        ListDestroy(&section->entries);
+    }
+    ListDestroy(&builder->sections);
+
+    builder->entryCount = 0;
+}
+
+void NnRelocBuilderBeginSection(NnRelocBuilder* builder, u32 dataOffset, u32 dataSize) {
+    _NnRelocBuilderSection section;
+    section.dataOffset = dataOffset;
+    section.dataSize = dataSize;
+
+    ListInit(&section.pointerOffsets, sizeof(u64), 64);
+    ListInit(&section.entries, sizeof(NnRelocEntry), 16);
+
+    ListAdd(&builder->sections, &section);
+}
+
+void NnRelocBuilderAddPointer(NnRelocBuilder* builder, u64 pointerOffset) {
+    if (ListIsEmpty(&builder->sections))
+        Panic("NnRelocBuilderAddPointer: no section has been started");
+    if (pointerOffset > 0xFFFFFFFF)
+        Panic("NnRelocBuilderAddPointer: pointer offset exceeds max of 0xFFFFFFFF");
+
+    _NnRelocBuilderSection* section = ListGet(&builder->sections, builder->sections.elementCount - 1);
+    ListAdd(&section->pointerOffsets, &pointerOffset);
+}
+
+static int _CompareOffsets(const void* a, const void* b) {
+    const u64 offsetA = *(const u64*)a;
+    const u64 offsetB = *(const u64*)b;
+    return (offsetA > offsetB) - (offsetA < offsetB);
+}
+
+// Greedily merge sorted, unique pointer offsets into entries: the first run of consecutive
+// pointers becomes the list size, then as many following lists with the same size & spacing
+// as possible are folded into the same entry.
+static void _MergeRelocEntries(const u64* offsets, u64 offsetCount, ConsList* outEntries) {
+    u64 i = 0;
+    while (i < offsetCount) {
+        const u64 listStart = offsets[i];
+
+        u64 pointersPerList = 1;
+        while (
+            i + pointersPerList < offsetCount && pointersPerList < 0xFF &&
+            offsets[i + pointersPerList] == offsets[i + pointersPerList - 1] + sizeof(u64)
+        )
+            pointersPerList++;
+
+        u64 listCount = 1;
+        u64 listSkip = 0;
+
+        u64 next = i + pointersPerList;
+        if (next < offsetCount && ((offsets[next] - offsets[next - 1]) % sizeof(u64)) == 0) {
+            listSkip = (offsets[next] - offsets[next - 1]) / sizeof(u64) - 1;
+
+            if (listSkip <= 0xFF) {
+                const u64 listStride = (pointersPerList + listSkip) * sizeof(u64);
+
+                while (listCount < 0xFFFF && next + pointersPerList <= offsetCount) {
+                    const u64 expectStart = listStart + (listCount * listStride);
+
+                    u64 matched = 0;
+                    while (
+                        matched < pointersPerList &&
+                        offsets[next + matched] == expectStart + (matched * sizeof(u64))
+                    )
+                        matched++;
+
+                    if (matched != pointersPerList)
+                        break;
+
+                    listCount++;
+                    next += pointersPerList;
                 }
-                currentPointerList += entry->pointerListSkip;
             }
+
+            if (listCount == 1)
+                listSkip = 0;
         }
+
+        NnRelocEntry entry;
+        entry.offsetToPointerList = (u32)listStart;
+        entry.pointerListCount = (u16)listCount;
+        entry.pointersPerList = (u8)pointersPerList;
+        entry.pointerListSkip = (u8)listSkip;
+
+        ListAdd(outEntries, &entry);
+
+        i += listCount * pointersPerList;
     }
+}
+
+void NnRelocBuilderFinalize(NnRelocBuilder* builder) {
+    builder->entryCount = 0;
+
+    for (u64 sectionIdx = 0; sectionIdx < builder->sections.elementCount; sectionIdx++) {
+        _NnRelocBuilderSection* section = ListGet(&builder->sections, sectionIdx);
+
+        u64* offsets = (u64*)section->pointerOffsets.data;
+        u64 offsetCount = section->pointerOffsets.elementCount;
+
+        qsort(offsets, offsetCount, sizeof(u64), _CompareOffsets);
 
-    // Hmmm .. Maybe we should leave the file header alone ..
-    // fileHeader->flags |= 1;
+        // Remove duplicates.
+        u64 uniqueCount = 0;
+        for (u64 i = 0; i < offsetCount; i++) {
+            if (uniqueCount == 0 || offsets[uniqueCount - 1] != offsets[i])
+                offsets[uniqueCount++] = offsets[i];
+        }
+        section->pointerOffsets.elementCount = uniqueCount;
+
+        ListClear(&section->entries);
+        _MergeRelocEntries(offsets, uniqueCount, &section->entries);
+
+        builder->entryCount += section->entries.elementCount;
+    }
+}
+
+u64 NnRelocBuilderGetSize(const NnRelocBuilder* builder) {
+    return sizeof(NnRelocTable) +
+        (sizeof(NnRelocSection) * builder->sections.elementCount) +
+        (sizeof(NnRelocEntry) * builder->entryCount);
+}
+
+void NnRelocBuilderWrite(const NnRelocBuilder* builder, void* binStart, u64 tableOffset) {
+    NnRelocTable* table = (NnRelocTable*)((u8*)binStart + tableOffset);
+
+    table->signature = NN__RLT_MAGIC;
+    table->selfOffset = (u32)tableOffset;
+    table->sectionCount = (u32)builder->sections.elementCount;
+    table->_pad32 = 0x00000000;
+
+    NnRelocEntry* entries = (NnRelocEntry*)NnRelocTableGetEntries(table);
+    u64 entryIndex = 0;
+
+    for (u32 sectionIdx = 0; sectionIdx < table->sectionCount; sectionIdx++) {
+        _NnRelocBuilderSection* section = ListGet((ConsList*)&builder->sections, sectionIdx);
+        NnRelocSection* outSection = table->sections + sectionIdx;
+
+        outSection->_dataAddress = 0x0000000000000000;
+        outSection->dataOffset = section->dataOffset;
+        outSection->dataSize = section->dataSize;
+        outSection->firstEntryIndex = (s32)entryIndex;
+        outSection->entryCount = (u32)section->entries.elementCount;
+
+        memcpy(
+            entries + entryIndex, section->entries.data,
+            sizeof(NnRelocEntry) * section->entries.elementCount
+        );
+        entryIndex += section->entries.elementCount;
+    }
 }
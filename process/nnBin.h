@@ -4,6 +4,8 @@
 #include "../cons/type.h"
 #include "../cons/macro.h"
 
+#include "../cons/list.h"
+
 #include <stdlib.h>
 
 #define NN_BOM_FOREIGN (0xFFFE)
@@ -28,7 +30,7 @@ typedef struct __attribute__((packed)) {
 
     u32 filenameOffset; // Offset to a null-terminated string containing the filename. Might be unused.
 
-    u16 flags; // Bit 0: relocated
+    u16 flags; // See NN_FILE_FLAG_*.
 
     u16 firstBlockOffset;
     u32 relocationTableOffset;
@@ -39,6 +41,20 @@ typedef struct __attribute__((packed)) {
 } NnFileHeader;
 STRUCT_SIZE_ASSERT(NnFileHeader, 0x20);
 
+#define NN_FILE_FLAG_RELOCATED (1 << 0)
+
+static inline bool NnFileHeaderIsRelocated(const NnFileHeader* fileHeader) {
+    return (fileHeader->flags & NN_FILE_FLAG_RELOCATED) != 0;
+}
+
+// Resolve a relocatable pointer field of the binary starting at binStart. Once the binary
+// has been relocated the field already holds the address, otherwise it holds an offset.
+static inline void* NnBinResolvePtr(const void* binStart, u64 ptr) {
+    if (NnFileHeaderIsRelocated((const NnFileHeader*)binStart))
+        return (void*)ptr;
+    return (void*)((u8*)binStart + ptr);
+}
+
 // Returns true if the version is matching, false if not. Accounts for foreign endianness.
 bool NnFileHeaderCheckVer(
     const NnFileHeader* fileHeader, u16 versionMajor, u8 versionMinor, u8 versionBugfix
@@ -102,6 +118,17 @@ STRUCT_SIZE_ASSERT(NnDic, 0x18);
 // set baseData to NULL if dictionary is relocated.
 const NnDicNode* NnDicFind(void* baseData, const NnDic* dic, const char* key);
 
+// Size of a dictionary holding keyCount entries (the root node is included in NnDic).
+static inline u64 NnDicGetSize(u32 keyCount) {
+    return sizeof(NnDic) + (sizeof(NnDicNode) * keyCount);
+}
+
+// Build a dictionary in the layout used by official tooling: keyCount + 1 nodes, where node
+// i + 1 refers to keys[i]. The name pointers are zeroed; filling them in is up to the caller.
+// keyLens may be NULL, in which case the keys must be null-terminated.
+// Returns false if there are too many keys or a key is duplicated.
+bool NnDicBuild(NnDic* dic, const char* const* keys, const u32* keyLens, u32 keyCount);
+
 static inline u32 NnDicNodeGetIndex(const NnDic* dic, const NnDicNode* node) {
     if (dic == NULL || node == NULL)
         return (u32)-1;
@@ -143,6 +170,37 @@ static inline const NnRelocEntry* NnRelocTableGetEntries(const NnRelocTable* tab
     return (NnRelocEntry*)(table->sections + table->sectionCount);
 }
 
-void NnRelocTableApply(NnRelocTable* table);
+// Relocate every pointer listed in the relocation table of the binary (binSize bytes at
+// binStart, in place) and mark it as relocated. Does nothing if it's already relocated.
+// The whole table is checked against binSize first; nothing is patched if it's inconsistent.
+// Returns true on success, false if the table is out of bounds or inconsistent.
+bool NnRelocTableApply(void* binStart, u64 binSize);
+
+// Collects the offsets of every pointer that needs relocation and merges them into as few
+// (strided) relocation entries as possible.
+typedef struct NnRelocBuilder {
+    ConsList sections; // Internal section list.
+    u64 entryCount; // Valid after finalizing.
+} NnRelocBuilder;
+
+void NnRelocBuilderInit(NnRelocBuilder* builder);
+void NnRelocBuilderDestroy(NnRelocBuilder* builder);
+
+// Start a new section. Pointers added after this belong to the new section.
+void NnRelocBuilderBeginSection(NnRelocBuilder* builder, u32 dataOffset, u32 dataSize);
+
+// Register a pointer (offset relative to the start of the file) that needs relocation.
+// Pointers may be added in any order; duplicates are ignored.
+void NnRelocBuilderAddPointer(NnRelocBuilder* builder, u64 pointerOffset);
+
+// Merge the registered pointers into relocation entries. Must be called before querying
+// the size of the table or writing it.
+void NnRelocBuilderFinalize(NnRelocBuilder* builder);
+
+// Size of the relocation table (including sections & entries).
+u64 NnRelocBuilderGetSize(const NnRelocBuilder* builder);
+
+// Write the relocation table to binStart + tableOffset (which must be aligned to 8 bytes).
+void NnRelocBuilderWrite(const NnRelocBuilder* builder, void* binStart, u64 tableOffset);
 
 #endif // NN_BIN_H
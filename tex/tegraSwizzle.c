@@ -206,7 +206,8 @@ ConsBuffer deswizzle_block_linear(
         return (ConsBuffer){ 0 };
 
     ConsBuffer buffer;
-    BufferInit(&buffer, deswizzled_mip_size(width, height, depth, bytesPerPixel));
+    // Every byte is written by swizzle_inner.
+    BufferInitUninit(&buffer, deswizzled_mip_size(width, height, depth, bytesPerPixel));
 
     u64 blockDepth = block_depth(depth);
 